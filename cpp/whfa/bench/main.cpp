@@ -0,0 +1,67 @@
+/**
+ * @file bench/main.cpp
+ * @author Robert Griffith
+ */
+#include "bench/queue.h"
+
+#include <cstdlib>
+#include <iostream>
+
+namespace wb = whfa::bench;
+
+namespace
+{
+
+    /// @brief default number of elements passed through each queue
+    constexpr size_t __DEF_NELEMS = 200000;
+
+    /**
+     * @brief print CLI usage
+     */
+    void print_usage()
+    {
+        std::cout << "\
+usage:\n\
+   <application> [number of elements]\n\
+\n\
+benchmarks util queues under pipeline patterns, reporting throughput and handoff latency\n\
+\n";
+    }
+
+}
+
+/**
+ * @brief application entry point
+ *
+ * @param argc number of cli arguments
+ * @param argv cli arguments
+ * @return 0 on success, 1 on error
+ */
+int main(int argc, char **argv)
+{
+    if (argc > 2)
+    {
+        print_usage();
+        return 1;
+    }
+    size_t nelems = __DEF_NELEMS;
+    if (argc == 2)
+    {
+        const long n = std::strtol(argv[1], nullptr, 0);
+        if (n <= 0)
+        {
+            print_usage();
+            return 1;
+        }
+        nelems = static_cast<size_t>(n);
+    }
+
+    std::cout << "benchmarking util queues with " << nelems << " elements" << std::endl;
+    wb::bench_steady(nelems);
+    wb::bench_bursty(nelems);
+    wb::bench_one_to_many(nelems);
+    wb::bench_flush_storm(nelems);
+    wb::bench_epoch_storm(nelems);
+
+    return 0;
+}
\ No newline at end of file
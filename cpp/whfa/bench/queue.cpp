@@ -0,0 +1,334 @@
+/**
+ * @file bench/queue.cpp
+ * @author Robert Griffith
+ */
+#include "bench/queue.h"
+
+#include "util/bpqueue.h"
+#include "util/dbpqueue.h"
+#include "util/spscpqueue.h"
+
+#include <algorithm>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+namespace wu = whfa::util;
+
+namespace
+{
+
+    /// @brief capacity of queues under benchmark (matches context defaults)
+    constexpr size_t __QCAP = 1024;
+    /// @brief number of elements per burst (frames decoded from one packet)
+    constexpr size_t __BURSTSZ = 8;
+    /// @brief pause between bursts
+    constexpr std::chrono::microseconds __BURSTGAP(20);
+    /// @brief pause between flushes or epoch advances
+    constexpr std::chrono::microseconds __FLUSHGAP(500);
+    /// @brief number of consumers in one to many benchmarks
+    constexpr size_t __NCONSUMERS = 2;
+
+    /// @brief convenience alias for benchmark clock
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * @struct Item
+     * @brief queued element carrying its push time
+     */
+    struct Item
+    {
+        /// @brief time immediately before pushing
+        Clock::time_point pushed;
+    };
+
+    /**
+     * @enum Storm
+     * @brief enum defining interference from a third thread while benchmarking
+     */
+    enum Storm
+    {
+        /// @brief no interference
+        STORM_NONE,
+        /// @brief repeated flush()
+        STORM_FLUSH,
+        /// @brief repeated advance_epoch()
+        STORM_EPOCH
+    };
+
+    /**
+     * @brief pop until end sentinel (nullptr), recording handoff latency of each element
+     *
+     * @param[out] q queue to pop from
+     * @param[out] lat latencies in nanoseconds
+     */
+    void consume(wu::PQueue<Item> &q, std::vector<uint64_t> &lat)
+    {
+        Item *item;
+        while (true)
+        {
+            if (!q.pop(item))
+            {
+                // flushed
+                continue;
+            }
+            if (item == nullptr)
+            {
+                return;
+            }
+            lat.push_back(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - item->pushed).count());
+        }
+    }
+
+    /**
+     * @brief push elements one at a time as fast as possible
+     *
+     * @param[out] q queue to push to
+     * @param[out] items elements to push
+     * @param n number of elements
+     */
+    void produce_steady(wu::PQueue<Item> &q, Item *items, size_t n)
+    {
+        for (size_t i = 0; i < n; ++i)
+        {
+            items[i].pushed = Clock::now();
+            q.push(&(items[i]));
+        }
+    }
+
+    /**
+     * @brief push elements in bursts separated by pauses
+     *
+     * @param[out] q queue to push to
+     * @param[out] items elements to push
+     * @param n number of elements
+     */
+    void produce_bursty(wu::PQueue<Item> &q, Item *items, size_t n)
+    {
+        Item *batch[__BURSTSZ];
+        for (size_t i = 0; i < n; i += __BURSTSZ)
+        {
+            const size_t m = std::min(__BURSTSZ, n - i);
+            const Clock::time_point now = Clock::now();
+            for (size_t j = 0; j < m; ++j)
+            {
+                items[i + j].pushed = now;
+                batch[j] = &(items[i + j]);
+            }
+            q.push_n(batch, m);
+            std::this_thread::sleep_for(__BURSTGAP);
+        }
+    }
+
+    /**
+     * @brief get latency percentile
+     *
+     * @param lat sorted latencies
+     * @param pct percentile in [0,1]
+     * @return latency in nanoseconds, 0 if empty
+     */
+    uint64_t percentile(const std::vector<uint64_t> &lat, double pct)
+    {
+        if (lat.empty())
+        {
+            return 0;
+        }
+        const size_t i = std::min(lat.size() - 1, static_cast<size_t>(pct * lat.size()));
+        return lat[i];
+    }
+
+    /**
+     * @brief print benchmark table header
+     *
+     * @param name benchmark name
+     */
+    void print_header(const char *name)
+    {
+        std::cout << std::endl
+                  << name << std::endl
+                  << std::left << std::setw(28) << "queue"
+                  << std::right << std::setw(14) << "ops/sec"
+                  << std::setw(12) << "p50 (ns)"
+                  << std::setw(12) << "p99 (ns)"
+                  << std::setw(12) << "p999 (ns)" << std::endl;
+    }
+
+    /**
+     * @brief run producer, consumers, and optional storm thread over queue and print results
+     *
+     * @param name queue name
+     * @param producer queue to push to
+     * @param consumers queues to pop from, one thread each
+     * @param nsentinel number of end sentinels required to stop all consumers
+     * @param produce producer function
+     * @param storm interference from a third thread
+     * @param nelems number of elements to push
+     */
+    void run(const char *name, wu::PQueue<Item> &producer, const std::vector<wu::PQueue<Item> *> &consumers,
+             size_t nsentinel, void (*produce)(wu::PQueue<Item> &, Item *, size_t), Storm storm, size_t nelems)
+    {
+        Item *items = new Item[nelems];
+        std::vector<std::vector<uint64_t>> lats(consumers.size());
+        for (std::vector<uint64_t> &lat : lats)
+        {
+            lat.reserve(nelems);
+        }
+
+        const Clock::time_point start = Clock::now();
+        std::vector<std::thread> t_cs;
+        for (size_t i = 0; i < consumers.size(); ++i)
+        {
+            t_cs.emplace_back(consume, std::ref(*(consumers[i])), std::ref(lats[i]));
+        }
+        std::atomic<bool> stop(false);
+        std::thread t_s([&]
+                        {
+                            while (storm != STORM_NONE && !stop.load())
+                            {
+                                std::this_thread::sleep_for(__FLUSHGAP);
+                                if (storm == STORM_FLUSH)
+                                {
+                                    producer.flush();
+                                }
+                                else
+                                {
+                                    producer.advance_epoch();
+                                }
+                            } });
+        produce(producer, items, nelems);
+        stop.store(true);
+        t_s.join();
+        for (size_t i = 0; i < nsentinel; ++i)
+        {
+            // retry pushes failed due to flush signals left by the storm
+            while (!producer.push(nullptr))
+            {
+            }
+        }
+        for (std::thread &t_c : t_cs)
+        {
+            t_c.join();
+        }
+        const double secs = std::chrono::duration<double>(Clock::now() - start).count();
+
+        std::vector<uint64_t> lat;
+        for (const std::vector<uint64_t> &l : lats)
+        {
+            lat.insert(lat.end(), l.begin(), l.end());
+        }
+        std::sort(lat.begin(), lat.end());
+        std::cout << std::left << std::setw(28) << name
+                  << std::right << std::setw(14) << static_cast<uint64_t>(lat.size() / secs)
+                  << std::setw(12) << percentile(lat, 0.5)
+                  << std::setw(12) << percentile(lat, 0.99)
+                  << std::setw(12) << percentile(lat, 0.999) << std::endl;
+        delete[] items;
+    }
+
+    /**
+     * @brief run one producer one consumer benchmark on newly constructed queue
+     *
+     * @param name queue name
+     * @param produce producer function
+     * @param storm interference from a third thread
+     * @param nelems number of elements to push
+     */
+    template <typename Q>
+    void run_single(const char *name, void (*produce)(wu::PQueue<Item> &, Item *, size_t), Storm storm, size_t nelems)
+    {
+        Q q(__QCAP);
+        run(name, q, {&q}, 1, produce, storm, nelems);
+    }
+
+    /**
+     * @brief run one producer one consumer benchmark on broadcast queue with one consumer
+     *
+     * @param produce producer function
+     * @param storm interference from a third thread
+     * @param nelems number of elements to push
+     */
+    void run_single_broadcast(void (*produce)(wu::PQueue<Item> &, Item *, size_t), Storm storm, size_t nelems)
+    {
+        wu::BPQueue<Item> q(__QCAP);
+        wu::PQueue<Item> *c = q.subscribe();
+        run("BPQueue", *c, {c}, 1, produce, storm, nelems);
+    }
+
+    /**
+     * @brief run benchmark on all single consumer capable queues
+     *
+     * @param produce producer function
+     * @param storm interference from a third thread
+     * @param nelems number of elements to push
+     */
+    void run_all_single(void (*produce)(wu::PQueue<Item> &, Item *, size_t), Storm storm, size_t nelems)
+    {
+        run_single<wu::DBPQueue<Item>>("DBPQueue<BlockWait>", produce, storm, nelems);
+        run_single<wu::DBPQueue<Item, wu::SpinWait<>>>("DBPQueue<SpinWait>", produce, storm, nelems);
+        run_single<wu::DBPQueue<Item, wu::SpinFutexWait<>>>("DBPQueue<SpinFutexWait>", produce, storm, nelems);
+        run_single<wu::SPSCPQueue<Item>>("SPSCPQueue", produce, storm, nelems);
+        run_single_broadcast(produce, storm, nelems);
+    }
+
+    /**
+     * @brief run one producer multiple consumer benchmark on newly constructed shared queue
+     *
+     * @param name queue name
+     * @param nelems number of elements to push
+     */
+    template <typename Q>
+    void run_shared(const char *name, size_t nelems)
+    {
+        Q q(__QCAP);
+        run(name, q, std::vector<wu::PQueue<Item> *>(__NCONSUMERS, &q), __NCONSUMERS,
+            produce_steady, STORM_NONE, nelems);
+    }
+
+}
+
+namespace whfa::bench
+{
+
+    void bench_steady(size_t nelems)
+    {
+        print_header("steady 1:1");
+        run_all_single(produce_steady, STORM_NONE, nelems);
+    }
+
+    void bench_bursty(size_t nelems)
+    {
+        print_header("bursty 1:1");
+        run_all_single(produce_bursty, STORM_NONE, nelems);
+    }
+
+    void bench_one_to_many(size_t nelems)
+    {
+        print_header("one to many (DBPQueue shared, BPQueue broadcast)");
+        run_shared<wu::DBPQueue<Item>>("DBPQueue<BlockWait>", nelems);
+        run_shared<wu::DBPQueue<Item, wu::SpinWait<>>>("DBPQueue<SpinWait>", nelems);
+        run_shared<wu::DBPQueue<Item, wu::SpinFutexWait<>>>("DBPQueue<SpinFutexWait>", nelems);
+
+        wu::BPQueue<Item> q(__QCAP);
+        std::vector<wu::PQueue<Item> *> consumers;
+        for (size_t i = 0; i < __NCONSUMERS; ++i)
+        {
+            consumers.push_back(q.subscribe());
+        }
+        run("BPQueue", *(consumers[0]), consumers, 1, produce_steady, STORM_NONE, nelems);
+    }
+
+    void bench_flush_storm(size_t nelems)
+    {
+        print_header("flush storm 1:1");
+        run_all_single(produce_steady, STORM_FLUSH, nelems);
+    }
+
+    void bench_epoch_storm(size_t nelems)
+    {
+        print_header("epoch storm 1:1 (queues without epochs flush)");
+        run_all_single(produce_steady, STORM_EPOCH, nelems);
+    }
+
+}
\ No newline at end of file
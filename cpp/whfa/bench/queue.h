@@ -0,0 +1,47 @@
+/**
+ * @file bench/queue.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include <cstddef>
+
+namespace whfa::bench
+{
+
+    /**
+     * @brief benchmark one producer one consumer throughput and handoff latency of each queue
+     *
+     * @param nelems number of elements to pass through each queue
+     */
+    void bench_steady(size_t nelems);
+
+    /**
+     * @brief benchmark producer pushing bursts of elements (decoder emitting several frames per packet)
+     *
+     * @param nelems number of elements to pass through each queue
+     */
+    void bench_bursty(size_t nelems);
+
+    /**
+     * @brief benchmark one producer with multiple consumers (shared for DBPQueue, broadcast for BPQueue)
+     *
+     * @param nelems number of elements to push to each queue
+     */
+    void bench_one_to_many(size_t nelems);
+
+    /**
+     * @brief benchmark one producer one consumer while another thread repeatedly flushes (seeking)
+     *
+     * @param nelems number of elements to push to each queue
+     */
+    void bench_flush_storm(size_t nelems);
+
+    /**
+     * @brief benchmark one producer one consumer while another thread repeatedly advances epoch (lazy seeking)
+     *
+     * @param nelems number of elements to push to each queue
+     */
+    void bench_epoch_storm(size_t nelems);
+
+}
\ No newline at end of file
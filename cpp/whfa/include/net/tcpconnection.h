@@ -4,6 +4,8 @@
  */
 #pragma once
 
+#include "util/canceltoken.h"
+
 #include <cstdint>
 #include <mutex>
 
@@ -19,6 +21,7 @@ namespace whfa::net
      * connect/accept/close will cause blocking recv/send to fail
      * simple blocking/nonblocking and poll timeout functionality
      * expecting full sends and receives
+     * blocking recv/send also wake and fail with ECANCELED once an optional cancel token is cancelled
      */
     class TCPConnection
     {
@@ -99,9 +102,29 @@ namespace whfa::net
          */
         void close(bool shutdown = false);
 
+        /**
+         * @brief set token to poll alongside socket in blocking recv/send
+         *
+         * token must outlive connection (or be replaced first), not threadsafe with recv/send
+         *
+         * @param token token whose cancellation fails waiting recv/send with ECANCELED, nullptr = none
+         */
+        void set_cancel_token(const util::CancelToken *token);
+
     protected:
+        /**
+         * @brief wait until socket is ready or cancel token is cancelled
+         *
+         * @param events poll events to wait for on socket
+         * @param timeout millisecond timeout to poll for (< 0 to block)
+         * @return true if socket is ready, check errno if false (ECANCELED if cancelled, ETIMEDOUT on timeout)
+         */
+        bool wait(short events, int timeout);
+
         /// @brief socket file descriptor, < 0 if not connected
         int _fd;
+        /// @brief token cancelling blocking recv/send (nullptr if none)
+        const util::CancelToken *_cancel;
 
         /// @brief mutex for socket connect/close synchronization
         std::mutex _sck_mtx;
@@ -5,6 +5,7 @@
 #pragma once
 
 #include "net/tcpconnection.h"
+#include "util/bytesource.h"
 #include "util/threader.h"
 
 namespace whfa::net
@@ -14,14 +15,15 @@ namespace whfa::net
      * @class whfa::net::TCPRAMFile
      * @brief threadsafe class for receiving remote file over TCP
      *
-     * to be used as source of custom allocated AVIOContext for streaming
-     * util::Threader mutex used to synchronize starting and stopping of
-     * file using recv on open socket
+     * to be used as source of custom allocated AVIOContext for streaming (pcm::Context::open(ByteSource &))
+     * util::Threader mutex used to synchronize opening, closing, and
+     * receiving of file using recv on open socket
      * own read mutex used to synchronize opening, closing, and reading of
      * socket
      * closing of socket will cause blocking or next recv calls to fail
+     * stopping or pausing cancels a blocked recv, so closing never waits on a stalled sender
      */
-    class TCPRAMFile : public util::Threader
+    class TCPRAMFile : public util::Threader, public util::ByteSource
     {
     public:
         /// @brief default transfer block size in bytes
@@ -65,7 +67,7 @@ namespace whfa::net
          * @param size number of bytes to read at most
          * @return number of bytes read, 0 if end of file (or no data)
          */
-        uint64_t read(uint8_t *buf, uint64_t size);
+        uint64_t read(uint8_t *buf, uint64_t size) override;
 
         /**
          * @brief fseek and avio_seek equivalent, can block
@@ -76,7 +78,14 @@ namespace whfa::net
          * @param whence position from which offset is applied
          * @return true if successful, false if bad parameter values
          */
-        bool seek(int64_t offset, int whence);
+        bool seek(int64_t offset, int whence) override;
+
+        /**
+         * @brief get current read position
+         *
+         * @return byte offset of read position
+         */
+        uint64_t get_position() override;
 
         /**
          * @brief close open connection
@@ -95,7 +104,7 @@ namespace whfa::net
          *
          * @return file size in bytes
          */
-        uint64_t get_filesize();
+        uint64_t get_filesize() override;
 
     protected:
         /**
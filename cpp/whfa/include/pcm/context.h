@@ -4,9 +4,15 @@
  */
 #pragma once
 
-#include "util/dbpqueue.h"
+#include "util/bpqueue.h"
+#include "util/bytesource.h"
+#include "util/ppool.h"
+#include "util/pqueue.h"
 #include "util/threader.h"
 
+#include <atomic>
+#include <cstdint>
+
 extern "C"
 {
 #include <libavformat/avformat.h>
@@ -15,6 +21,8 @@ extern "C"
 namespace whfa::pcm
 {
 
+    class ProbeCache;
+
     /**
      * @class whfa::pcm::Context
      * @brief threadsafe class for synchronized shared context of one audio stream
@@ -25,10 +33,102 @@ namespace whfa::pcm
     class Context
     {
     public:
+        /**
+         * @enum whfa::pcm::Context::QueueType
+         * @brief enum defining the implementation backing a packet or frame queue
+         */
+        enum QueueType
+        {
+            /// @brief util::DBPQueue, dual-blocking mutex and condition variable queue
+            DUAL_BLOCKING,
+            /// @brief util::DBPQueue, waiting threads spin before blocking on condition variable
+            DUAL_SPIN,
+            /// @brief util::DBPQueue, waiting threads spin before parking on futex
+            DUAL_SPIN_FUTEX,
+            /// @brief util::SPSCPQueue, lock-free single-producer single-consumer ring
+            SPSC_RING,
+            /// @brief util::BPQueue, frames broadcast to every subscribed consumer, slowest blocks decoding
+            BROADCAST_BLOCKING,
+            /// @brief util::BPQueue, frames broadcast to every subscribed consumer, slowest may skip frames
+            BROADCAST_DROPPING
+        };
+
+        /**
+         * @enum whfa::pcm::Context::QueueBound
+         * @brief enum defining the unit a queue's total payload is bounded by
+         */
+        enum QueueBound
+        {
+            /// @brief number of elements only (capacity)
+            BOUND_COUNT,
+            /// @brief total payload bytes (packet data or decoded samples)
+            BOUND_BYTES,
+            /// @brief total decoded sample duration in microseconds (frames only, packets use bytes)
+            BOUND_DURATION
+        };
+
+        /**
+         * @struct whfa::pcm::Context::QueueSpec
+         * @brief struct for specifying the implementation and bounds of a queue
+         */
+        struct QueueSpec
+        {
+            /// @brief implementation backing the queue
+            QueueType type;
+            /// @brief max number of elements
+            size_t capacity;
+            /// @brief unit limiting total payload of queued elements
+            QueueBound bound;
+            /// @brief max total payload in units of bound, ignored for BOUND_COUNT
+            size_t limit;
+        };
+
         /// @brief default packet queue capacity
         static constexpr size_t DEF_PKT_QCAP = 1024;
         /// @brief default frame queue capacity
         static constexpr size_t DEF_FRM_QCAP = 1024;
+        /// @brief default packet queue implementation
+        static constexpr QueueType DEF_PKT_QTYPE = DUAL_BLOCKING;
+        /// @brief default frame queue implementation
+        static constexpr QueueType DEF_FRM_QTYPE = DUAL_BLOCKING;
+        /// @brief number of pooled packets or frames beyond queue capacity (held by workers in flight)
+        static constexpr size_t POOL_SLACK = 64;
+        /// @brief stream index of packets marking the boundary between the current and next input
+        static constexpr int BOUNDARY_STREAM = -1;
+        /// @brief size of I/O buffer for byte sources in bytes (libav default)
+        static constexpr int AVIO_BUFSZ = 32 * 1024;
+
+        /**
+         * @enum whfa::pcm::Context::Stage
+         * @brief enum defining the pipeline stage a worker publishes its position as
+         */
+        enum Stage
+        {
+            /// @brief demuxing packets (Reader)
+            STAGE_READ,
+            /// @brief decoding frames (Decoder)
+            STAGE_DECODE,
+            /// @brief consuming frames (Player or Writer)
+            STAGE_OUTPUT,
+            /// @brief number of stages
+            NUM_STAGES
+        };
+
+        /**
+         * @struct whfa::pcm::Context::Position
+         * @brief latest timestamps of each pipeline stage in stream time base units
+         *
+         * read >= decode >= output while running, their differences are the buffered durations
+         */
+        struct Position
+        {
+            /// @brief end timestamp of latest queued packet
+            int64_t read;
+            /// @brief timestamp of latest queued frame
+            int64_t decode;
+            /// @brief timestamp of latest played or written frame
+            int64_t output;
+        };
 
         /**
          * @class whfa::pcm::Context::Worker
@@ -36,15 +136,86 @@ namespace whfa::pcm
          */
         class Worker : public util::Threader
         {
+        public:
+            /// @brief batch budget of workers moving one packet or frame per iteration (cheap codecs like pcm)
+            static constexpr util::Threader::BatchBudget ITEM_BATCH_BUDGET = {.iterations = 32,
+                                                                              .duration = util::Executor::IDLE_WAIT};
+
         protected:
             /**
              * @brief hidden constructor for derived classes to use
              * @param context threadsafe audio context to access
+             * @param stage pipeline stage to publish position as
+             * @param executor shared pool to run loop body iterations on, nullptr = dedicated thread
              */
-            Worker(Context &context);
+            Worker(Context &context, Stage stage, util::Executor *executor = nullptr);
+
+            /**
+             * @brief set state timestamp and publish it as position of stage to context
+             *
+             * lock-free, loop body only
+             *
+             * @param timestamp timestamp in stream time base units
+             */
+            void set_position(int64_t timestamp);
+
+            /**
+             * @brief get max duration to block on a queue for, so state changes are noticed in bounded time
+             *
+             * @return Executor::IDLE_WAIT if pooled, Threader::CANCEL_WAIT otherwise
+             */
+            std::chrono::microseconds get_queue_wait() const;
+
+            /**
+             * @brief keep EOF popped while no output was open, so it can be handled once one opens
+             *
+             * consumers only read their frame queue, so EOF is kept here rather than pushed back
+             * nothing is kept if the context has no valid codec (input closed)
+             */
+            void set_pending_eof();
+
+            /**
+             * @brief take EOF kept by set_pending_eof()
+             *
+             * @return true if EOF is pending and no frames were invalidated since (seek or new input)
+             */
+            bool take_pending_eof();
+
+            /**
+             * @brief push elements, blocking while queue is full until pushed, flushed, or cancelled
+             *
+             * waits in CANCEL_WAIT slices, so stopping or pausing ends a blocked push in bounded time
+             *
+             * @param queue queue to push to
+             * @param in array of n pointers to copy to queue
+             * @param n number of elements to push
+             * @return number of elements pushed, less than n if flushed or cancelled
+             */
+            template <typename T>
+            size_t push_n_until_cancelled(util::PQueue<T> &queue, T *const *in, size_t n)
+            {
+                size_t cnt = 0;
+                while (cnt < n && !get_cancel_token().is_cancelled())
+                {
+                    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+                    cnt += queue.push_n(in + cnt, n - cnt, CANCEL_WAIT);
+                    if (cnt < n && std::chrono::steady_clock::now() - start < CANCEL_WAIT)
+                    {
+                        // returned before timing out, so flushed
+                        break;
+                    }
+                }
+                return cnt;
+            }
 
             /// @brief the libav audio context object
             Context *_ctxt;
+            /// @brief pipeline stage position is published as
+            const Stage _stage;
+            /// @brief true if EOF was popped while no output was open
+            bool _pending_eof;
+            /// @brief codec generation pending EOF was popped in
+            uint64_t _eof_gen;
         };
 
         /**
@@ -70,6 +241,31 @@ namespace whfa::pcm
             int rate;
         };
 
+        /**
+         * @struct whfa::pcm::Context::DecoderConfig
+         * @brief struct for holding codec options applied when opening an input
+         *
+         * threading helps CPU-heavy codecs (e.g. APE, high resolution WavPack) on slow cores,
+         * codecs without threading support decode on the calling thread regardless
+         */
+        struct DecoderConfig
+        {
+            /// @brief number of decoding threads, 0 = one per core, 1 = no threading
+            int threads;
+            /// @brief allowed threading methods (FF_THREAD_FRAME | FF_THREAD_SLICE), frame threading delays output by a frame per thread
+            int thread_type;
+            /// @brief true to force low delay decoding (disables frame threading)
+            bool low_delay;
+            /// @brief frames decoder may skip (AVDISCARD_DEFAULT = only frames marked discardable)
+            AVDiscard skip_frame;
+        };
+
+        /// @brief default decoder config (libav defaults, no threading)
+        static constexpr DecoderConfig DEF_DECODER_CONFIG = {.threads = 1,
+                                                             .thread_type = FF_THREAD_FRAME | FF_THREAD_SLICE,
+                                                             .low_delay = false,
+                                                             .skip_frame = AVDISCARD_DEFAULT};
+
         /**
          * @brief  register all available codec formats with libav
          */
@@ -83,13 +279,60 @@ namespace whfa::pcm
          */
         static void disable_networking();
 
+        /**
+         * @brief check if two stream specifications produce identical output (format, depth, channels, rate)
+         *
+         * @param a first stream specification
+         * @param b second stream specification
+         * @return true if an output configured for one can play the other without reconfiguring
+         */
+        static bool same_output(const StreamSpec &a, const StreamSpec &b);
+
+        /**
+         * @brief check if decoded frame matches stream specification (format, channels, rate)
+         *
+         * @param spec stream specification
+         * @param frame decoded frame
+         * @return true if frame can be handled as spec
+         */
+        static bool matches_frame(const StreamSpec &spec, const AVFrame &frame);
+
+        /**
+         * @brief check if packet marks the boundary between the current and next input
+         *
+         * @param packet packet to check
+         * @return true if boundary marker
+         */
+        static bool is_boundary(const AVPacket &packet);
+
         /**
          * @brief constructor
+         *
+         * single producer single consumer rings are only valid while each queue has
+         * exactly one pushing worker and one popping worker (e.g. one Player or Writer)
+         * broadcast types apply to the frame queue only (packet queue falls back to DUAL_BLOCKING)
+         *
+         * @param pkt_qcap capacity of underlying packet queue
+         * @param frm_qcap capacity of underlying frame queue
+         * @param pkt_qtype implementation of underlying packet queue
+         * @param frm_qtype implementation of underlying frame queue
+         */
+        Context(size_t pkt_qcap = DEF_PKT_QCAP,
+                size_t frm_qcap = DEF_FRM_QCAP,
+                QueueType pkt_qtype = DEF_PKT_QTYPE,
+                QueueType frm_qtype = DEF_FRM_QTYPE);
 
-         * @param pkt_qcap capacity of underlying packet DBPQueue
-         * @param frm_qcap capacity of underlying frame DBPQueue
+        /**
+         * @brief constructor with payload bounded queues
+         *
+         * bounding by bytes or duration keeps memory use predictable for high resolution streams
+         * element capacity of each spec still applies
+         * broadcast frame queues are bounded by capacity only
+         *
+         * @param pkt_qspec specification of underlying packet queue
+         * @param frm_qspec specification of underlying frame queue
          */
-        Context(size_t pkt_qcap = DEF_PKT_QCAP, size_t frm_qcap = DEF_FRM_QCAP);
+        Context(const QueueSpec &pkt_qspec, const QueueSpec &frm_qspec);
 
         /**
          * @brief destructor, closes context
@@ -102,15 +345,141 @@ namespace whfa::pcm
          * format and codec members are attempted to be freed upon error
          *
          * @param url libav stream string to source
+         * @param config codec options
+         * @return error int, 0 on success
+         */
+        int open(const char *url, const DecoderConfig &config = DEF_DECODER_CONFIG);
+
+        /**
+         * @brief open byte source (e.g. net::TCPRAMFile, util::MappedFile) and sets format and codec context if valid audio source
+         *
+         * reads through a custom AVIOContext with a buffer reused across opens, so a file still
+         * arriving over the network can be decoded as it arrives (reads block until data is available)
+         * format and codec members are attempted to be freed upon error
+         *
+         * @param source byte source outliving its use by context (until closed or another input is opened)
+         * @param name name of source for format detection hints and logging, nullptr = none
+         * @param config codec options
          * @return error int, 0 on success
          */
-        int open(const char *url);
+        int open(util::ByteSource &source, const char *name = nullptr,
+                 const DecoderConfig &config = DEF_DECODER_CONFIG);
 
         /**
          * @brief close and free format and codec contexts
+         *
+         * also frees any prepared next input
          */
         void close();
 
+        /**
+         * @brief open and probe next input while the current one plays, for gapless transitions
+         *
+         * never locks the current format or codec, so workers continue while probing (may block on I/O)
+         * once the current input ends, the Reader continues with the next input (advance_format())
+         * replaces any previously prepared next input, open() and close() discard it
+         *
+         * @param url libav stream string to source
+         * @param config codec options
+         * @return error int, 0 on success
+         */
+        int prepare_next(const char *url, const DecoderConfig &config = DEF_DECODER_CONFIG);
+
+        /**
+         * @brief free prepared next input, if any
+         */
+        void cancel_next();
+
+        /**
+         * @brief check if a next input is prepared
+         *
+         * @return true if prepared and not yet advanced to
+         */
+        bool has_next();
+
+        /**
+         * @brief replace ended format context with prepared next input
+         *
+         * the next codec context is held pending until the decoder drains the current one
+         * (advance_codec()), the reader should mark the boundary with a BOUNDARY_STREAM packet
+         *
+         * @return true if advanced, false if no next input is prepared
+         */
+        bool advance_format();
+
+        /**
+         * @brief check if a codec context is pending from advance_format()
+         *
+         * codec lock from get_codec() must be held
+         *
+         * @return true if pending
+         */
+        bool has_pending_codec() const;
+
+        /**
+         * @brief replace codec context with pending codec context from advance_format()
+         *
+         * codec lock from get_codec() must be held, previously returned codec context is freed
+         *
+         * @return true if replaced, false if none pending
+         */
+        bool advance_codec();
+
+        /**
+         * @brief invalidate queued packets after repositioning format context (e.g. seeking)
+         *
+         * format lock from get_format() must be held, advances packet queue epoch and format generation
+         */
+        void invalidate_packets();
+
+        /**
+         * @brief invalidate decoded frames after repositioning format context (e.g. seeking)
+         *
+         * codec lock from get_codec() must be held, switches to pending codec context if any
+         * (packets of its ended input are discarded, so it needs no draining), otherwise flushes codec
+         * advances frame queue epoch and codec generation
+         */
+        void invalidate_frames();
+
+        /**
+         * @brief get generation of format context, changing whenever it is repositioned or replaced
+         *
+         * format lock from get_format() must be held
+         * workers holding packets outside the packet queue discard them once the generation changes
+         *
+         * @return format generation
+         */
+        uint64_t get_format_generation() const;
+
+        /**
+         * @brief get generation of codec context, changing whenever it is flushed or replaced
+         *
+         * codec lock from get_codec() must be held
+         * workers holding frames outside the frame queue discard them once the generation changes
+         *
+         * @return codec generation
+         */
+        uint64_t get_codec_generation() const;
+
+        /**
+         * @brief set cache of probed stream parameters used by open() and prepare_next()
+         *
+         * known inputs skip format detection and analyze only briefly, new inputs are added to cache
+         *
+         * @param cache probe cache outliving its use by context, nullptr = always probe fully
+         */
+        void set_probe_cache(ProbeCache *cache);
+
+        /**
+         * @brief set callback interrupting blocking libav I/O (e.g. av_read_frame on a stalled url)
+         *
+         * applied to the open input and every input opened afterwards, once opened
+         * interrupted reads fail with AVERROR_EXIT
+         *
+         * @param callback callback returning nonzero to interrupt, {nullptr, nullptr} = none
+         */
+        void set_interrupt_callback(const AVIOInterruptCB &callback);
+
         /**
          * @brief get stream specification for currently opened format & codec
          *
@@ -119,6 +488,16 @@ namespace whfa::pcm
          */
         bool get_stream_spec(StreamSpec &spec);
 
+        /**
+         * @brief get effective codec options of currently opened codec
+         *
+         * threads is the thread count libav settled on, thread_type the active method (0 if not threaded)
+         *
+         * @param[out] config effective codec options
+         * @return false if codec is invalid (invalid stream)
+         */
+        bool get_decoder_config(DecoderConfig &config);
+
         /**
          * @brief get exclusive access to format context and stream index
          *
@@ -146,39 +525,196 @@ namespace whfa::pcm
          * @brief get reference to threadsafe packet queue
          *
          * popped packets are the responsibility of the caller
-         * packets must be freed using av_packet_free() after popping or when flushing
+         * packets should be released using release_packet() after popping
+         * (av_packet_free() is also valid, flushed and stale packets are recycled into the pool)
          *
          * @return packet queue
          */
-        util::DBPQueue<AVPacket> &get_packet_queue();
+        util::PQueue<AVPacket> &get_packet_queue();
 
         /**
          * @brief get reference to threadsafe frame queue
 
          * popped frames are the responsibility of the caller
-         * frames must be freed using av_frame_free() after popping or when flushing
+         * frames should be released using release_frame() after popping
+         * (av_frame_free() is also valid, flushed and stale frames are recycled into the pool)
          *
          * @return frame queue
          */
-        util::DBPQueue<AVFrame> &get_frame_queue();
+        util::PQueue<AVFrame> &get_frame_queue();
+
+        /**
+         * @brief get recycled or newly allocated packet for pushing to packet queue
+         *
+         * lock-free, allocates only until the packet pool has warmed up
+         *
+         * @return blank packet, nullptr if allocation failed
+         */
+        AVPacket *acquire_packet();
+
+        /**
+         * @brief unreference packet data and recycle packet into packet pool
+         *
+         * lock-free, frees packet if pool is full
+         *
+         * @param[out] packet packet to release and set to nullptr (ignored if nullptr)
+         */
+        void release_packet(AVPacket *&packet);
+
+        /**
+         * @brief get recycled or newly allocated frame for pushing to frame queue
+         *
+         * lock-free, allocates only until the frame pool has warmed up
+         *
+         * @return blank frame, nullptr if allocation failed
+         */
+        AVFrame *acquire_frame();
+
+        /**
+         * @brief unreference frame data and recycle frame into frame pool
+         *
+         * lock-free, frees frame if pool is full
+         *
+         * @param[out] frame frame to release and set to nullptr (ignored if nullptr)
+         */
+        void release_frame(AVFrame *&frame);
+
+        /**
+         * @brief get number of packets and frames allocated because their pool was empty
+         *
+         * stops increasing once playback reaches steady state
+         *
+         * @param[out] pkt_allocs number of packet allocations
+         * @param[out] frm_allocs number of frame allocations
+         */
+        void get_pool_allocs(uint64_t &pkt_allocs, uint64_t &frm_allocs);
+
+        /**
+         * @brief subscribe an additional consumer (e.g. a second Player or Writer) to broadcast frame queue
+         *
+         * the returned queue pops every frame pushed after subscribing, in order
+         * popped frames are independent references (av_frame_clone) and must still be released by the caller
+         * pushing and flushing through any consumer acts on the whole frame queue
+         * the returned queue is owned by the context, valid until unsubscribed or context destruction
+         *
+         * @return consumer frame queue, nullptr if frame queue is not broadcast
+         */
+        util::PQueue<AVFrame> *subscribe_frame_queue();
+
+        /**
+         * @brief unsubscribe consumer from broadcast frame queue, releasing its unread frames
+         *
+         * no worker may be using the queue, the default frame queue cannot be unsubscribed
+         *
+         * @param queue consumer frame queue returned by subscribe_frame_queue()
+         * @return false if queue is not a subscribed consumer
+         */
+        bool unsubscribe_frame_queue(util::PQueue<AVFrame> *queue);
+
+        /**
+         * @brief get latest position of every pipeline stage
+         *
+         * lock-free, never blocks workers, suitable for high-frequency polling
+         * retries until all stages are read without any changing in between (a consistent snapshot)
+         *
+         * @param[out] pos latest stage positions
+         * @return true if consistent, false if stages kept changing (each position is still valid)
+         */
+        bool get_position(Position &pos) const;
+
+        /**
+         * @brief get snapshot of packet and frame queue counters
+         *
+         * does not lock context or block queue pushing and popping
+         * compare wait times to find the bottleneck worker:
+         * packet push waits = reader ahead, frame pop waits = player/writer starved
+         * broadcast frame queue counters are those of the default frame queue consumer
+         *
+         * @param[out] pkt_stats packet queue counters
+         * @param[out] frm_stats frame queue counters
+         */
+        void get_queue_stats(util::QueueStats &pkt_stats, util::QueueStats &frm_stats);
 
     protected:
+        /**
+         * @brief reset position of every stage to 0
+         */
+        void reset_positions();
+
+        /**
+         * @brief free format, codec, pending codec, and byte source I/O contexts
+         *
+         * format and codec locks must be held
+         */
+        void free_input();
+
+        /**
+         * @brief free byte source I/O context, keeping its buffer for reuse
+         *
+         * format lock must be held
+         */
+        void free_avio();
+
         /// @brief libav format context (nullptr if invalid)
         AVFormatContext *_fmt_ctxt;
         /// @brief libav codec context (nullptr if invalid)
         AVCodecContext *_cdc_ctxt;
         /// @brief stream index to audio stream in format context (-1 if invalid)
         int _stm_idx;
+        /// @brief number of times format context was repositioned or replaced
+        uint64_t _fmt_gen;
+        /// @brief number of times codec context was flushed or replaced
+        uint64_t _cdc_gen;
+        /// @brief codec context of current format waiting for decoder to drain codec (nullptr if none)
+        AVCodecContext *_pending_cdc;
+        /// @brief prepared next format context (nullptr if none)
+        AVFormatContext *_next_fmt;
+        /// @brief prepared next codec context (nullptr if none)
+        AVCodecContext *_next_cdc;
+        /// @brief stream index of prepared next input (-1 if none)
+        int _next_stm;
+        /// @brief cache of probed stream parameters (nullptr if none)
+        std::atomic<ProbeCache *> _probe_cache;
+        /// @brief I/O context reading from byte source of format context (nullptr if url)
+        AVIOContext *_avio;
+        /// @brief I/O buffer kept for reuse while no byte source is open (nullptr if in use or not allocated)
+        uint8_t *_avio_buf;
+        /// @brief size of kept I/O buffer in bytes
+        int _avio_bufsz;
+
+        /**
+         * @struct whfa::pcm::Context::PositionSlot
+         * @brief single-writer position of one stage, on its own cache line
+         */
+        struct alignas(util::QueueCounters::CACHELINE_SZ) PositionSlot
+        {
+            /// @brief latest timestamp of stage
+            std::atomic<int64_t> timestamp;
+        };
+
+        /// @brief callback interrupting blocking I/O of format context
+        AVIOInterruptCB _interrupt_cb;
+        /// @brief latest position of each stage, written lock-free by workers
+        PositionSlot _positions[NUM_STAGES];
 
-        /// @brief mutex synchronizing access to format context and stream index
+        /// @brief mutex synchronizing access to format context, stream index, and interrupt callback
         std::mutex _fmt_mtx;
-        /// @brief mutex synchronizing access to codec context
+        /// @brief mutex synchronizing access to codec context and pending codec context
         std::mutex _cdc_mtx;
+        /// @brief mutex synchronizing access to prepared next input, locked before other context mutexes
+        std::mutex _next_mtx;
+
+        /// @brief lock-free pool of recycled libav packets
+        util::PPool<AVPacket> _pkt_pool;
+        /// @brief lock-free pool of recycled libav frames
+        util::PPool<AVFrame> _frm_pool;
 
         /// @brief threadsafe queue of pointers to libav packets on the heap
-        util::DBPQueue<AVPacket> _pkt_q;
-        /// @brief threadsafe queue of pointers to libav frames on the heap
-        util::DBPQueue<AVFrame> _frm_q;
+        util::PQueue<AVPacket> *_pkt_q;
+        /// @brief broadcast frame queue owning all frame queue consumers (nullptr if not broadcast)
+        util::BPQueue<AVFrame> *_frm_bq;
+        /// @brief threadsafe queue of pointers to libav frames on the heap (default consumer if broadcast)
+        util::PQueue<AVFrame> *_frm_q;
     };
 
 }
\ No newline at end of file
@@ -14,25 +14,74 @@ namespace whfa::pcm
      * @brief class for parallel decoding of packets from queue into a frame queue
      *
      * context worker class to abstract decoding packets using libav
+     * can run on a shared executor, only decoding while packets and frame queue space are available
+     * switches to the next input's codec at boundary packets, after draining the ended input's frames
+     * when pooled, never blocks on a full frame queue, so reader, decoder, and writer can share one thread
      */
     class Decoder : public Context::Worker
     {
     public:
+        /// @brief max number of decoded frames pushed to frame queue at once
+        static constexpr size_t MAX_FRAME_BATCH = 64;
+
         /**
          * @brief constructor
          *
          * @param context threadsafe audio context to access
+         * @param executor shared pool to run on, nullptr = dedicated thread
          */
-        Decoder(Context &context);
+        Decoder(Context &context, util::Executor *executor = nullptr);
+
+        /**
+         * @brief destructor, stops decoding and releases held frames
+         */
+        virtual ~Decoder();
 
     protected:
         /**
          * @brief decode queued packets and enqueue decoded frames
          *
          * attempts to decode one packet per iteration, can enqueue multiple frames
+         * at a boundary packet, drains delayed frames of the ended input then switches to the pending codec
+         * when pooled, holds frames the frame queue has no room for (by count or weight), resuming next iteration
          * upon failure, pauses and sets error state without altering context
          */
         void execute_loop_body() override;
+
+        /**
+         * @brief check for queued packets and frame queue space when pooled, by count and weight
+         *
+         * @return true if a packet can be decoded (or held frames pushed) without blocking
+         */
+        bool is_ready() override;
+
+        /**
+         * @brief push held frames, keeping those not pushed
+         *
+         * codec lock must be held
+         * when pooled, pushes only what fits without waiting, otherwise blocks until pushed, flushed, or cancelled
+         *
+         * @param frm_queue frame queue to push to
+         * @param[out] pts timestamp of last pushed frame, unchanged if none pushed
+         * @return true if all held frames were pushed
+         */
+        bool push_held(util::PQueue<AVFrame> &frm_queue, int64_t &pts);
+
+        /**
+         * @brief release held frames back to context
+         */
+        void release_held();
+
+        /// @brief true if frames are held or codec may hold frames left undelivered by a full frame queue
+        bool _resume;
+        /// @brief true while delayed frames of ended input are received, switching codecs once drained
+        bool _draining;
+        /// @brief decoded frames not yet pushed, in decoding order (guarded by codec lock)
+        AVFrame *_held[MAX_FRAME_BATCH];
+        /// @brief number of held frames
+        size_t _nheld;
+        /// @brief codec generation held frames were decoded in
+        uint64_t _gen;
     };
 
 }
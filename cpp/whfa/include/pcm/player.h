@@ -18,7 +18,9 @@ namespace whfa::pcm
      *
      * context worker class to abstract forwarding libav frames to files and devices
      * will write to only one sink at a time (potentially changed later)
-     * a context should only have one writer/player, as it consumes frames destructively from the queue
+     * a context should only have one writer/player per frame queue, as it consumes frames destructively
+     * additional writers/players require a broadcast frame queue (Context::subscribe_frame_queue())
+     * always runs on a dedicated thread (configurable for real-time scheduling), never a shared executor
      *
      * @todo: common base class for Player and Writer, multipurpose parallel processing of each poppped frame
      */
@@ -34,8 +36,9 @@ namespace whfa::pcm
          * @brief constructor
          *
          * @param context threadsafe audio context to access
+         * @param frames frame queue to pop from, nullptr = context frame queue
          */
-        Player(Context &context);
+        Player(Context &context, util::PQueue<AVFrame> *frames = nullptr);
 
         /**
          * @brief destructor to ensure device closure
@@ -59,6 +62,7 @@ namespace whfa::pcm
          * @brief configure open device using current Context
          *
          * drains current playback and sets hardware and software parameters for device
+         * skipped (no drain, gapless) if already configured with identical output and parameters
          *
          * @param resample enable/disable libasound resampling
          * @param latency_us latency for libasound playback in microseconds
@@ -76,15 +80,33 @@ namespace whfa::pcm
          * @brief write queued frames to opened device
          *
          * upon failure, pauses and sets error state without altering context or closing
+         * reconfigures when a frame no longer matches the configured stream (e.g. next input)
          */
         void execute_loop_body() override;
 
+        /**
+         * @brief not threadsafe implementation of configure(), _mtx must be held
+         *
+         * @param resample enable/disable libasound resampling
+         * @param latency_us latency for libasound playback in microseconds
+         * @return false if failure or no device opened
+         */
+        bool configure_dev_locked(bool resample, unsigned int latency_us);
+
         /// @brief libasound PCM device handle
         snd_pcm_t *_dev;
+        /// @brief frame queue to pop from
+        util::PQueue<AVFrame> *_frm_q;
         /// @brief context stream specification
         Context::StreamSpec _spec;
         /// @brief class to write to device with
         FrameHandler *_writer;
+        /// @brief true if device parameters are set for _spec
+        bool _configured;
+        /// @brief libasound resampling configured
+        bool _resample;
+        /// @brief libasound latency configured in microseconds
+        unsigned int _latency_us;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,112 @@
+/**
+ * @file pcm/probecache.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace whfa::pcm
+{
+
+    /**
+     * @class whfa::pcm::ProbeCache
+     * @brief threadsafe persistent cache of probed stream parameters, shortening reopening of known inputs
+     *
+     * local files are keyed by path, size, and modification time, so changed files are probed again
+     * remote urls are keyed by url only, cached values only fill in what the opened stream's header lacks
+     * entries are appended to a plain text file, one line per entry, later lines replacing earlier ones
+     */
+    class ProbeCache
+    {
+    public:
+        /**
+         * @struct whfa::pcm::ProbeCache::Entry
+         * @brief probed input format, audio stream, and codec parameters
+         */
+        struct Entry
+        {
+            /// @brief short name of input format (demuxer)
+            std::string format_name;
+            /// @brief index of audio stream
+            int stream_idx;
+            /// @brief codec id (AVCodecID)
+            int codec_id;
+            /// @brief sample format (AVSampleFormat)
+            int sample_format;
+            /// @brief bits per raw sample, 0 if unspecified
+            int bitdepth;
+            /// @brief number of channels
+            int channels;
+            /// @brief channel layout mask, 0 if unspecified
+            uint64_t channel_layout;
+            /// @brief sample frequency
+            int rate;
+            /// @brief bytes per coded block, 0 if unspecified
+            int block_align;
+            /// @brief samples per coded frame, 0 if unspecified
+            int frame_size;
+            /// @brief numerator of stream time base
+            int timebase_num;
+            /// @brief denominator of stream time base
+            int timebase_den;
+            /// @brief total duration in time base units, AV_NOPTS_VALUE if unknown
+            int64_t duration;
+        };
+
+        /**
+         * @brief constructor, loads existing entries
+         *
+         * a missing or unreadable file is an empty cache, malformed lines are skipped
+         *
+         * @param path path of cache file to load and append to
+         */
+        ProbeCache(const char *path);
+
+        /**
+         * @brief get cached entry of input
+         *
+         * @param url libav stream string of input
+         * @param[out] entry cached parameters
+         * @return true if cached and unchanged (local files)
+         */
+        bool lookup(const char *url, Entry &entry);
+
+        /**
+         * @brief cache entry of input, appending it to cache file
+         *
+         * @param url libav stream string of input
+         * @param entry probed parameters
+         * @return false if input cannot be keyed or cache file cannot be written (still cached in memory)
+         */
+        bool store(const char *url, const Entry &entry);
+
+        /**
+         * @brief get number of cached entries
+         *
+         * @return number of cached entries
+         */
+        size_t get_size();
+
+        /**
+         * @brief make cache key of input
+         *
+         * @param url libav stream string of input
+         * @param[out] key cache key
+         * @return false if input cannot be keyed (missing local file or url unsafe to store)
+         */
+        static bool make_key(const char *url, std::string &key);
+
+    protected:
+        /// @brief path of cache file
+        const std::string _path;
+        /// @brief cached entries by key
+        std::unordered_map<std::string, Entry> _entries;
+        /// @brief mutex synchronizing access to entries and cache file
+        std::mutex _mtx;
+    };
+
+}
\ No newline at end of file
@@ -14,6 +14,9 @@ namespace whfa::pcm
      * @brief class for parallel reading of packets from an audio stream into a queue
      *
      * context worker class to abstract reading packets using libav and seeking to new positions
+     * can run on a shared executor, only reading while packet queue space is available
+     * stopping, pausing, seeking, and destruction interrupt a blocked read (e.g. a stalled network url)
+     * continues with the context's prepared next input at end of stream, marking the boundary for the decoder
      */
     class Reader : public Context::Worker
     {
@@ -22,12 +25,20 @@ namespace whfa::pcm
          * @brief constructor
          *
          * @param context threadsafe audio context to access
+         * @param executor shared pool to run on, nullptr = dedicated thread
          */
-        Reader(Context &context);
+        Reader(Context &context, util::Executor *executor = nullptr);
+
+        /**
+         * @brief destructor, stops reading and removes interrupt callback from context
+         */
+        virtual ~Reader();
 
         /**
          * @brief seek to position by timestamp
          *
+         * queued packets and frames are invalidated (advance_epoch) and discarded lazily by consumers
+         *
          * @param pos_pts presentation timestamp in frames using AV_TIME_BASE fps
          * @return true if successful, sets error state upon failure
          */
@@ -36,6 +47,8 @@ namespace whfa::pcm
         /**
          * @brief seek to position by percentage
          *
+         * queued packets and frames are invalidated (advance_epoch) and discarded lazily by consumers
+         *
          * @param pos_pct percentage of stream duration to seek to (clipped to [0,1])
          * @return true if successful, sets error state upon failure
          */
@@ -48,6 +61,58 @@ namespace whfa::pcm
          * upon failure, pauses and sets error state without altering context
          */
         void execute_loop_body() override;
+
+        /**
+         * @brief check for packet queue space when pooled, by count and weight
+         *
+         * @return true if a packet (or the held packet) can be queued without blocking
+         */
+        bool is_ready() override;
+
+        /**
+         * @brief push packet read from format context, publishing its position once pushed
+         *
+         * format lock must be held
+         * when pooled and the packet exceeds the remaining weight limit, holds it instead of blocking
+         *
+         * @param pkt_queue packet queue to push to
+         * @param[in,out] packet packet to push, set to nullptr if pushed or held (unchanged if flushed or cancelled)
+         */
+        void push_packet(util::PQueue<AVPacket> &pkt_queue, AVPacket *&packet);
+
+        /**
+         * @brief discard codec state and queued frames of position before seek
+         *
+         * switches to pending codec of advanced input if any, otherwise flushes current codec
+         *
+         * @return false if codec is invalid
+         */
+        bool reset_codec();
+
+        /**
+         * @brief push packet marking boundary between ended and next input
+         *
+         * @param pkt_queue packet queue to push to
+         * @return true if pushed, false if out of memory, cancelled, or flushed (retried next iteration)
+         */
+        bool push_boundary(util::PQueue<AVPacket> &pkt_queue);
+
+        /**
+         * @brief libav interrupt callback of context, interrupting while cancelled or seeking
+         *
+         * @param opaque reader to check
+         * @return 1 to interrupt blocking I/O, 0 to continue
+         */
+        static int interrupt(void *opaque);
+
+        /// @brief number of seeks waiting on the format context, interrupting reads while nonzero
+        std::atomic<int> _interrupts;
+        /// @brief true while boundary packet of advanced input still needs pushing (loop body only)
+        bool _boundary;
+        /// @brief packet read but not yet queued for lack of room (pooled and loop body only, nullptr if none)
+        AVPacket *_held;
+        /// @brief format generation held packet was read in
+        uint64_t _held_gen;
     };
 
 }
\ No newline at end of file
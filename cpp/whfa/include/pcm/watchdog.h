@@ -0,0 +1,194 @@
+/**
+ * @file pcm/watchdog.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include "pcm/context.h"
+
+#include <chrono>
+
+namespace whfa::pcm
+{
+
+    /**
+     * @class whfa::pcm::Watchdog
+     * @brief class for parallel detection of stalled workers and predicted output starvation
+     *
+     * samples context stage positions and watched workers' progress times every interval
+     * buffered duration is the read position ahead of the output position (packets and frames queued),
+     * its trend predicts the time until output runs out (e.g. a stalled network read)
+     * events are edge-triggered and handled on the watchdog thread, never blocking workers
+     * intended for real-time output, only samples while the output worker is running
+     */
+    class Watchdog : public util::Threader
+    {
+    public:
+        /**
+         * @enum whfa::pcm::Watchdog::EventType
+         * @brief enum defining the kind of watchdog event
+         */
+        enum EventType
+        {
+            /// @brief predicted time to empty fell below starvation threshold
+            EVENT_STARVING,
+            /// @brief predicted time to empty recovered to twice starvation threshold
+            EVENT_BUFFERED,
+            /// @brief running worker made no progress within stall timeout
+            EVENT_STALLED,
+            /// @brief stalled worker made progress again
+            EVENT_RESUMED
+        };
+
+        /**
+         * @struct whfa::pcm::Watchdog::Event
+         * @brief watchdog event and the buffering measured with it
+         */
+        struct Event
+        {
+            /// @brief kind of event
+            EventType type;
+            /// @brief stage of stalled or resumed worker (STAGE_OUTPUT for starvation events)
+            Context::Stage stage;
+            /// @brief duration read ahead of output
+            std::chrono::milliseconds buffered;
+            /// @brief predicted duration until output starves, max if buffer is not draining
+            std::chrono::milliseconds time_to_empty;
+        };
+
+        /**
+         * @class whfa::pcm::Watchdog::EventHandler
+         * @brief interface for handling watchdog events
+         */
+        class EventHandler
+        {
+        public:
+            /**
+             * @brief destructor
+             */
+            virtual ~EventHandler();
+
+            /**
+             * @brief handle event, called on watchdog thread
+             *
+             * must not call watchdog methods (e.g. watch()), trigger larger read-ahead or buffering elsewhere
+             *
+             * @param event event to handle
+             */
+            virtual void handle(const Event &event) = 0;
+        };
+
+        /**
+         * @struct whfa::pcm::Watchdog::Config
+         * @brief sampling period and thresholds of watchdog
+         */
+        struct Config
+        {
+            /// @brief duration between samples
+            std::chrono::milliseconds interval;
+            /// @brief predict starvation when time to empty falls below
+            std::chrono::milliseconds starvation;
+            /// @brief running worker is stalled when it makes no progress for
+            std::chrono::milliseconds stall;
+        };
+
+        /// @brief default config
+        static constexpr Config DEF_CONFIG = {.interval = std::chrono::milliseconds(20),
+                                              .starvation = std::chrono::milliseconds(500),
+                                              .stall = std::chrono::milliseconds(1000)};
+
+        /**
+         * @brief constructor
+         *
+         * @param context threadsafe audio context to sample positions of
+         * @param config sampling period and thresholds
+         */
+        Watchdog(Context &context, const Config &config = DEF_CONFIG);
+
+        /**
+         * @brief destructor
+         */
+        virtual ~Watchdog();
+
+        /**
+         * @brief watch worker of stage for stalls, output worker also gates sampling
+         *
+         * @param stage stage worker publishes position as
+         * @param worker worker to watch, nullptr to stop watching stage
+         */
+        void watch(Context::Stage stage, const util::Threader *worker);
+
+        /**
+         * @brief set event handler
+         *
+         * @param handler handler invoked on watchdog thread, nullptr for none
+         */
+        void set_event_handler(EventHandler *handler);
+
+        /**
+         * @brief configure using current Context, resetting trend
+         *
+         * should be called after the context is opened and before starting
+         *
+         * @return true on success, false if context is not open (sets error state)
+         */
+        bool configure();
+
+    protected:
+        /**
+         * @brief wait for interval (or cancellation), then sample positions and progress and emit events
+         */
+        void execute_loop_body() override;
+
+        /**
+         * @brief sample buffered duration and update its trend, emitting starvation events
+         *
+         * @param now time of sample
+         * @param pos positions of stages
+         * @param reading true if read worker is running (not at end of stream)
+         */
+        void sample_buffer(std::chrono::steady_clock::time_point now, const Context::Position &pos, bool reading);
+
+        /**
+         * @brief check watched running workers for stalls, emitting stall events
+         *
+         * @param now time of sample
+         */
+        void sample_progress(std::chrono::steady_clock::time_point now);
+
+        /**
+         * @brief invoke handler with event if set, _mtx must be held
+         *
+         * @param type kind of event
+         * @param stage stage of event
+         */
+        void emit(EventType type, Context::Stage stage);
+
+        /// @brief the libav audio context object
+        Context *_ctxt;
+        /// @brief sampling period and thresholds
+        const Config _config;
+        /// @brief watched worker of each stage (nullptr if not watched)
+        const util::Threader *_workers[Context::NUM_STAGES];
+        /// @brief event handler (nullptr if none)
+        EventHandler *_evt_handler;
+        /// @brief stream time base in seconds per unit (0 if not configured)
+        double _timebase;
+
+        /// @brief true if a previous sample exists to measure trend from
+        bool _sampled;
+        /// @brief time of previous sample
+        std::chrono::steady_clock::time_point _prev_time;
+        /// @brief buffered seconds at previous sample
+        double _prev_buffered;
+        /// @brief latest buffered seconds
+        double _buffered;
+        /// @brief smoothed change of buffered seconds per second
+        double _trend;
+        /// @brief true while starvation is predicted
+        bool _starving;
+        /// @brief true while worker of stage is stalled
+        bool _stalled[Context::NUM_STAGES];
+    };
+
+}
\ No newline at end of file
@@ -18,7 +18,9 @@ namespace whfa::pcm
      *
      * context worker class to abstract forwarding libav frames to files
      * will write to only one sink at a time (potentially changed later)
-     * a context should only have one writer/player, as it consumes frames destructively from the queue
+     * a context should only have one writer/player per frame queue, as it consumes frames destructively
+     * additional writers/players require a broadcast frame queue (Context::subscribe_frame_queue())
+     * can run on a shared executor, only writing while frames are queued
      *
      * @todo: common base class for Player and Writer, multipurpose parallel processing of each poppped frame
      */
@@ -41,8 +43,10 @@ namespace whfa::pcm
          * @brief constructor
          *
          * @param context threadsafe audio context to access
+         * @param frames frame queue to pop from, nullptr = context frame queue
+         * @param executor shared pool to run on, nullptr = dedicated thread
          */
-        Writer(Context &context);
+        Writer(Context &context, util::PQueue<AVFrame> *frames = nullptr, util::Executor *executor = nullptr);
 
         /**
          * @brief destructor to ensure file closure
@@ -73,10 +77,19 @@ namespace whfa::pcm
          */
         void execute_loop_body() override;
 
+        /**
+         * @brief check for queued frames when pooled
+         *
+         * @return true if a frame or pending EOF can be handled without blocking
+         */
+        bool is_ready() override;
+
         /// @brief mode of output / writing
         OutputType _mode;
         /// @brief output file stream, closed if invalid
         std::ofstream _ofs;
+        /// @brief frame queue to pop from
+        util::PQueue<AVFrame> *_frm_q;
         /// @brief context stream specification
         Context::StreamSpec _spec;
         /// @brief class to write to file with
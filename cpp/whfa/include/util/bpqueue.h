@@ -0,0 +1,739 @@
+/**
+ * @file util/bpqueue.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include "util/pqueue.h"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace whfa::util
+{
+
+    /**
+     * @class whfa::util::BPQueue<T>
+     * @brief threadsafe broadcast pointer queue of fixed capacity with multiple consumers
+     *
+     * only stores pointers T*
+     * every element pushed is popped once by each consumer subscribed at the time of pushing
+     * each consumer is a PQueue<T> with its own cursor, popping blocks while its cursor is caught up
+     * pushing blocks while the slowest consumer is a full capacity behind (backpressure),
+     * or with SLOW_DROP, consumers stalling a caught up consumer skip ahead to the newest element
+     *
+     * each element is reference counted by its remaining consumers:
+     * the last consumer to pop an element receives the original pointer (and ownership of it),
+     * earlier consumers receive copies made by the clone callback (e.g. refcounted av_frame_clone)
+     * if cloning fails (out of memory) the element stays unread, and popping retries until cloning succeeds
+     * or the consumer is its last reader, so a failed clone is never mistaken for a nullptr element
+     * without a clone callback all consumers receive the same pointer and lifetime is managed by the caller
+     */
+    template <typename T>
+    class BPQueue
+    {
+    public:
+        /// @brief callback type to be invoked when flushing (mostly for destruction or recycling)
+        using FlushCallback = typename PQueue<T>::FlushCallback;
+        /// @brief callback type to copy elements for all but the last consumer (stateless, must accept nullptr)
+        using CloneCallback = T *(*)(const T *);
+
+        /// @brief interval at which popping retries a failed clone
+        static constexpr std::chrono::milliseconds CLONE_RETRY{1};
+
+        /**
+         * @enum whfa::util::BPQueue<T>::SlowPolicy
+         * @brief enum defining handling of a consumer that holds up a full queue
+         */
+        enum SlowPolicy
+        {
+            /// @brief pushing blocks until the slowest consumer pops
+            SLOW_BLOCK,
+            /// @brief slowest consumers skip unread elements if another consumer is caught up
+            SLOW_DROP
+        };
+
+        /**
+         * @class whfa::util::BPQueue<T>::Consumer
+         * @brief cursor of one consumer of a broadcast queue
+         *
+         * popping reads from this cursor only, pushing and flushing act on the whole broadcast queue
+         * size is the number of elements this consumer has yet to pop
+         * skipped elements (SLOW_DROP) are counted as flushed
+         */
+        class Consumer : public PQueue<T>
+        {
+        public:
+            using PQueue<T>::pop;
+            using PQueue<T>::push;
+            using PQueue<T>::pop_n;
+            using PQueue<T>::push_n;
+
+            /**
+             * @brief clear broadcast queue for all consumers
+             * @see BPQueue::flush()
+             *
+             * @param callback function to invoked on popped pointers, nullptr = use default
+             */
+            void flush(FlushCallback callback = nullptr) override
+            {
+                _q->flush(callback);
+            }
+
+            /**
+             * @brief invalidate broadcast queue for all consumers without waking waiting threads
+             * @see BPQueue::advance_epoch()
+             */
+            void advance_epoch() override
+            {
+                _q->advance_epoch();
+            }
+
+            /**
+             * @brief remove and retrieve next element unread by this consumer
+             *
+             * @param[out] ptr pointer (or clone) from this consumer's cursor
+             * @return true if successful, false if flushing or flushed while waiting
+             */
+            bool pop(T *&ptr) override
+            {
+                return _q->pop_n_until(*this, &ptr, 1, nullptr) == 1;
+            }
+
+            /**
+             * @brief remove and retrieve all elements unread by this consumer up to a max count
+             *
+             * blocks only while no elements are unread
+             *
+             * @param[out] out array of at least max pointers to populate from this consumer's cursor
+             * @param max max number of elements to pop
+             * @return number of elements popped, 0 if flushing or flushed while waiting
+             */
+            size_t pop_n(T **out, size_t max) override
+            {
+                return _q->pop_n_until(*this, out, max, nullptr);
+            }
+
+            /**
+             * @brief insert element into back of broadcast queue
+             *
+             * @param ptr pointer to copy to queue
+             * @return true if successful, false if flushing or flushed while waiting
+             */
+            bool push(T *ptr) override
+            {
+                return _q->push_n_until(&ptr, 1, nullptr) == 1;
+            }
+
+            /**
+             * @brief insert multiple elements into back of broadcast queue
+             *
+             * @param in array of n pointers to copy to queue
+             * @param n number of elements to push
+             * @return number of elements pushed, less than n if flushing or flushed while waiting
+             */
+            size_t push_n(T *const *in, size_t n) override
+            {
+                return _q->push_n_until(in, n, nullptr);
+            }
+
+            /**
+             * @brief get capacity of broadcast queue
+             *
+             * @return capacity of queue
+             */
+            size_t get_capacity() const override
+            {
+                return _q->get_capacity();
+            }
+
+            /**
+             * @brief get number of elements this consumer has yet to pop
+             *
+             * @return number of unread elements
+             */
+            size_t get_size() override
+            {
+                std::lock_guard<std::mutex> lk(_q->_mtx);
+                return static_cast<size_t>(_q->_head - _pos);
+            }
+
+            /**
+             * @brief broadcast queues are unweighted
+             *
+             * @return 0
+             */
+            size_t get_limit() const override
+            {
+                return 0;
+            }
+
+            /**
+             * @brief broadcast queues are unweighted
+             *
+             * @return 0
+             */
+            size_t get_weight() override
+            {
+                return 0;
+            }
+
+        protected:
+            friend class BPQueue<T>;
+
+            /**
+             * @brief hidden constructor, consumers are created by BPQueue::subscribe()
+             *
+             * @param q broadcast queue to consume from
+             * @param pos sequence number of first element to pop
+             */
+            Consumer(BPQueue &q, uint64_t pos)
+                : _q(&q),
+                  _pos(pos),
+                  _flush(false),
+                  _num_wait(0)
+            {
+            }
+
+            /**
+             * @brief implementation of timed pop()
+             * @see PQueue::pop()
+             *
+             * @param[out] ptr pointer (or clone) from this consumer's cursor
+             * @param timeout max duration to wait for
+             * @return true if successful, false if flushed or timeout reached
+             */
+            bool pop_for(T *&ptr, const std::chrono::nanoseconds &timeout) override
+            {
+                const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+                return _q->pop_n_until(*this, &ptr, 1, &deadline) == 1;
+            }
+
+            /**
+             * @brief implementation of timed pop_n()
+             * @see PQueue::pop_n()
+             *
+             * @param[out] out array of at least max pointers to populate from this consumer's cursor
+             * @param max max number of elements to pop
+             * @param timeout max duration to wait for
+             * @return number of elements popped, 0 if flushed or timeout reached
+             */
+            size_t pop_n_for(T **out, size_t max, const std::chrono::nanoseconds &timeout) override
+            {
+                const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+                return _q->pop_n_until(*this, out, max, &deadline);
+            }
+
+            /**
+             * @brief implementation of timed push()
+             * @see PQueue::push()
+             *
+             * @param ptr pointer to copy to queue
+             * @param timeout max duration to wait for
+             * @return true if successful, false if flushed or timeout reached
+             */
+            bool push_for(T *ptr, const std::chrono::nanoseconds &timeout) override
+            {
+                const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+                return _q->push_n_until(&ptr, 1, &deadline) == 1;
+            }
+
+            /**
+             * @brief implementation of timed push_n()
+             * @see PQueue::push_n()
+             *
+             * @param in array of n pointers to copy to queue
+             * @param n number of elements to push
+             * @param timeout max duration to wait for
+             * @return number of elements pushed, less than n if flushed or timeout reached
+             */
+            size_t push_n_for(T *const *in, size_t n, const std::chrono::nanoseconds &timeout) override
+            {
+                const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+                return _q->push_n_until(in, n, &deadline);
+            }
+
+            /// @brief broadcast queue consumed from
+            BPQueue *_q;
+            /// @brief sequence number of next element to pop
+            uint64_t _pos;
+            /// @brief control flag to signal a flush
+            bool _flush;
+            /// @brief number of threads waiting to pop
+            size_t _num_wait;
+        };
+
+        /**
+         * @brief constructor
+         *
+         * @param capacity max number of elements any consumer can lag behind
+         * @param callback default callback to invoke when flushing
+         * @param clone callback to copy elements for all but the last consumer, nullptr = share pointers
+         * @param policy handling of consumers that hold up a full queue
+         */
+        BPQueue(size_t capacity, FlushCallback callback = nullptr,
+                CloneCallback clone = nullptr, SlowPolicy policy = SLOW_BLOCK)
+            : _capacity(capacity),
+              _callback(callback),
+              _clone(clone),
+              _policy(policy),
+              _buf(new T *[capacity]),
+              _refs(new size_t[capacity]),
+              _head(0),
+              _tail(0),
+              _push_flush(false),
+              _push_num_wait(0)
+        {
+        }
+
+        /**
+         * @brief destructor, flushes and frees all consumers
+         */
+        ~BPQueue()
+        {
+            flush();
+            std::lock_guard<std::mutex> lk(_mtx);
+            for (Consumer *c : _consumers)
+            {
+                delete c;
+            }
+            delete[] _refs;
+            delete[] _buf;
+        }
+
+        /**
+         * @brief add consumer that pops every element pushed from now on
+         *
+         * @return consumer owned by this queue, valid until unsubscribed or destruction
+         */
+        Consumer *subscribe()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            Consumer *c = new Consumer(*this, _head);
+            _consumers.push_back(c);
+            return c;
+        }
+
+        /**
+         * @brief remove and free consumer, releasing its unread elements
+         *
+         * no thread may be using the consumer
+         *
+         * @param consumer consumer returned by subscribe()
+         * @return false if consumer is not subscribed to this queue
+         */
+        bool unsubscribe(Consumer *consumer)
+        {
+            bool released;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                auto it = std::find(_consumers.begin(), _consumers.end(), consumer);
+                if (it == _consumers.end())
+                {
+                    return false;
+                }
+                skip_unread(*consumer);
+                _consumers.erase(it);
+                released = advance_tail();
+            }
+            delete consumer;
+            if (released)
+            {
+                _push_cond.notify_all();
+            }
+            return true;
+        }
+
+        /**
+         * @brief clear queue for all consumers and handle invoked on each queued element
+         *
+         * notify all waiting threads
+         * waiting push and pop calls of every consumer will return false
+         *
+         * @param callback function to invoked on queued pointers, nullptr = use default
+         */
+        void flush(FlushCallback callback = nullptr)
+        {
+            FlushCallback cb = (callback == nullptr) ? _callback : callback;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                if (cb != nullptr)
+                {
+                    for (uint64_t seq = _tail; seq != _head; ++seq)
+                    {
+                        cb(_buf[seq % _capacity]);
+                    }
+                }
+                for (Consumer *c : _consumers)
+                {
+                    c->_counters.count_flush(_head - c->_pos);
+                    c->_pos = _head;
+                    c->_flush = true;
+                }
+                _tail = _head;
+                _push_flush = true;
+            }
+            _pop_cond.notify_all();
+            _push_cond.notify_all();
+        }
+
+        /**
+         * @brief invalidate all queued elements for all consumers without waking waiting threads
+         *
+         * unlike flush(), waiting and later push and pop calls proceed normally
+         * elements pushed before this call are released immediately with the default flush callback,
+         * the sequence number of the head marks the epoch boundary, so no per element tagging is needed
+         * released elements are counted as flushed by each consumer that had yet to pop them
+         */
+        void advance_epoch()
+        {
+            bool released;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                for (Consumer *c : _consumers)
+                {
+                    skip_unread(*c);
+                }
+                released = advance_tail();
+            }
+            if (released)
+            {
+                // only pushing threads blocked on a full queue can make progress
+                _push_cond.notify_all();
+            }
+        }
+
+        /**
+         * @brief get capacity specified from constructor
+         *
+         * @return capacity of queue
+         */
+        size_t get_capacity() const
+        {
+            return _capacity;
+        }
+
+        /**
+         * @brief get number of subscribed consumers
+         *
+         * @return number of consumers
+         */
+        size_t get_consumers()
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            return _consumers.size();
+        }
+
+    protected:
+        /**
+         * @brief blocking pop of multiple elements from consumer cursor with optional deadline
+         *
+         * @param c consumer popping
+         * @param[out] out array of at least max pointers to populate
+         * @param max max number of elements to pop
+         * @param deadline time to stop waiting at, nullptr = wait indefinitely
+         * @return number of elements popped, 0 if flushed or deadline reached
+         */
+        size_t pop_n_until(Consumer &c, T **out, size_t max, const std::chrono::steady_clock::time_point *deadline)
+        {
+            if (max == 0)
+            {
+                return 0;
+            }
+            std::unique_lock<std::mutex> lk(_mtx);
+            size_t n = 0;
+            while (n == 0)
+            {
+                while (!c._flush && c._pos == _head)
+                {
+                    const std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+                    c._num_wait++;
+                    bool timedout = false;
+                    if (deadline == nullptr)
+                    {
+                        _pop_cond.wait(lk);
+                    }
+                    else
+                    {
+                        timedout = _pop_cond.wait_until(lk, *deadline) == std::cv_status::timeout;
+                    }
+                    c._num_wait--;
+                    c._counters.count_pop_wait(wait_start);
+                    if (timedout)
+                    {
+                        return 0;
+                    }
+                }
+                if (c._flush)
+                {
+                    c._flush = c._num_wait != 0;
+                    return 0;
+                }
+                n = take(c, out, max);
+                if (n == 0)
+                {
+                    // clone of next element failed, retry later (memory freed, or other consumers popped it)
+                    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+                    std::chrono::steady_clock::time_point retry = now + CLONE_RETRY;
+                    if (deadline != nullptr)
+                    {
+                        if (now >= *deadline)
+                        {
+                            return 0;
+                        }
+                        retry = std::min(retry, *deadline);
+                    }
+                    c._num_wait++;
+                    _pop_cond.wait_until(lk, retry);
+                    c._num_wait--;
+                }
+            }
+            c._counters.count_pop(n);
+            const bool released = advance_tail();
+            lk.unlock();
+            if (released)
+            {
+                _push_cond.notify_all();
+            }
+            return n;
+        }
+
+        /**
+         * @brief not thread safe removal of available elements from consumer cursor
+         *
+         * the last consumer to pop an element takes the original, others take clones
+         * stops at the first element that fails to clone, leaving it unread
+         *
+         * @param c consumer popping, with at least one unread element
+         * @param[out] out array of at least max pointers to populate
+         * @param max max number of elements to pop
+         * @return number of elements popped, 0 if cloning the next element failed
+         */
+        size_t take(Consumer &c, T **out, size_t max)
+        {
+            const size_t n = std::min<size_t>(max, _head - c._pos);
+            size_t i = 0;
+            for (; i < n; ++i)
+            {
+                const size_t slot = c._pos % _capacity;
+                T *ptr = _buf[slot];
+                // others take clones while original is still referenced (nullptr elements clone to nullptr)
+                if (_refs[slot] != 1 && _clone != nullptr && ptr != nullptr)
+                {
+                    ptr = _clone(ptr);
+                    if (ptr == nullptr)
+                    {
+                        break;
+                    }
+                }
+                _refs[slot]--;
+                c._pos++;
+                out[i] = ptr;
+            }
+            return i;
+        }
+
+        /**
+         * @brief blocking push of multiple elements with optional deadline
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n number of elements to push
+         * @param deadline time to stop waiting at, nullptr = wait indefinitely
+         * @return number of elements pushed, less than n if flushed or deadline reached
+         */
+        size_t push_n_until(T *const *in, size_t n, const std::chrono::steady_clock::time_point *deadline)
+        {
+            size_t cnt = 0;
+            std::unique_lock<std::mutex> lk(_mtx);
+            while (cnt < n)
+            {
+                bool timedout = false;
+                while (!_push_flush && is_full() && !timedout)
+                {
+                    if (_policy == SLOW_DROP && drop_slowest())
+                    {
+                        continue;
+                    }
+                    if (cnt != 0)
+                    {
+                        // consumers may be waiting on elements already pushed
+                        _pop_cond.notify_all();
+                    }
+                    const std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+                    _push_num_wait++;
+                    if (deadline == nullptr)
+                    {
+                        _push_cond.wait(lk);
+                    }
+                    else
+                    {
+                        timedout = _push_cond.wait_until(lk, *deadline) == std::cv_status::timeout;
+                    }
+                    _push_num_wait--;
+                    for (Consumer *c : _consumers)
+                    {
+                        c->_counters.count_push_wait(wait_start);
+                    }
+                }
+                if (_push_flush)
+                {
+                    _push_flush = _push_num_wait != 0;
+                    break;
+                }
+                if (timedout)
+                {
+                    break;
+                }
+                cnt += fill(&(in[cnt]), n - cnt);
+            }
+            lk.unlock();
+            if (cnt != 0)
+            {
+                _pop_cond.notify_all();
+            }
+            return cnt;
+        }
+
+        /**
+         * @brief not thread safe copying of elements into free slots
+         *
+         * elements pushed while no consumer is subscribed are handed to the default flush callback
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n max number of elements to copy
+         * @return number of elements copied
+         */
+        size_t fill(T *const *in, size_t n)
+        {
+            const size_t refs = _consumers.size();
+            if (refs == 0)
+            {
+                if (_callback != nullptr)
+                {
+                    for (size_t i = 0; i < n; ++i)
+                    {
+                        _callback(in[i]);
+                    }
+                }
+                return n;
+            }
+            const size_t m = std::min<size_t>(n, _capacity - (_head - _tail));
+            for (size_t i = 0; i < m; ++i)
+            {
+                const size_t slot = (_head++) % _capacity;
+                _buf[slot] = in[i];
+                _refs[slot] = refs;
+            }
+            for (Consumer *c : _consumers)
+            {
+                c->_counters.count_push(m, _head - c->_pos);
+            }
+            return m;
+        }
+
+        /**
+         * @brief not thread safe check if the slowest consumer is a full capacity behind
+         *
+         * @return true if full
+         */
+        bool is_full() const
+        {
+            return _head - _tail >= _capacity;
+        }
+
+        /**
+         * @brief not thread safe skipping of consumers holding up the tail while another is caught up
+         *
+         * @return true if any consumer skipped ahead
+         */
+        bool drop_slowest()
+        {
+            const bool caught_up = std::any_of(_consumers.begin(), _consumers.end(),
+                                               [this](const Consumer *c)
+                                               { return c->_pos == _head; });
+            if (!caught_up)
+            {
+                return false;
+            }
+            bool dropped = false;
+            for (Consumer *c : _consumers)
+            {
+                if (c->_pos == _tail)
+                {
+                    skip_unread(*c);
+                    dropped = true;
+                }
+            }
+            return dropped && advance_tail();
+        }
+
+        /**
+         * @brief not thread safe release of all elements unread by consumer
+         *
+         * elements no longer referenced by any consumer are handed to the default flush callback
+         *
+         * @param c consumer to move to the head of the queue
+         */
+        void skip_unread(Consumer &c)
+        {
+            c._counters.count_flush(_head - c._pos);
+            for (; c._pos != _head; ++c._pos)
+            {
+                const size_t slot = c._pos % _capacity;
+                if (--_refs[slot] == 0 && _callback != nullptr)
+                {
+                    _callback(_buf[slot]);
+                }
+            }
+        }
+
+        /**
+         * @brief not thread safe release of slots no longer referenced by any consumer
+         *
+         * @return true if any slots were released
+         */
+        bool advance_tail()
+        {
+            const uint64_t tail = _tail;
+            while (_tail != _head && _refs[_tail % _capacity] == 0)
+            {
+                _tail++;
+            }
+            return _tail != tail;
+        }
+
+        /// @brief max number of elements any consumer can lag behind
+        size_t _capacity;
+        /// @brief default flush callback to invoke
+        FlushCallback _callback;
+        /// @brief clone callback (nullptr if pointers are shared)
+        CloneCallback _clone;
+        /// @brief handling of consumers that hold up a full queue
+        SlowPolicy _policy;
+        /// @brief ring of pointers indexed by sequence number modulo capacity
+        T **_buf;
+        /// @brief number of consumers yet to pop each slot
+        size_t *_refs;
+        /// @brief sequence number of next element to push
+        uint64_t _head;
+        /// @brief sequence number of oldest element still referenced
+        uint64_t _tail;
+        /// @brief subscribed consumers
+        std::vector<Consumer *> _consumers;
+        /// @brief control flag to signal a flush to pushing threads
+        bool _push_flush;
+        /// @brief number of threads waiting to push
+        size_t _push_num_wait;
+
+        /// @brief mutex synchronizing all queue and consumer state
+        std::mutex _mtx;
+        /// @brief condition variable for waiting and notifying blocking pop threads
+        std::condition_variable _pop_cond;
+        /// @brief condition variable for waiting and notifying blocking push threads
+        std::condition_variable _push_cond;
+    };
+
+}
\ No newline at end of file
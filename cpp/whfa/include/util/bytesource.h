@@ -0,0 +1,62 @@
+/**
+ * @file util/bytesource.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include <cstdint>
+
+namespace whfa::util
+{
+
+    /**
+     * @class whfa::util::ByteSource
+     * @brief abstract interface for a seekable source of file bytes (e.g. a file received into memory)
+     *
+     * shaped like stdio and libav I/O callbacks, so sources can back a custom AVIOContext
+     * only one thread reads and seeks at a time
+     */
+    class ByteSource
+    {
+    public:
+        /**
+         * @brief destructor
+         */
+        virtual ~ByteSource()
+        {
+        }
+
+        /**
+         * @brief copy bytes from current read position into buffer, can block
+         *
+         * @param[out] buf byte buffer to populate
+         * @param size number of bytes to read at most
+         * @return number of bytes read, 0 if end of file (or no data)
+         */
+        virtual uint64_t read(uint8_t *buf, uint64_t size) = 0;
+
+        /**
+         * @brief fseek equivalent, can block
+         *
+         * @param offset byte offset to move read position to
+         * @param whence position from which offset is applied (SEEK_SET, SEEK_CUR, or SEEK_END)
+         * @return true if successful, false if bad parameter values
+         */
+        virtual bool seek(int64_t offset, int whence) = 0;
+
+        /**
+         * @brief get current read position
+         *
+         * @return byte offset of read position
+         */
+        virtual uint64_t get_position() = 0;
+
+        /**
+         * @brief get file size
+         *
+         * @return file size in bytes
+         */
+        virtual uint64_t get_filesize() = 0;
+    };
+
+}
\ No newline at end of file
@@ -0,0 +1,73 @@
+/**
+ * @file util/canceltoken.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include <atomic>
+#include <mutex>
+
+namespace whfa::util
+{
+
+    /**
+     * @class whfa::util::CancelToken
+     * @brief threadsafe flag requesting blocking operations to give up, pollable as a file descriptor
+     *
+     * polled by callbacks (e.g. libav interrupt callbacks) or between bounded waits,
+     * and added to poll() sets so socket waits wake as soon as it is cancelled
+     */
+    class CancelToken
+    {
+    public:
+        /**
+         * @brief constructor, creates eventfd
+         */
+        CancelToken();
+
+        /**
+         * @brief destructor, closes eventfd
+         */
+        ~CancelToken();
+
+        CancelToken(const CancelToken &) = delete;
+        CancelToken &operator=(const CancelToken &) = delete;
+
+        /**
+         * @brief request cancellation, waking pollers of fd
+         */
+        void cancel();
+
+        /**
+         * @brief clear cancellation for reuse
+         */
+        void reset();
+
+        /**
+         * @brief check if cancelled
+         *
+         * lock-free
+         *
+         * @return true if cancelled
+         */
+        bool is_cancelled() const;
+
+        /**
+         * @brief get file descriptor readable (POLLIN) while cancelled
+         *
+         * must not be read from, only polled
+         *
+         * @return eventfd, < 0 if it could not be created
+         */
+        int get_fd() const;
+
+    protected:
+        /// @brief true while cancelled
+        std::atomic<bool> _cancelled;
+        /// @brief eventfd holding a nonzero count while cancelled
+        int _fd;
+        /// @brief mutex keeping flag and eventfd count consistent across cancel and reset
+        std::mutex _mtx;
+    };
+
+}
\ No newline at end of file
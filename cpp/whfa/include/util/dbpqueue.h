@@ -4,15 +4,19 @@
  */
 #pragma once
 
-#include <chrono>
-#include <condition_variable>
+#include "util/pqueue.h"
+#include "util/waitpolicy.h"
+
+#include <algorithm>
+#include <atomic>
 #include <mutex>
+#include <vector>
 
 namespace whfa::util
 {
 
     /**
-     * @class whfa::util::DBPQueue<T>
+     * @class whfa::util::DBPQueue<T, WaitPolicy>
      * @brief threadsafe dual-blocking pointer queue of fixed capacity
      *
      * only stores pointers T*
@@ -20,29 +24,53 @@ namespace whfa::util
      * pushing blocks when queue is full
      * implemented using two arrays with separate locks for popping and pushing
      * effective capacity at worst is 2 * specified capacity
+     * optionally bounded by total weight of queued elements across both arrays (e.g. bytes)
+     * waiting behavior defined by WaitPolicy (BlockWait, SpinWait, or SpinFutexWait)
      */
-    template <typename T>
-    class DBPQueue
+    template <typename T, typename WaitPolicy = BlockWait>
+    class DBPQueue : public PQueue<T>
     {
     public:
-        /// @brief callback type to be invoked when flushing (stateless, mostly for destruction)
-        using FlushCallback = void (*)(T *);
+        /// @brief callback type to be invoked when flushing (mostly for destruction or recycling)
+        using FlushCallback = typename PQueue<T>::FlushCallback;
+        /// @brief callback type to weigh elements against weight limit (stateless)
+        using WeightCallback = typename PQueue<T>::WeightCallback;
+
+        using PQueue<T>::pop;
+        using PQueue<T>::push;
+        using PQueue<T>::pop_n;
+        using PQueue<T>::push_n;
 
         /**
          * @brief constructor
          *
+         * when weighted, pushing also blocks while total queued weight would exceed the limit
+         * an element heavier than the limit is still accepted by an empty queue
+         *
          * @param capacity the ideal target capacity
          * @param callback default callback to invoke when flushing
+         * @param limit max total weight of queued elements (ignored if weight is nullptr)
+         * @param weight callback to weigh elements, nullptr = unweighted
          */
-        DBPQueue(size_t capacity, FlushCallback callback = nullptr)
+        DBPQueue(size_t capacity, FlushCallback callback = nullptr,
+                 size_t limit = 0, WeightCallback weight = nullptr)
             : _capacity(capacity),
               _callback(callback),
+              _limit(limit),
+              _weigher(weight),
+              _weight(0),
+              _weight_wait(0),
+              _pop_wait(0),
+              _count(0),
+              _epoch(0),
               _pop_buf({.buf = new T *[capacity],
+                        .epoch = new uint64_t[capacity],
                         .pos = 0,
                         .sz = 0}),
               _pop_st({.flush = false,
                        .num_wait = 0}),
               _push_buf({.buf = new T *[capacity],
+                         .epoch = new uint64_t[capacity],
                          .pos = 0,
                          .sz = 0}),
               _push_st({.flush = false,
@@ -53,16 +81,18 @@ namespace whfa::util
         /**
          * @brief destructor
          */
-        ~DBPQueue()
+        ~DBPQueue() override
         {
             flush();
             {
                 std::lock_guard<std::mutex> pop_lk(_pop_mtx);
-                delete _pop_buf.buf;
+                delete[] _pop_buf.epoch;
+                delete[] _pop_buf.buf;
             }
             {
                 std::lock_guard<std::mutex> push_lk(_push_mtx);
-                delete _push_buf.buf;
+                delete[] _push_buf.epoch;
+                delete[] _push_buf.buf;
             }
         }
 
@@ -76,129 +106,135 @@ namespace whfa::util
          *
          * @param callback function to invoked on popped pointers, nullptr = use default
          */
-        void flush(FlushCallback callback = nullptr)
+        void flush(FlushCallback callback = nullptr) override
         {
             FlushCallback cb = (callback == nullptr) ? _callback : callback;
 
             {
                 std::lock_guard<std::mutex> lk(_pop_mtx);
                 _pop_st.flush = true;
-                if (cb != nullptr)
+                size_t w = 0;
+                const size_t n = _pop_buf.sz;
+                while (_pop_buf.sz != 0)
                 {
-                    while (_pop_buf.sz != 0)
+                    T *ptr = _pop_buf.buf[_pop_buf.pos++];
+                    _pop_buf.sz--;
+                    w += weigh(ptr);
+                    if (cb != nullptr)
                     {
-                        cb(_pop_buf.buf[_pop_buf.pos++]);
-                        _pop_buf.sz--;
+                        cb(ptr);
                     }
                 }
                 _pop_buf.pos = 0;
+                _weight.fetch_sub(w, std::memory_order_seq_cst);
+                _count.fetch_sub(n, std::memory_order_relaxed);
+                this->_counters.count_flush(n);
             }
             _pop_cond.notify_all();
 
             {
                 std::lock_guard<std::mutex> lk(_push_mtx);
                 _push_st.flush = true;
-                if (cb != nullptr)
+                size_t w = 0;
+                size_t i = 0;
+                while (i != _push_buf.sz)
                 {
-                    size_t i = 0;
-                    while (i != _push_buf.sz)
+                    T *ptr = _push_buf.buf[i++];
+                    w += weigh(ptr);
+                    if (cb != nullptr)
                     {
-                        cb(_push_buf.buf[i++]);
+                        cb(ptr);
                     }
                 }
+                _weight.fetch_sub(w, std::memory_order_seq_cst);
+                _count.fetch_sub(_push_buf.sz, std::memory_order_relaxed);
+                this->_counters.count_flush(_push_buf.sz);
                 _push_buf.sz = 0;
             }
             _push_cond.notify_all();
         }
 
         /**
-         * @brief remove and retrieve first element in queue
+         * @brief invalidate all queued elements without waking waiting threads
          *
-         * @param[out] ptr pointer moved from front of queue
-         * @return true if successful, false if flushing or flushed while waiting
+         * elements pushed before this call are discarded lazily by poppers, using the default flush callback
+         * stale elements still occupy capacity and weight until discarded
          */
-        bool pop(T *&ptr)
+        void advance_epoch() override
         {
-            bool rv = false;
-            std::unique_lock<std::mutex> pop_lk(_pop_mtx);
-            while (!_pop_st.flush && _pop_buf.sz == 0)
-            {
-                bool refilled;
-                {
-                    std::lock_guard<std::mutex> push_lk(_push_mtx);
-                    refilled = fill_pop_buffer();
-                }
-                if (refilled)
-                {
-                    _push_cond.notify_all();
-                }
-                else
-                {
-                    _pop_st.num_wait++;
-                    _pop_cond.wait(pop_lk);
-                    _pop_st.num_wait--;
-                }
-            }
-            if (_pop_st.flush)
-            {
-                _pop_st.flush = _pop_st.num_wait != 0;
-            }
-            else
-            {
-                ptr = _pop_buf.buf[_pop_buf.pos++];
-                _pop_buf.sz--;
-                rv = true;
-            }
-            pop_lk.unlock();
-            return rv;
+            _epoch.fetch_add(1, std::memory_order_acq_rel);
         }
 
         /**
-         * @brief remove and retrieve first element in queue within a timeout period
+         * @brief remove only queued elements matching a predicate
          *
-         * @param[out] ptr pointer moved from front of queue
-         * @param timeout max duration to wait for
-         * @return true if successful, false if flushed or timeout reached
+         * unlike flush(), waiting threads are not woken and push and pop calls are unaffected
+         * matching elements are handed to callback after releasing queue locks
+         *
+         * @param pred callable taking const T* returning true if the element should be removed
+         * @param callback function to invoke on removed pointers, nullptr = use default
+         * @return number of elements removed
          */
-        template <typename Rep, typename Period>
-        bool pop(T *&ptr, const std::chrono::duration<Rep, Period> &timeout)
+        template <typename Predicate>
+        size_t flush_if(Predicate pred, FlushCallback callback = nullptr)
         {
-            bool rv = false;
-            std::unique_lock<std::mutex> pop_lk(_pop_mtx);
-            while (!_pop_st.flush && _pop_buf.sz == 0)
+            FlushCallback cb = (callback == nullptr) ? _callback : callback;
+            std::vector<T *> removed;
             {
-                bool refilled;
-                {
-                    std::lock_guard<std::mutex> push_lk(_push_mtx);
-                    refilled = fill_pop_buffer();
-                }
-                if (refilled)
+                std::lock_guard<std::mutex> pop_lk(_pop_mtx);
+                std::lock_guard<std::mutex> push_lk(_push_mtx);
+                extract_if(_pop_buf, pred, removed);
+                extract_if(_push_buf, pred, removed);
+                _count.fetch_sub(removed.size(), std::memory_order_relaxed);
+                this->_counters.count_flush(removed.size());
+            }
+            if (!removed.empty())
+            {
+                if (_weigher != nullptr)
                 {
-                    _push_cond.notify_all();
+                    size_t w = 0;
+                    for (const T *ptr : removed)
+                    {
+                        w += _weigher(ptr);
+                    }
+                    release_weight(w);
                 }
-                else
+                _push_cond.notify_all();
+                if (cb != nullptr)
                 {
-                    _pop_st.num_wait++;
-                    const std::cv_status cvs = _pop_cond.wait_for(pop_lk, timeout);
-                    _pop_st.num_wait--;
-                    if (cvs == std::cv_status::timeout)
+                    for (T *ptr : removed)
                     {
-                        return false;
+                        cb(ptr);
                     }
                 }
             }
-            if (_pop_st.flush)
-            {
-                _pop_st.flush = _pop_st.num_wait != 0;
-            }
-            else
-            {
-                ptr = _pop_buf.buf[_pop_buf.pos++];
-                _pop_buf.sz--;
-                rv = true;
-            }
-            pop_lk.unlock();
-            return rv;
+            return removed.size();
+        }
+
+        /**
+         * @brief remove and retrieve first element in queue
+         *
+         * @param[out] ptr pointer moved from front of queue
+         * @return true if successful, false if flushing or flushed while waiting
+         */
+        bool pop(T *&ptr) override
+        {
+            return pop_n_until(&ptr, 1, nullptr) == 1;
+        }
+
+        /**
+         * @brief remove and retrieve all available elements up to a max count
+         *
+         * blocks only while queue is empty
+         * takes from both underlying buffers within a single pop lock acquisition
+         *
+         * @param[out] out array of at least max pointers to populate from front of queue
+         * @param max max number of elements to pop
+         * @return number of elements popped, 0 if flushing or flushed while waiting
+         */
+        size_t pop_n(T **out, size_t max) override
+        {
+            return pop_n_until(out, max, nullptr);
         }
 
         /**
@@ -207,15 +243,19 @@ namespace whfa::util
          * @param ptr pointer to copy to queue
          * @return true if successful, false if flushing or flushed while waiting
          */
-        bool push(T *ptr)
+        bool push(T *ptr) override
         {
             bool rv = false;
+            const size_t w = weigh(ptr);
             std::unique_lock<std::mutex> push_lk(_push_mtx);
-            while (!_push_st.flush && _push_buf.sz == _capacity)
+            WeightWaitGuard ww(*this);
+            while (!_push_st.flush && is_full(w))
             {
+                const std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
                 _push_st.num_wait++;
                 _push_cond.wait(push_lk);
                 _push_st.num_wait--;
+                this->_counters.count_push_wait(wait_start);
             }
             if (_push_st.flush)
             {
@@ -223,31 +263,163 @@ namespace whfa::util
             }
             else
             {
-                _push_buf.buf[_push_buf.sz++] = ptr;
+                fill_push_buffer(&ptr, 1);
                 rv = true;
             }
             push_lk.unlock();
-            _pop_cond.notify_all();
+            notify_pop();
             return rv;
         }
 
         /**
-         * @brief insert element into back of queue within a timeout period
+         * @brief insert multiple elements into back of queue
+         *
+         * blocks while queue is full until all elements are pushed
+         * waiting consumers are notified once per filled buffer rather than once per element
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n number of elements to push
+         * @return number of elements pushed, less than n if flushing or flushed while waiting
+         */
+        size_t push_n(T *const *in, size_t n) override
+        {
+            return push_n_until(in, n, nullptr);
+        }
+
+        /**
+         * @brief get ideal capacity of queue specified from constructor
+         *
+         * backed by two arrays of this size with a worst case max of 2 * capacity
+         *
+         * @return capacity of queue
+         */
+        size_t get_capacity() const override
+        {
+            return _capacity;
+        }
+
+        /**
+         * @brief get number of items in queue
+         *
+         * does not lock, may lag behind concurrent pushes and pops
+         *
+         * @return number of items in queue
+         */
+        size_t get_size() override
+        {
+            return _count.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief get max total weight of queued elements specified from constructor
+         *
+         * @return weight limit, 0 if unweighted
+         */
+        size_t get_limit() const override
+        {
+            return (_weigher == nullptr) ? 0 : _limit;
+        }
+
+        /**
+         * @brief get total weight of queued elements
+         *
+         * @return total weight, 0 if unweighted
+         */
+        size_t get_weight() override
+        {
+            return _weight.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief weigh element using weight callback
+         *
+         * @param ptr element to weigh
+         * @return weight of element, 0 if unweighted
+         */
+        size_t weigh(const T *ptr) const override
+        {
+            return (_weigher == nullptr) ? 0 : _weigher(ptr);
+        }
+
+    protected:
+        /**
+         * @struct whfa::util::DBPQueue<T, WaitPolicy>::Buffer
+         * @brief struct for holding backing buffer data
+         */
+        struct BufferData
+        {
+            /// @brief array of pointers
+            T **buf;
+            /// @brief array of epochs elements were pushed in
+            uint64_t *epoch;
+            /// @brief position in buffer where valid data starts
+            size_t pos;
+            /// @brief number of valid elements in buffer
+            size_t sz;
+        };
+
+        /**
+         * @struct whfa::util::DBPQueue<T, WaitPolicy>::State
+         * @brief struct for holding backing buffer state
+         */
+        struct BufferState
+        {
+            /// @brief control flag to signal a flush
+            bool flush;
+            /// @brief number of threads waiting to access buffer
+            size_t num_wait;
+        };
+
+        /// @brief max number of stale elements discarded per pop lock acquisition
+        static constexpr size_t DISCARD_SZ = 64;
+
+        /**
+         * @struct whfa::util::DBPQueue<T, WaitPolicy>::Discard
+         * @brief struct for holding stale elements removed from pop buffer
+         */
+        struct Discard
+        {
+            /// @brief array of stale pointers
+            T *buf[DISCARD_SZ];
+            /// @brief number of stale pointers
+            size_t sz;
+        };
+
+        /**
+         * @brief implementation of timed pop()
+         * @see PQueue::pop()
+         *
+         * @param[out] ptr pointer moved from front of queue
+         * @param timeout max duration to wait for
+         * @return true if successful, false if flushed or timeout reached
+         */
+        bool pop_for(T *&ptr, const std::chrono::nanoseconds &timeout) override
+        {
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+            return pop_n_until(&ptr, 1, &deadline) == 1;
+        }
+
+        /**
+         * @brief implementation of timed push()
+         * @see PQueue::push()
          *
          * @param ptr pointer to copy to queue
          * @param timeout max duration to wait for
          * @return true if successful, false if flushed or timeout reached
          */
-        template <typename Rep, typename Period>
-        bool push(T *ptr, const std::chrono::duration<Rep, Period> &timeout)
+        bool push_for(T *ptr, const std::chrono::nanoseconds &timeout) override
         {
             bool rv = false;
+            const size_t w = weigh(ptr);
             std::unique_lock<std::mutex> push_lk(_push_mtx);
-            while (!_push_st.flush && _push_buf.sz == _capacity)
+            WeightWaitGuard ww(*this);
+            while (!_push_st.flush && is_full(w))
             {
+                const std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
                 _push_st.num_wait++;
                 const std::cv_status cvs = _push_cond.wait_for(push_lk, timeout);
                 _push_st.num_wait--;
+                this->_counters.count_push_wait(wait_start);
                 if (cvs == std::cv_status::timeout)
                 {
                     return false;
@@ -259,63 +431,414 @@ namespace whfa::util
             }
             else
             {
-                _push_buf.buf[_push_buf.sz++] = ptr;
+                fill_push_buffer(&ptr, 1);
                 rv = true;
             }
             push_lk.unlock();
-            _pop_cond.notify_all();
+            notify_pop();
             return rv;
         }
 
         /**
-         * @brief get ideal capacity of queue specified from constructor
+         * @brief implementation of timed pop_n()
+         * @see PQueue::pop_n()
          *
-         * backed by two arrays of this size with a worst case max of 2 * capacity
+         * @param[out] out array of at least max pointers to populate from front of queue
+         * @param max max number of elements to pop
+         * @param timeout max duration to wait for
+         * @return number of elements popped, 0 if flushed or timeout reached
+         */
+        size_t pop_n_for(T **out, size_t max, const std::chrono::nanoseconds &timeout) override
+        {
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+            return pop_n_until(out, max, &deadline);
+        }
+
+        /**
+         * @brief implementation of timed push_n()
+         * @see PQueue::push_n()
          *
-         * @return capacity of queue
+         * @param in array of n pointers to copy to queue
+         * @param n number of elements to push
+         * @param timeout max duration to wait for
+         * @return number of elements pushed, less than n if flushed or timeout reached
          */
-        size_t get_capacity() const
+        size_t push_n_for(T *const *in, size_t n, const std::chrono::nanoseconds &timeout) override
         {
-            return _capacity;
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + timeout;
+            return push_n_until(in, n, &deadline);
         }
 
         /**
-         * @brief get number of items in queue
+         * @brief blocking pop of all available elements up to a max count with optional deadline
          *
-         * @return number of items in queue
+         * @param[out] out array of at least max pointers to populate from front of queue
+         * @param max max number of elements to pop
+         * @param deadline time to stop waiting at, nullptr = wait indefinitely
+         * @return number of elements popped, 0 if flushed or deadline reached
          */
-        size_t get_size()
+        size_t pop_n_until(T **out, size_t max, const std::chrono::steady_clock::time_point *deadline)
         {
-            std::lock_guard<std::mutex> pop_lk(_pop_mtx);
-            std::lock_guard<std::mutex> push_lk(_push_mtx);
-            return _pop_buf.sz + _push_buf.sz;
+            if (max == 0)
+            {
+                return 0;
+            }
+            size_t n = 0;
+            bool timedout = false;
+            Discard stale;
+            stale.sz = 0;
+            std::unique_lock<std::mutex> pop_lk(_pop_mtx);
+            while (true)
+            {
+                while (!_pop_st.flush && _pop_buf.sz == 0 && !timedout)
+                {
+                    bool refilled;
+                    _pop_wait.fetch_add(1, std::memory_order_seq_cst);
+                    {
+                        std::lock_guard<std::mutex> push_lk(_push_mtx);
+                        refilled = fill_pop_buffer();
+                    }
+                    if (refilled)
+                    {
+                        _pop_wait.fetch_sub(1, std::memory_order_seq_cst);
+                        _push_cond.notify_all();
+                    }
+                    else
+                    {
+                        const std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+                        _pop_st.num_wait++;
+                        if (deadline == nullptr)
+                        {
+                            _pop_cond.wait(pop_lk);
+                        }
+                        else
+                        {
+                            timedout = _pop_cond.wait_until(pop_lk, *deadline) == std::cv_status::timeout;
+                        }
+                        _pop_st.num_wait--;
+                        _pop_wait.fetch_sub(1, std::memory_order_seq_cst);
+                        this->_counters.count_pop_wait(wait_start);
+                    }
+                }
+                if (_pop_st.flush)
+                {
+                    _pop_st.flush = _pop_st.num_wait != 0;
+                    break;
+                }
+                if (timedout)
+                {
+                    break;
+                }
+                n = take_pop_buffer(out, max, stale);
+                if (n != 0)
+                {
+                    break;
+                }
+                if (stale.sz == DISCARD_SZ)
+                {
+                    // only stale elements so far, free them without holding pop lock
+                    pop_lk.unlock();
+                    discard(stale);
+                    pop_lk.lock();
+                }
+            }
+            if (n != 0 && n < max)
+            {
+                // pop buffer drained, take what is available from push buffer as well
+                bool refilled;
+                {
+                    std::lock_guard<std::mutex> push_lk(_push_mtx);
+                    refilled = fill_pop_buffer();
+                }
+                if (refilled)
+                {
+                    _push_cond.notify_all();
+                    n += take_pop_buffer(&(out[n]), max - n, stale);
+                }
+            }
+            pop_lk.unlock();
+            discard(stale);
+            return n;
         }
 
-    protected:
         /**
-         * @struct whfa::util::DBPQueue<T>::Buffer
-         * @brief struct for holding backing buffer data
+         * @brief blocking push of multiple elements with optional deadline
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n number of elements to push
+         * @param deadline time to stop waiting at, nullptr = wait indefinitely
+         * @return number of elements pushed, less than n if flushed or deadline reached
          */
-        struct BufferData
+        size_t push_n_until(T *const *in, size_t n, const std::chrono::steady_clock::time_point *deadline)
         {
-            /// @brief array of pointers
-            T **buf;
-            /// @brief position in buffer where valid data starts
-            size_t pos;
-            /// @brief number of valid elements in buffer
-            size_t sz;
-        };
+            size_t cnt = 0;
+            size_t notified = 0;
+            std::unique_lock<std::mutex> push_lk(_push_mtx);
+            WeightWaitGuard ww(*this);
+            while (cnt < n)
+            {
+                bool timedout = false;
+                const size_t w = weigh(in[cnt]);
+                while (!_push_st.flush && is_full(w) && !timedout)
+                {
+                    if (cnt != notified)
+                    {
+                        // consumers may be waiting on elements already pushed, notify without push lock
+                        notified = cnt;
+                        push_lk.unlock();
+                        notify_pop();
+                        push_lk.lock();
+                        continue;
+                    }
+                    const std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+                    _push_st.num_wait++;
+                    if (deadline == nullptr)
+                    {
+                        _push_cond.wait(push_lk);
+                    }
+                    else
+                    {
+                        timedout = _push_cond.wait_until(push_lk, *deadline) == std::cv_status::timeout;
+                    }
+                    _push_st.num_wait--;
+                    this->_counters.count_push_wait(wait_start);
+                }
+                if (_push_st.flush)
+                {
+                    _push_st.flush = _push_st.num_wait != 0;
+                    break;
+                }
+                if (timedout)
+                {
+                    break;
+                }
+                cnt += fill_push_buffer(&(in[cnt]), n - cnt);
+            }
+            push_lk.unlock();
+            if (cnt != notified)
+            {
+                notify_pop();
+            }
+            return cnt;
+        }
 
         /**
-         * @struct whfa::util::DBPQueue<T>::State
-         * @brief struct for holding backing buffer state
+         * @brief not thread safe copying of elements from front of pop buffer
+         *
+         * elements tagged with a previous epoch are moved to stale instead, until it is full
+         *
+         * @param[out] out array of at least max pointers to populate
+         * @param max max number of elements to copy
+         * @param[out] stale stale elements to discard after releasing pop lock
+         * @return number of elements copied and removed from pop buffer
          */
-        struct BufferState
+        size_t take_pop_buffer(T **out, size_t max, Discard &stale)
         {
-            /// @brief control flag to signal a flush
-            bool flush;
-            /// @brief number of threads waiting to access buffer
-            size_t num_wait;
+            const uint64_t epoch = _epoch.load(std::memory_order_acquire);
+            const size_t nstale = stale.sz;
+            size_t n = 0;
+            size_t w = 0;
+            while (_pop_buf.sz != 0 && n < max)
+            {
+                T *ptr = _pop_buf.buf[_pop_buf.pos];
+                if (_pop_buf.epoch[_pop_buf.pos] == epoch)
+                {
+                    out[n++] = ptr;
+                }
+                else if (stale.sz != DISCARD_SZ)
+                {
+                    stale.buf[stale.sz++] = ptr;
+                }
+                else
+                {
+                    break;
+                }
+                _pop_buf.pos++;
+                _pop_buf.sz--;
+                w += weigh(ptr);
+            }
+            _count.fetch_sub(n + stale.sz - nstale, std::memory_order_relaxed);
+            this->_counters.count_pop(n);
+            this->_counters.count_flush(stale.sz - nstale);
+            if (_weigher != nullptr)
+            {
+                release_weight(w);
+            }
+            return n;
+        }
+
+        /**
+         * @brief not thread safe in order compaction of buffer, moving matching elements out
+         *
+         * @param[out] b buffer to compact
+         * @param pred callable taking const T* returning true if the element should be removed
+         * @param[out] removed removed elements appended
+         */
+        template <typename Predicate>
+        void extract_if(BufferData &b, Predicate &pred, std::vector<T *> &removed)
+        {
+            size_t k = b.pos;
+            for (size_t i = b.pos; i < b.pos + b.sz; ++i)
+            {
+                if (pred(static_cast<const T *>(b.buf[i])))
+                {
+                    removed.push_back(b.buf[i]);
+                }
+                else
+                {
+                    b.buf[k] = b.buf[i];
+                    b.epoch[k] = b.epoch[i];
+                    ++k;
+                }
+            }
+            b.sz = k - b.pos;
+        }
+
+        /**
+         * @brief hand stale elements to default flush callback
+         *
+         * @param[out] stale stale elements, emptied upon return
+         */
+        void discard(Discard &stale)
+        {
+            if (_callback != nullptr)
+            {
+                for (size_t i = 0; i < stale.sz; ++i)
+                {
+                    _callback(stale.buf[i]);
+                }
+            }
+            stale.sz = 0;
+        }
+
+        /**
+         * @brief not thread safe appending of as many elements as fit into push buffer
+         *
+         * the first element is assumed to fit, limited by capacity and weight limit thereafter
+         *
+         * @param in array of n pointers to copy to push buffer
+         * @param n max number of elements to copy
+         * @return number of elements copied into push buffer
+         */
+        size_t fill_push_buffer(T *const *in, size_t n)
+        {
+            n = std::min(n, _capacity - _push_buf.sz);
+            size_t k = 0;
+            size_t w = 0;
+            if (_weigher == nullptr)
+            {
+                k = n;
+            }
+            else
+            {
+                const size_t cur = _weight.load(std::memory_order_seq_cst);
+                while (k < n)
+                {
+                    const size_t w_k = _weigher(in[k]);
+                    if (k != 0 && cur + w + w_k > _limit)
+                    {
+                        break;
+                    }
+                    w += w_k;
+                    ++k;
+                }
+            }
+            std::copy(in, &(in[k]), &(_push_buf.buf[_push_buf.sz]));
+            std::fill_n(&(_push_buf.epoch[_push_buf.sz]), k, _epoch.load(std::memory_order_acquire));
+            _push_buf.sz += k;
+            _weight.fetch_add(w, std::memory_order_seq_cst);
+            this->_counters.count_push(k, _count.fetch_add(k, std::memory_order_relaxed) + k);
+            return k;
+        }
+
+        /**
+         * @brief not thread safe check if push buffer cannot accept an element
+         *
+         * @param weight weight of element to push
+         * @return true if push buffer is full or weight limit would be exceeded
+         */
+        bool is_full(size_t weight) const
+        {
+            if (_push_buf.sz == _capacity)
+            {
+                return true;
+            }
+            if (_weigher == nullptr)
+            {
+                return false;
+            }
+            const size_t cur = _weight.load(std::memory_order_seq_cst);
+            return cur != 0 && cur + weight > _limit;
+        }
+
+        /**
+         * @brief subtract popped weight and notify pushers waiting on weight limit
+         *
+         * @param weight total weight of popped elements
+         */
+        void release_weight(size_t weight)
+        {
+            _weight.fetch_sub(weight, std::memory_order_seq_cst);
+            if (_weight_wait.load(std::memory_order_seq_cst) != 0)
+            {
+                // pushers check weight while holding push lock, cannot miss this notification
+                {
+                    std::lock_guard<std::mutex> push_lk(_push_mtx);
+                }
+                _push_cond.notify_all();
+            }
+        }
+
+        /**
+         * @brief notify waiting poppers of elements pushed to push buffer
+         *
+         * must not be called while holding push lock
+         */
+        void notify_pop()
+        {
+            if (_pop_wait.load(std::memory_order_seq_cst) != 0)
+            {
+                // poppers check push buffer while holding pop lock, cannot miss this notification
+                {
+                    std::lock_guard<std::mutex> pop_lk(_pop_mtx);
+                }
+            }
+            _pop_cond.notify_all();
+        }
+
+        /**
+         * @struct whfa::util::DBPQueue<T, WaitPolicy>::WeightWaitGuard
+         * @brief scoped registration of a pusher that may wait on the weight limit
+         */
+        struct WeightWaitGuard
+        {
+            /**
+             * @brief constructor, registers pusher if queue is weighted
+             *
+             * @param q queue being pushed to
+             */
+            WeightWaitGuard(DBPQueue &q)
+                : _q(q._weigher == nullptr ? nullptr : &q)
+            {
+                if (_q != nullptr)
+                {
+                    _q->_weight_wait.fetch_add(1, std::memory_order_seq_cst);
+                }
+            }
+
+            /**
+             * @brief destructor, unregisters pusher
+             */
+            ~WeightWaitGuard()
+            {
+                if (_q != nullptr)
+                {
+                    _q->_weight_wait.fetch_sub(1, std::memory_order_seq_cst);
+                }
+            }
+
+            /// @brief registered queue, nullptr if unweighted
+            DBPQueue *_q;
         };
 
         /**
@@ -332,9 +855,12 @@ namespace whfa::util
                 return false;
             }
             T **b = _pop_buf.buf;
+            uint64_t *e = _pop_buf.epoch;
             _pop_buf = _push_buf;
             _push_buf.buf = b;
+            _push_buf.epoch = e;
             _push_buf.sz = 0;
+            this->_counters.count_swap();
             return true;
         }
 
@@ -342,6 +868,20 @@ namespace whfa::util
         size_t _capacity;
         /// @brief default flush callback to invoke
         FlushCallback _callback;
+        /// @brief max total weight of queued elements
+        size_t _limit;
+        /// @brief weight callback (nullptr if unweighted)
+        WeightCallback _weigher;
+        /// @brief total weight of elements in both buffers
+        std::atomic<size_t> _weight;
+        /// @brief number of pushers that may be waiting on weight limit
+        std::atomic<size_t> _weight_wait;
+        /// @brief number of poppers that may be waiting on empty push buffer
+        std::atomic<size_t> _pop_wait;
+        /// @brief number of elements in both buffers
+        std::atomic<size_t> _count;
+        /// @brief current epoch, elements pushed in previous epochs are stale
+        std::atomic<uint64_t> _epoch;
 
         /// @brief pop buffer data
         BufferData _pop_buf;
@@ -350,7 +890,7 @@ namespace whfa::util
         /// @brief mutex for synchronizing pop buffer access
         std::mutex _pop_mtx;
         /// @brief condition variable for waiting and notifying blocking pop threads
-        std::condition_variable _pop_cond;
+        Parker<WaitPolicy> _pop_cond;
 
         /// @brief push buffer data
         BufferData _push_buf;
@@ -359,7 +899,7 @@ namespace whfa::util
         /// @brief mutex for synchronizing push buffer access
         std::mutex _push_mtx;
         /// @brief condition variable for waiting and notifying blocking push threads
-        std::condition_variable _push_cond;
+        Parker<WaitPolicy> _push_cond;
     };
 
 }
\ No newline at end of file
@@ -0,0 +1,170 @@
+/**
+ * @file util/executor.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace whfa::util
+{
+
+    /**
+     * @class whfa::util::Executor
+     * @brief threadsafe fixed-size work-stealing pool of threads running recurring tasks
+     *
+     * each pool thread owns a lane of tasks it runs in order, requeueing tasks that want to run again
+     * idle pool threads steal tasks from the back of other lanes
+     * tasks reporting no available work are requeued, and pool threads park once every task they try is idle,
+     * so waiting tasks cost no dedicated threads and an idle pool does not poll
+     * parked threads wake when any task does work or is submitted, or when wake() is called
+     * tasks must not block indefinitely, the executor must outlive all tasks submitted to it
+     */
+    class Executor
+    {
+    public:
+        /// @brief max duration a pool thread backs off for, or a pooled task should wait on a queue for
+        static constexpr std::chrono::microseconds IDLE_WAIT{500};
+        /// @brief max duration a pool thread parks for, bounds latency of readiness changes not followed by wake()
+        static constexpr std::chrono::milliseconds IDLE_PARK{50};
+
+        /**
+         * @class whfa::util::Executor::Task
+         * @brief interface of a recurring task run by an executor
+         */
+        class Task
+        {
+        public:
+            /**
+             * @enum whfa::util::Executor::Task::Result
+             * @brief enum defining how an executor handles a task after running it
+             */
+            enum Result
+            {
+                /// @brief task is finished, do not requeue
+                TASK_DONE,
+                /// @brief task did work, requeue
+                TASK_AGAIN,
+                /// @brief task had no work available, requeue and allow parking
+                TASK_IDLE
+            };
+
+            /**
+             * @brief destructor
+             */
+            virtual ~Task();
+
+            /**
+             * @brief run one unit of work
+             *
+             * @return handling of task after running
+             */
+            virtual Result run() = 0;
+        };
+
+        /**
+         * @brief constructor, spawns pool threads
+         *
+         * @param nthreads number of pool threads, 0 = number of hardware threads
+         */
+        Executor(size_t nthreads = 0);
+
+        /**
+         * @brief destructor, stops and joins pool threads without running queued tasks
+         */
+        ~Executor();
+
+        /**
+         * @brief queue task to run on a pool thread
+         *
+         * a task must not be queued more than once at a time
+         *
+         * @param task task to run until it returns TASK_DONE
+         */
+        void submit(Task *task);
+
+        /**
+         * @brief wake pool threads parked on idle tasks to poll them again
+         *
+         * called automatically whenever a task does work, call when a pooled task may have become ready
+         * due to something outside the executor (e.g. a dedicated thread pushing to its queue, or a seek)
+         */
+        void wake();
+
+        /**
+         * @brief get number of pool threads
+         *
+         * @return number of pool threads
+         */
+        size_t get_num_threads() const;
+
+    protected:
+        /**
+         * @struct whfa::util::Executor::Lane
+         * @brief queue of tasks owned by one pool thread
+         */
+        struct Lane
+        {
+            /// @brief mutex synchronizing access to tasks
+            std::mutex mtx;
+            /// @brief queued tasks, owner pops front, thieves pop back
+            std::deque<Task *> tasks;
+        };
+
+        /**
+         * @brief pool thread loop
+         *
+         * @param idx index of lane owned by pool thread
+         */
+        void execute_loop(size_t idx);
+
+        /**
+         * @brief take next task from own lane or steal from another lane
+         *
+         * @param idx index of own lane
+         * @param[out] nlocal number of tasks in own lane before taking, 0 if stolen
+         * @return task, nullptr if all lanes are empty
+         */
+        Task *take(size_t idx, size_t &nlocal);
+
+        /**
+         * @brief queue task on lane and wake a waiting pool thread
+         *
+         * @param idx index of lane
+         * @param task task to queue
+         */
+        void enqueue(size_t idx, Task *task);
+
+        /// @brief lanes of each pool thread
+        std::vector<Lane> _lanes;
+        /// @brief pool threads
+        std::vector<std::thread> _threads;
+        /// @brief next lane to submit external tasks to
+        std::atomic<size_t> _next;
+        /// @brief number of queued tasks across all lanes
+        std::atomic<size_t> _ntasks;
+        /// @brief number of pool threads waiting for tasks
+        std::atomic<size_t> _nwait;
+        /// @brief number of pool threads parked on idle tasks
+        std::atomic<size_t> _npark;
+        /// @brief incremented on every wake(), parked threads wait for it to change
+        std::atomic<uint64_t> _wakes;
+        /// @brief true if pool threads should terminate
+        bool _terminate;
+        /// @brief mutex synchronizing submission, waiting, and termination
+        std::mutex _mtx;
+        /// @brief condition variable for pool thread waiting and notifying
+        std::condition_variable _cond;
+        /// @brief condition variable for pool threads parked on idle tasks
+        std::condition_variable _park_cond;
+    };
+
+}
\ No newline at end of file
@@ -0,0 +1,35 @@
+/**
+ * @file util/futex.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace whfa::util
+{
+
+    /**
+     * @brief block calling thread on futex word while it holds the expected value
+     *
+     * returns immediately if word no longer holds expected value
+     * spurious wakeups are possible, callers must recheck their own condition
+     *
+     * @param word futex word to wait on
+     * @param expected value of word that allows the calling thread to sleep
+     * @param timeout max duration to wait for, nullptr = wait indefinitely
+     * @return false if timeout reached, true otherwise
+     */
+    bool futex_wait(std::atomic<uint32_t> &word, uint32_t expected,
+                    const std::chrono::nanoseconds *timeout = nullptr);
+
+    /**
+     * @brief wake all threads blocked on futex word
+     *
+     * @param word futex word to wake waiters of
+     */
+    void futex_wake(std::atomic<uint32_t> &word);
+
+}
\ No newline at end of file
@@ -0,0 +1,101 @@
+/**
+ * @file util/loopstats.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * loop timing instrumentation is compiled in unless built with -DWHFA_LOOP_STATS=0,
+ * in which case timing calls compile to nothing and all stats read as 0
+ */
+#ifndef WHFA_LOOP_STATS
+#define WHFA_LOOP_STATS 1
+#endif
+
+namespace whfa::util
+{
+
+    /// @brief true if loop timing instrumentation is compiled in
+    constexpr bool LOOP_STATS_ENABLED = WHFA_LOOP_STATS != 0;
+
+    /**
+     * @struct whfa::util::LoopStats
+     * @brief snapshot of worker loop iteration counters and timing histograms
+     *
+     * counters are cumulative since threader construction
+     * histogram bucket i counts iterations whose duration d in nanoseconds satisfies
+     * 2^i <= d < 2^(i+1) (bucket 0 also counts d = 0, last bucket also counts longer durations)
+     */
+    struct LoopStats
+    {
+        /// @brief number of histogram buckets (last bucket starts at ~1.07s)
+        static constexpr size_t NBUCKETS = 31;
+
+        /// @brief number of loop body iterations run
+        uint64_t iterations;
+        /// @brief total time loop bodies spent working (not blocked on queues) in nanoseconds
+        uint64_t busy_ns;
+        /// @brief total time loop bodies spent blocked on queues in nanoseconds
+        uint64_t wait_ns;
+        /// @brief histogram of busy time per iteration
+        uint64_t busy_hist[NBUCKETS];
+        /// @brief histogram of wait time per iteration
+        uint64_t wait_hist[NBUCKETS];
+    };
+
+    /**
+     * @class whfa::util::LoopCounters
+     * @brief lock-free counters backing LoopStats, updated with relaxed atomics
+     *
+     * only the loop thread counts, snapshots never block it
+     * snapshots are not atomic as a whole, so totals may lag histograms by an iteration
+     */
+    class LoopCounters
+    {
+    public:
+        /**
+         * @brief constructor, zeroes all counters
+         */
+        LoopCounters();
+
+        /**
+         * @brief count one loop body iteration
+         *
+         * @param busy_ns time spent working in nanoseconds
+         * @param wait_ns time spent blocked in nanoseconds
+         */
+        void count_iteration(uint64_t busy_ns, uint64_t wait_ns);
+
+        /**
+         * @brief copy counters into snapshot
+         *
+         * @param[out] stats snapshot to populate
+         */
+        void get_stats(LoopStats &stats) const;
+
+        /**
+         * @brief get histogram bucket of a duration
+         *
+         * @param ns duration in nanoseconds
+         * @return bucket index, floor(log2(ns)) clamped to [0, NBUCKETS)
+         */
+        static size_t bucket(uint64_t ns);
+
+    protected:
+        /// @brief number of loop body iterations run
+        std::atomic<uint64_t> _iterations;
+        /// @brief total busy time in nanoseconds
+        std::atomic<uint64_t> _busy_ns;
+        /// @brief total wait time in nanoseconds
+        std::atomic<uint64_t> _wait_ns;
+        /// @brief histogram of busy time per iteration
+        std::atomic<uint64_t> _busy_hist[LoopStats::NBUCKETS];
+        /// @brief histogram of wait time per iteration
+        std::atomic<uint64_t> _wait_hist[LoopStats::NBUCKETS];
+    };
+
+}
\ No newline at end of file
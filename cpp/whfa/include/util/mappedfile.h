@@ -0,0 +1,118 @@
+/**
+ * @file util/mappedfile.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include "util/bytesource.h"
+
+#include <mutex>
+
+namespace whfa::util
+{
+
+    /**
+     * @class whfa::util::MappedFile
+     * @brief threadsafe memory-mapped local file, read without copying through a stdio or libav protocol buffer
+     *
+     * to be used as source of custom allocated AVIOContext (pcm::Context::open(ByteSource &))
+     * mapping is advised sequential, and the window ahead of the read position is advised needed,
+     * so the page cache reads ahead (e.g. over a network mount) while earlier blocks are decoded
+     * seeks advise the window at the new position, random access is served from the same mapping
+     * the file must not be truncated while mapped (reading truncated pages raises SIGBUS)
+     */
+    class MappedFile : public ByteSource
+    {
+    public:
+        /// @brief default size of window advised ahead of read position in bytes
+        static constexpr uint64_t DEF_READAHEAD = 1024 * 1024;
+
+        /**
+         * @brief constructor
+         *
+         * @param readahead size of window advised ahead of read position in bytes
+         */
+        MappedFile(uint64_t readahead = DEF_READAHEAD);
+
+        /**
+         * @brief destructor
+         */
+        virtual ~MappedFile();
+
+        /**
+         * @brief map file, closing any previously mapped file
+         *
+         * @param path path of local file to map
+         * @return true if successful, check errno if false
+         */
+        bool open(const char *path);
+
+        /**
+         * @brief unmap file
+         */
+        void close();
+
+        /**
+         * @brief check if file is mapped
+         *
+         * @return true if mapped (empty files are never mapped)
+         */
+        bool is_open();
+
+        /**
+         * @brief copy bytes from current read position into buffer
+         *
+         * can block on page faults if advised window has not been read ahead yet
+         *
+         * @param[out] buf byte buffer to populate
+         * @param size number of bytes to read at most
+         * @return number of bytes read, 0 if end of file (or not open)
+         */
+        uint64_t read(uint8_t *buf, uint64_t size) override;
+
+        /**
+         * @brief fseek equivalent, advising window at new position
+         *
+         * @param offset byte offset to move read position to
+         * @param whence position from which offset is applied (SEEK_SET, SEEK_CUR, or SEEK_END)
+         * @return true if successful, false if not open or new position is outside of file
+         */
+        bool seek(int64_t offset, int whence) override;
+
+        /**
+         * @brief get current read position
+         *
+         * @return byte offset of read position
+         */
+        uint64_t get_position() override;
+
+        /**
+         * @brief get file size
+         *
+         * @return file size in bytes, 0 if not open
+         */
+        uint64_t get_filesize() override;
+
+    protected:
+        /**
+         * @brief advise window at read position needed if it is not already advised, _mtx must be held
+         */
+        void advise();
+
+        /// @brief size of window advised ahead of read position in bytes
+        const uint64_t _readahead;
+        /// @brief mapped file bytes (nullptr if not open)
+        uint8_t *_data;
+        /// @brief file size
+        uint64_t _filesz;
+        /// @brief current file read byte position
+        uint64_t _read_pos;
+        /// @brief start of advised window
+        uint64_t _adv_begin;
+        /// @brief end of advised window
+        uint64_t _adv_end;
+        /// @brief mutex synchronizing mapping and reading
+        std::mutex _mtx;
+    };
+
+}
\ No newline at end of file
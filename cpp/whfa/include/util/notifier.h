@@ -0,0 +1,158 @@
+/**
+ * @file util/notifier.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include "util/threader.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+
+namespace whfa::util
+{
+
+    /**
+     * @class whfa::util::Notifier
+     * @brief threadsafe dispatcher invoking threader state handlers on its own thread
+     *
+     * worker threads post state changes to a bounded lock-free queue and return immediately,
+     * so slow handlers (logging, closing contexts) never add latency to worker loops
+     * events are handled in the order they were posted
+     * timestamp-only updates are coalesced, at most one per threader is queued at a time
+     * and the latest timestamp is read when it is handled
+     */
+    class Notifier
+    {
+    public:
+        /// @brief default max number of queued events
+        static constexpr size_t DEF_CAPACITY = 1024;
+
+        /**
+         * @brief constructor, spawns notifier thread
+         *
+         * @param capacity max number of queued events (rounded up to power of two)
+         */
+        Notifier(size_t capacity = DEF_CAPACITY);
+
+        /**
+         * @brief destructor, handles remaining events and joins notifier thread
+         *
+         * all threaders using this notifier must be destroyed first
+         */
+        ~Notifier();
+
+        /**
+         * @brief queue state change to be handled
+         *
+         * lock-free, only waits if queue is full
+         *
+         * @param handler handler to invoke
+         * @param state state to handle
+         */
+        void post(Threader::StateHandler *handler, const Threader::State &state);
+
+        /**
+         * @brief queue coalesced timestamp update to be handled
+         *
+         * lock-free, dropped if queue is full (pending is cleared so a later update is posted)
+         * caller should only post when exchanging pending from false to true
+         *
+         * @param threader threader to read latest state of when handled
+         * @param handler handler to invoke
+         * @param pending flag cleared immediately before reading latest state
+         */
+        void post_timestamp(const Threader *threader, Threader::StateHandler *handler,
+                            std::atomic<bool> *pending);
+
+        /**
+         * @brief wait until all events posted before calling have been handled
+         *
+         * returns immediately if called from notifier thread (e.g. by a handler)
+         */
+        void drain();
+
+    protected:
+        /**
+         * @struct whfa::util::Notifier::Event
+         * @brief queued state change or coalesced timestamp update
+         */
+        struct Event
+        {
+            /// @brief handler to invoke
+            Threader::StateHandler *handler;
+            /// @brief state to handle (state changes only)
+            Threader::State state;
+            /// @brief threader to read latest state of (timestamp updates only)
+            const Threader *threader;
+            /// @brief pending flag of timestamp update, nullptr for state changes
+            std::atomic<bool> *pending;
+        };
+
+        /**
+         * @struct whfa::util::Notifier::Cell
+         * @brief slot of event ring, sequence number marks whether it is full or empty for a lap
+         */
+        struct Cell
+        {
+            /// @brief sequence number, index when empty, index + 1 when full (per lap)
+            std::atomic<size_t> seq;
+            /// @brief queued event
+            Event event;
+        };
+
+        /**
+         * @brief lock-free multi-producer enqueue
+         *
+         * @param event event to copy to queue
+         * @return false if queue is full
+         */
+        bool try_push(const Event &event);
+
+        /**
+         * @brief single consumer dequeue
+         *
+         * @param[out] event event copied from queue
+         * @return false if queue is empty (or front event is still being written)
+         */
+        bool try_pop(Event &event);
+
+        /**
+         * @brief wake notifier thread if waiting
+         */
+        void wake();
+
+        /**
+         * @brief notifier thread loop handling events until terminated and empty
+         */
+        void execute_loop();
+
+        /// @brief number of cells in event ring (power of two)
+        const size_t _capacity;
+        /// @brief mask for wrapping indices into event ring
+        const size_t _mask;
+        /// @brief event ring
+        Cell *_cells;
+
+        /// @brief index of next cell to post to
+        alignas(64) std::atomic<size_t> _enq;
+        /// @brief index of next cell to handle
+        alignas(64) std::atomic<size_t> _deq;
+
+        /// @brief futex word incremented on every post, drain, and termination
+        std::atomic<uint32_t> _signal;
+        /// @brief true while notifier thread may be waiting on _signal
+        std::atomic<bool> _waiting;
+        /// @brief futex word incremented after each batch of handled events
+        std::atomic<uint32_t> _handled;
+        /// @brief number of threads draining
+        std::atomic<size_t> _ndrain;
+        /// @brief true if notifier thread should terminate once empty
+        std::atomic<bool> _terminate;
+        /// @brief the notifier thread
+        std::thread _thread;
+    };
+
+}
\ No newline at end of file
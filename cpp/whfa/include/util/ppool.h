@@ -0,0 +1,259 @@
+/**
+ * @file util/ppool.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+namespace whfa::util
+{
+
+    /**
+     * @class whfa::util::PPool<T>
+     * @brief threadsafe lock-free bounded pool of reusable heap allocated objects
+     *
+     * only stores pointers T*
+     * acquiring takes a pooled object, allocating only when the pool is empty
+     * releasing resets the object and returns it to the pool, freeing only when the pool is full
+     * any number of threads may acquire and release concurrently without locking
+     * capacity is rounded up to the nearest power of two
+     */
+    template <typename T>
+    class PPool
+    {
+    public:
+        /// @brief callback type to allocate a new object (stateless)
+        using AllocCallback = T *(*)();
+        /// @brief callback type to reset an object before pooling it (stateless, e.g. unref)
+        using ResetCallback = void (*)(T *);
+        /// @brief callback type to free an object that does not fit in the pool (stateless)
+        using FreeCallback = void (*)(T *);
+
+        /// @brief assumed cache line size in bytes used to pad acquiring and releasing indices
+        static constexpr size_t CACHELINE_SZ = 64;
+
+        /**
+         * @brief constructor
+         *
+         * @param capacity the minimum number of pooled objects (rounded up to power of two)
+         * @param alloc callback to allocate objects when pool is empty
+         * @param reset callback to reset released objects, nullptr = none
+         * @param free callback to free objects when pool is full or destroyed
+         */
+        PPool(size_t capacity, AllocCallback alloc, ResetCallback reset, FreeCallback free)
+            : _capacity(round_capacity(capacity)),
+              _mask(_capacity - 1),
+              _alloc(alloc),
+              _reset(reset),
+              _free(free),
+              _cells(new Cell[_capacity]),
+              _allocs(0),
+              _put(0),
+              _get(0)
+        {
+            for (size_t i = 0; i < _capacity; ++i)
+            {
+                _cells[i].seq.store(i, std::memory_order_relaxed);
+                _cells[i].ptr = nullptr;
+            }
+        }
+
+        /**
+         * @brief destructor, frees all pooled objects
+         *
+         * no thread may be acquiring or releasing
+         */
+        ~PPool()
+        {
+            T *ptr;
+            while ((ptr = try_get()) != nullptr)
+            {
+                _free(ptr);
+            }
+            delete[] _cells;
+        }
+
+        /**
+         * @brief take pooled object or allocate new object if pool is empty
+         *
+         * @return object, nullptr if allocation failed
+         */
+        T *acquire()
+        {
+            T *ptr = try_get();
+            if (ptr == nullptr)
+            {
+                _allocs.fetch_add(1, std::memory_order_relaxed);
+                ptr = _alloc();
+            }
+            return ptr;
+        }
+
+        /**
+         * @brief reset object and return to pool, freeing if pool is full
+         *
+         * @param ptr object to release, ignored if nullptr
+         */
+        void release(T *ptr)
+        {
+            if (ptr == nullptr)
+            {
+                return;
+            }
+            if (_reset != nullptr)
+            {
+                _reset(ptr);
+            }
+            if (!try_put(ptr))
+            {
+                _free(ptr);
+            }
+        }
+
+        /**
+         * @brief get capacity of pool
+         *
+         * @return max number of pooled objects
+         */
+        size_t get_capacity() const
+        {
+            return _capacity;
+        }
+
+        /**
+         * @brief get number of objects allocated because the pool was empty
+         *
+         * does not change once the pool has warmed up to steady state usage
+         *
+         * @return number of allocations since construction
+         */
+        uint64_t get_allocs() const
+        {
+            return _allocs.load(std::memory_order_relaxed);
+        }
+
+    protected:
+        /**
+         * @struct whfa::util::PPool<T>::Cell
+         * @brief slot of pool ring, sequence number marks whether it is full or empty for a lap
+         */
+        struct Cell
+        {
+            /// @brief sequence number, index when empty, index + 1 when full (per lap)
+            std::atomic<size_t> seq;
+            /// @brief pooled object
+            T *ptr;
+        };
+
+        /**
+         * @brief round capacity up to nearest power of two
+         *
+         * @param capacity minimum capacity
+         * @return power of two capacity
+         */
+        static size_t round_capacity(size_t capacity)
+        {
+            size_t c = 1;
+            while (c < capacity)
+            {
+                c <<= 1;
+            }
+            return c;
+        }
+
+        /**
+         * @brief lock-free return of object to pool ring
+         *
+         * @param ptr object to pool
+         * @return false if pool is full
+         */
+        bool try_put(T *ptr)
+        {
+            size_t pos = _put.load(std::memory_order_relaxed);
+            Cell *cell;
+            while (true)
+            {
+                cell = &(_cells[pos & _mask]);
+                const size_t seq = cell->seq.load(std::memory_order_acquire);
+                const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+                if (dif == 0)
+                {
+                    if (_put.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (dif < 0)
+                {
+                    return false;
+                }
+                else
+                {
+                    pos = _put.load(std::memory_order_relaxed);
+                }
+            }
+            cell->ptr = ptr;
+            cell->seq.store(pos + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * @brief lock-free take of object from pool ring
+         *
+         * @return pooled object, nullptr if pool is empty
+         */
+        T *try_get()
+        {
+            size_t pos = _get.load(std::memory_order_relaxed);
+            Cell *cell;
+            while (true)
+            {
+                cell = &(_cells[pos & _mask]);
+                const size_t seq = cell->seq.load(std::memory_order_acquire);
+                const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+                if (dif == 0)
+                {
+                    if (_get.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    {
+                        break;
+                    }
+                }
+                else if (dif < 0)
+                {
+                    return nullptr;
+                }
+                else
+                {
+                    pos = _get.load(std::memory_order_relaxed);
+                }
+            }
+            T *ptr = cell->ptr;
+            cell->seq.store(pos + _mask + 1, std::memory_order_release);
+            return ptr;
+        }
+
+        /// @brief number of cells in pool ring (power of two)
+        const size_t _capacity;
+        /// @brief mask for wrapping indices into pool ring
+        const size_t _mask;
+        /// @brief allocation callback
+        AllocCallback _alloc;
+        /// @brief reset callback (nullptr if none)
+        ResetCallback _reset;
+        /// @brief free callback
+        FreeCallback _free;
+        /// @brief pool ring
+        Cell *_cells;
+        /// @brief number of allocations due to empty pool
+        std::atomic<uint64_t> _allocs;
+
+        /// @brief index of next cell to return object to
+        alignas(CACHELINE_SZ) std::atomic<size_t> _put;
+        /// @brief index of next cell to take object from
+        alignas(CACHELINE_SZ) std::atomic<size_t> _get;
+    };
+
+}
\ No newline at end of file
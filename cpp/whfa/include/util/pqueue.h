@@ -0,0 +1,278 @@
+/**
+ * @file util/pqueue.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include "util/queuestats.h"
+
+#include <chrono>
+#include <cstddef>
+#include <functional>
+
+namespace whfa::util
+{
+
+    /**
+     * @class whfa::util::PQueue<T>
+     * @brief abstract interface for a threadsafe blocking pointer queue of fixed capacity
+     *
+     * only stores pointers T*
+     * popping blocks when queue is empty
+     * pushing blocks when queue is full
+     * flushing wakes all waiting threads, causing their push and pop calls to return false
+     * implementations may also bound the total weight of queued elements (e.g. bytes or duration)
+     */
+    template <typename T>
+    class PQueue
+    {
+    public:
+        /// @brief callback type to be invoked when flushing (mostly for destruction or recycling)
+        using FlushCallback = std::function<void(T *)>;
+        /// @brief callback type to weigh elements against a weight limit (stateless, must accept nullptr)
+        using WeightCallback = size_t (*)(const T *);
+
+        /**
+         * @brief destructor
+         */
+        virtual ~PQueue()
+        {
+        }
+
+        /**
+         * @brief clear queue and handle invoked on each popped element
+         *
+         * notify all waiting threads
+         * waiting push and pop calls will return false
+         *
+         * @param callback function to invoked on popped pointers, nullptr = use default
+         */
+        virtual void flush(FlushCallback callback = nullptr) = 0;
+
+        /**
+         * @brief invalidate all queued elements without waking waiting threads
+         *
+         * elements pushed before calling are discarded (lazily by poppers, or immediately) with the default flush callback
+         * implementations that cannot tag elements with an epoch flush instead
+         */
+        virtual void advance_epoch()
+        {
+            flush();
+        }
+
+        /**
+         * @brief remove and retrieve first element in queue
+         *
+         * @param[out] ptr pointer moved from front of queue
+         * @return true if successful, false if flushing or flushed while waiting
+         */
+        virtual bool pop(T *&ptr) = 0;
+
+        /**
+         * @brief remove and retrieve first element in queue within a timeout period
+         *
+         * @param[out] ptr pointer moved from front of queue
+         * @param timeout max duration to wait for
+         * @return true if successful, false if flushed or timeout reached
+         */
+        template <typename Rep, typename Period>
+        bool pop(T *&ptr, const std::chrono::duration<Rep, Period> &timeout)
+        {
+            return pop_for(ptr, std::chrono::duration_cast<std::chrono::nanoseconds>(timeout));
+        }
+
+        /**
+         * @brief remove and retrieve all available elements up to a max count
+         *
+         * blocks only while queue is empty
+         *
+         * @param[out] out array of at least max pointers to populate from front of queue
+         * @param max max number of elements to pop
+         * @return number of elements popped, 0 if flushing or flushed while waiting
+         */
+        virtual size_t pop_n(T **out, size_t max) = 0;
+
+        /**
+         * @brief remove and retrieve all available elements up to a max count within a timeout period
+         *
+         * @param[out] out array of at least max pointers to populate from front of queue
+         * @param max max number of elements to pop
+         * @param timeout max duration to wait for
+         * @return number of elements popped, 0 if flushed or timeout reached
+         */
+        template <typename Rep, typename Period>
+        size_t pop_n(T **out, size_t max, const std::chrono::duration<Rep, Period> &timeout)
+        {
+            return pop_n_for(out, max, std::chrono::duration_cast<std::chrono::nanoseconds>(timeout));
+        }
+
+        /**
+         * @brief insert element into back of queue
+         *
+         * @param ptr pointer to copy to queue
+         * @return true if successful, false if flushing or flushed while waiting
+         */
+        virtual bool push(T *ptr) = 0;
+
+        /**
+         * @brief insert element into back of queue within a timeout period
+         *
+         * @param ptr pointer to copy to queue
+         * @param timeout max duration to wait for
+         * @return true if successful, false if flushed or timeout reached
+         */
+        template <typename Rep, typename Period>
+        bool push(T *ptr, const std::chrono::duration<Rep, Period> &timeout)
+        {
+            return push_for(ptr, std::chrono::duration_cast<std::chrono::nanoseconds>(timeout));
+        }
+
+        /**
+         * @brief insert multiple elements into back of queue
+         *
+         * blocks while queue is full until all elements are pushed
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n number of elements to push
+         * @return number of elements pushed, less than n if flushing or flushed while waiting
+         */
+        virtual size_t push_n(T *const *in, size_t n) = 0;
+
+        /**
+         * @brief insert multiple elements into back of queue within a timeout period
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n number of elements to push
+         * @param timeout max duration to wait for
+         * @return number of elements pushed, less than n if flushed or timeout reached
+         */
+        template <typename Rep, typename Period>
+        size_t push_n(T *const *in, size_t n, const std::chrono::duration<Rep, Period> &timeout)
+        {
+            return push_n_for(in, n, std::chrono::duration_cast<std::chrono::nanoseconds>(timeout));
+        }
+
+        /**
+         * @brief get capacity of queue
+         *
+         * @return capacity of queue
+         */
+        virtual size_t get_capacity() const = 0;
+
+        /**
+         * @brief get number of items in queue
+         *
+         * @return number of items in queue
+         */
+        virtual size_t get_size() = 0;
+
+        /**
+         * @brief get max total weight of queued elements
+         *
+         * @return weight limit, 0 if unweighted
+         */
+        virtual size_t get_limit() const = 0;
+
+        /**
+         * @brief get total weight of queued elements
+         *
+         * @return total weight, 0 if unweighted
+         */
+        virtual size_t get_weight() = 0;
+
+        /**
+         * @brief weigh element as counted against weight limit
+         *
+         * @param ptr element to weigh
+         * @return weight of element, 0 if unweighted
+         */
+        virtual size_t weigh(const T *ptr) const
+        {
+            (void)ptr;
+            return 0;
+        }
+
+        /**
+         * @brief check if an element can be pushed without blocking
+         *
+         * does not lock, may lag behind concurrent pushes and pops (room only grows for a sole pusher)
+         * weighted queues admit an element if it fits under the weight limit, or if they hold no weight
+         *
+         * @param weight weight of element (weigh()), 0 = unknown, only check queue is below its weight limit
+         * @return true if element can be pushed without blocking
+         */
+        bool has_room(size_t weight = 0)
+        {
+            if (get_size() >= get_capacity())
+            {
+                return false;
+            }
+            const size_t limit = get_limit();
+            if (limit == 0)
+            {
+                return true;
+            }
+            const size_t cur = get_weight();
+            return cur == 0 || ((weight == 0) ? cur < limit : cur + weight <= limit);
+        }
+
+        /**
+         * @brief get snapshot of queue counters without blocking pushing or popping threads
+         *
+         * @param[out] stats counters, current size, and current weight
+         */
+        void get_stats(QueueStats &stats)
+        {
+            _counters.get_stats(stats);
+            stats.size = get_size();
+            stats.weight = get_weight();
+        }
+
+    protected:
+        /**
+         * @brief implementation of timed pop()
+         * @see PQueue::pop()
+         *
+         * @param[out] ptr pointer moved from front of queue
+         * @param timeout max duration to wait for
+         * @return true if successful, false if flushed or timeout reached
+         */
+        virtual bool pop_for(T *&ptr, const std::chrono::nanoseconds &timeout) = 0;
+
+        /**
+         * @brief implementation of timed pop_n()
+         * @see PQueue::pop_n()
+         *
+         * @param[out] out array of at least max pointers to populate from front of queue
+         * @param max max number of elements to pop
+         * @param timeout max duration to wait for
+         * @return number of elements popped, 0 if flushed or timeout reached
+         */
+        virtual size_t pop_n_for(T **out, size_t max, const std::chrono::nanoseconds &timeout) = 0;
+
+        /**
+         * @brief implementation of timed push()
+         * @see PQueue::push()
+         *
+         * @param ptr pointer to copy to queue
+         * @param timeout max duration to wait for
+         * @return true if successful, false if flushed or timeout reached
+         */
+        virtual bool push_for(T *ptr, const std::chrono::nanoseconds &timeout) = 0;
+
+        /**
+         * @brief implementation of timed push_n()
+         * @see PQueue::push_n()
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n number of elements to push
+         * @param timeout max duration to wait for
+         * @return number of elements pushed, less than n if flushed or timeout reached
+         */
+        virtual size_t push_n_for(T *const *in, size_t n, const std::chrono::nanoseconds &timeout) = 0;
+
+        /// @brief occupancy and wait time counters, updated by implementations
+        QueueCounters _counters;
+    };
+
+}
\ No newline at end of file
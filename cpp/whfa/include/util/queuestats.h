@@ -0,0 +1,126 @@
+/**
+ * @file util/queuestats.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace whfa::util
+{
+
+    /**
+     * @struct whfa::util::QueueStats
+     * @brief snapshot of queue occupancy and wait time counters
+     *
+     * counters are cumulative since queue construction
+     */
+    struct QueueStats
+    {
+        /// @brief number of elements pushed
+        uint64_t pushes;
+        /// @brief number of elements popped (excluding flushed elements)
+        uint64_t pops;
+        /// @brief number of elements discarded by flushing
+        uint64_t flushed;
+        /// @brief total time pushing threads spent blocked in nanoseconds
+        uint64_t push_wait_ns;
+        /// @brief total time popping threads spent blocked in nanoseconds
+        uint64_t pop_wait_ns;
+        /// @brief max number of elements queued at once
+        uint64_t high_water;
+        /// @brief number of underlying buffer swaps (0 for implementations without swaps)
+        uint64_t swaps;
+        /// @brief number of elements queued at time of snapshot
+        uint64_t size;
+        /// @brief total weight of elements queued at time of snapshot
+        uint64_t weight;
+    };
+
+    /**
+     * @class whfa::util::QueueCounters
+     * @brief lock-free counters backing QueueStats, updated with relaxed atomics
+     *
+     * push side and pop side counters reside on separate cache lines so producers
+     * and consumers do not contend, snapshots never block either side
+     */
+    class QueueCounters
+    {
+    public:
+        /// @brief assumed cache line size in bytes used to separate push and pop counters
+        static constexpr size_t CACHELINE_SZ = 64;
+
+        /**
+         * @brief constructor, zeroes all counters
+         */
+        QueueCounters();
+
+        /**
+         * @brief count pushed elements and update high water mark
+         *
+         * @param n number of elements pushed
+         * @param size number of elements queued after pushing
+         */
+        void count_push(uint64_t n, uint64_t size);
+
+        /**
+         * @brief count popped elements
+         *
+         * @param n number of elements popped
+         */
+        void count_pop(uint64_t n);
+
+        /**
+         * @brief count flushed elements
+         *
+         * @param n number of elements discarded
+         */
+        void count_flush(uint64_t n);
+
+        /**
+         * @brief count an underlying buffer swap
+         */
+        void count_swap();
+
+        /**
+         * @brief accumulate time a pushing thread spent blocked
+         *
+         * @param start time blocking began
+         */
+        void count_push_wait(const std::chrono::steady_clock::time_point &start);
+
+        /**
+         * @brief accumulate time a popping thread spent blocked
+         *
+         * @param start time blocking began
+         */
+        void count_pop_wait(const std::chrono::steady_clock::time_point &start);
+
+        /**
+         * @brief copy counters into snapshot (size and weight left untouched)
+         *
+         * @param[out] stats snapshot to populate
+         */
+        void get_stats(QueueStats &stats) const;
+
+    protected:
+        /// @brief number of elements pushed
+        alignas(CACHELINE_SZ) std::atomic<uint64_t> _pushes;
+        /// @brief total time pushing threads spent blocked in nanoseconds
+        std::atomic<uint64_t> _push_wait_ns;
+        /// @brief max number of elements queued at once
+        std::atomic<uint64_t> _high_water;
+
+        /// @brief number of elements popped
+        alignas(CACHELINE_SZ) std::atomic<uint64_t> _pops;
+        /// @brief total time popping threads spent blocked in nanoseconds
+        std::atomic<uint64_t> _pop_wait_ns;
+        /// @brief number of underlying buffer swaps
+        std::atomic<uint64_t> _swaps;
+        /// @brief number of elements discarded by flushing
+        std::atomic<uint64_t> _flushed;
+    };
+
+}
\ No newline at end of file
@@ -0,0 +1,568 @@
+/**
+ * @file util/spscpqueue.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include "util/futex.h"
+#include "util/pqueue.h"
+
+#include <algorithm>
+#include <atomic>
+
+namespace whfa::util
+{
+
+    /**
+     * @class whfa::util::SPSCPQueue<T>
+     * @brief single-producer single-consumer lock-free pointer ring queue of fixed capacity
+     *
+     * only stores pointers T*
+     * at most one thread may push and one other thread may pop concurrently
+     * flushing is allowed from any thread at any time
+     * pushing and popping never lock, threads only park on a futex when full or empty
+     * capacity is rounded up to the nearest power of two
+     * optionally bounded by total weight of queued elements (e.g. bytes)
+     */
+    template <typename T>
+    class SPSCPQueue : public PQueue<T>
+    {
+    public:
+        /// @brief callback type to be invoked when flushing (mostly for destruction or recycling)
+        using FlushCallback = typename PQueue<T>::FlushCallback;
+        /// @brief callback type to weigh elements against weight limit (stateless)
+        using WeightCallback = typename PQueue<T>::WeightCallback;
+
+        using PQueue<T>::pop;
+        using PQueue<T>::push;
+        using PQueue<T>::pop_n;
+        using PQueue<T>::push_n;
+
+        /// @brief assumed cache line size in bytes used to pad producer and consumer indices
+        static constexpr size_t CACHELINE_SZ = 64;
+
+        /**
+         * @brief constructor
+         *
+         * when weighted, pushing also blocks while total queued weight would exceed the limit
+         * an element heavier than the limit is still accepted by an empty queue
+         *
+         * @param capacity the minimum capacity (rounded up to power of two)
+         * @param callback default callback to invoke when flushing
+         * @param limit max total weight of queued elements (ignored if weight is nullptr)
+         * @param weight callback to weigh elements, nullptr = unweighted
+         */
+        SPSCPQueue(size_t capacity, FlushCallback callback = nullptr,
+                   size_t limit = 0, WeightCallback weight = nullptr)
+            : _capacity(round_capacity(capacity)),
+              _mask(_capacity - 1),
+              _callback(callback),
+              _limit(limit),
+              _weigher(weight),
+              _buf(new std::atomic<T *>[_capacity]),
+              _weight(0),
+              _head(0),
+              _tail_cache(0),
+              _push_flush(false),
+              _push_wait(false),
+              _push_seq(0),
+              _tail(0),
+              _head_cache(0),
+              _pop_flush(false),
+              _pop_wait(false),
+              _pop_seq(0)
+        {
+        }
+
+        /**
+         * @brief destructor
+         */
+        ~SPSCPQueue() override
+        {
+            flush();
+            delete[] _buf;
+        }
+
+        /**
+         * @brief clear queue and handle invoked on each popped element
+         *
+         * notify all waiting threads
+         * waiting push and pop calls will return false
+         * callback primarily required for proper destruction and freeing of heap memory
+         * ideally only need to use default callback specified during construction
+         *
+         * @param callback function to invoked on popped pointers, nullptr = use default
+         */
+        void flush(FlushCallback callback = nullptr) override
+        {
+            FlushCallback cb = (callback == nullptr) ? _callback : callback;
+            _pop_flush.store(true, std::memory_order_seq_cst);
+            _push_flush.store(true, std::memory_order_seq_cst);
+            T *ptr = nullptr;
+            size_t head = 0;
+            while (try_pop_n(&ptr, 1, head) != 0)
+            {
+                this->_counters.count_flush(1);
+                if (cb != nullptr)
+                {
+                    cb(ptr);
+                }
+            }
+            wake(_pop_seq);
+            wake(_push_seq);
+        }
+
+        /**
+         * @brief remove and retrieve first element in queue
+         *
+         * @param[out] ptr pointer moved from front of queue
+         * @return true if successful, false if flushing or flushed while waiting
+         */
+        bool pop(T *&ptr) override
+        {
+            return pop_wait(&ptr, 1, nullptr) == 1;
+        }
+
+        /**
+         * @brief remove and retrieve all available elements up to a max count
+         *
+         * blocks only while queue is empty
+         *
+         * @param[out] out array of at least max pointers to populate from front of queue
+         * @param max max number of elements to pop
+         * @return number of elements popped, 0 if flushing or flushed while waiting
+         */
+        size_t pop_n(T **out, size_t max) override
+        {
+            return pop_wait(out, max, nullptr);
+        }
+
+        /**
+         * @brief insert element into back of queue
+         *
+         * @param ptr pointer to copy to queue
+         * @return true if successful, false if flushing or flushed while waiting
+         */
+        bool push(T *ptr) override
+        {
+            return push_wait(&ptr, 1, nullptr) == 1;
+        }
+
+        /**
+         * @brief insert multiple elements into back of queue
+         *
+         * blocks while queue is full until all elements are pushed
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n number of elements to push
+         * @return number of elements pushed, less than n if flushing or flushed while waiting
+         */
+        size_t push_n(T *const *in, size_t n) override
+        {
+            return push_wait(in, n, nullptr);
+        }
+
+        /**
+         * @brief get capacity of queue (power of two)
+         *
+         * @return capacity of queue
+         */
+        size_t get_capacity() const override
+        {
+            return _capacity;
+        }
+
+        /**
+         * @brief get number of items in queue
+         *
+         * @return number of items in queue
+         */
+        size_t get_size() override
+        {
+            const size_t t = _tail.load(std::memory_order_acquire);
+            return _head.load(std::memory_order_acquire) - t;
+        }
+
+        /**
+         * @brief get max total weight of queued elements specified from constructor
+         *
+         * @return weight limit, 0 if unweighted
+         */
+        size_t get_limit() const override
+        {
+            return (_weigher == nullptr) ? 0 : _limit;
+        }
+
+        /**
+         * @brief get total weight of queued elements
+         *
+         * @return total weight, 0 if unweighted
+         */
+        size_t get_weight() override
+        {
+            return _weight.load(std::memory_order_relaxed);
+        }
+
+        /**
+         * @brief weigh element using weight callback
+         *
+         * @param ptr element to weigh
+         * @return weight of element, 0 if unweighted
+         */
+        size_t weigh(const T *ptr) const override
+        {
+            return (_weigher == nullptr) ? 0 : _weigher(ptr);
+        }
+
+    protected:
+        /**
+         * @brief implementation of timed pop()
+         * @see PQueue::pop()
+         *
+         * @param[out] ptr pointer moved from front of queue
+         * @param timeout max duration to wait for
+         * @return true if successful, false if flushed or timeout reached
+         */
+        bool pop_for(T *&ptr, const std::chrono::nanoseconds &timeout) override
+        {
+            return pop_wait(&ptr, 1, &timeout) == 1;
+        }
+
+        /**
+         * @brief implementation of timed pop_n()
+         * @see PQueue::pop_n()
+         *
+         * @param[out] out array of at least max pointers to populate from front of queue
+         * @param max max number of elements to pop
+         * @param timeout max duration to wait for
+         * @return number of elements popped, 0 if flushed or timeout reached
+         */
+        size_t pop_n_for(T **out, size_t max, const std::chrono::nanoseconds &timeout) override
+        {
+            return pop_wait(out, max, &timeout);
+        }
+
+        /**
+         * @brief implementation of timed push()
+         * @see PQueue::push()
+         *
+         * @param ptr pointer to copy to queue
+         * @param timeout max duration to wait for
+         * @return true if successful, false if flushed or timeout reached
+         */
+        bool push_for(T *ptr, const std::chrono::nanoseconds &timeout) override
+        {
+            return push_wait(&ptr, 1, &timeout) == 1;
+        }
+
+        /**
+         * @brief implementation of timed push_n()
+         * @see PQueue::push_n()
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n number of elements to push
+         * @param timeout max duration to wait for
+         * @return number of elements pushed, less than n if flushed or timeout reached
+         */
+        size_t push_n_for(T *const *in, size_t n, const std::chrono::nanoseconds &timeout) override
+        {
+            return push_wait(in, n, &timeout);
+        }
+
+        /**
+         * @brief round capacity up to nearest power of two (minimum of 1)
+         *
+         * @param capacity requested capacity
+         * @return power of two capacity
+         */
+        static size_t round_capacity(size_t capacity)
+        {
+            size_t c = 1;
+            while (c < capacity)
+            {
+                c <<= 1;
+            }
+            return c;
+        }
+
+        /**
+         * @brief increment futex word and wake all threads parked on it
+         *
+         * @param seq futex sequence word to wake
+         */
+        static void wake(std::atomic<uint32_t> &seq)
+        {
+            seq.fetch_add(1, std::memory_order_seq_cst);
+            futex_wake(seq);
+        }
+
+        /**
+         * @brief non-blocking pop of up to max elements, safe against a concurrent pop from a flushing thread
+         *
+         * @param[out] out array of at least max pointers to populate from front of queue
+         * @param max max number of elements to pop
+         * @param[out] head caller local copy of producer index, refreshed when exhausted
+         * @return number of elements popped, 0 if empty
+         */
+        size_t try_pop_n(T **out, size_t max, size_t &head)
+        {
+            size_t t = _tail.load(std::memory_order_acquire);
+            size_t n;
+            do
+            {
+                if (head < t + max)
+                {
+                    // cached producer index cannot satisfy request, refresh
+                    head = _head.load(std::memory_order_seq_cst);
+                    if (head <= t)
+                    {
+                        return 0;
+                    }
+                }
+                n = std::min(max, head - t);
+                for (size_t i = 0; i < n; ++i)
+                {
+                    out[i] = _buf[(t + i) & _mask].load(std::memory_order_relaxed);
+                }
+            } while (!_tail.compare_exchange_weak(t, t + n,
+                                                  std::memory_order_seq_cst,
+                                                  std::memory_order_acquire));
+            if (_weigher != nullptr)
+            {
+                size_t w = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    w += _weigher(out[i]);
+                }
+                _weight.fetch_sub(w, std::memory_order_seq_cst);
+            }
+            return n;
+        }
+
+        /**
+         * @brief non-blocking push of up to n elements
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n max number of elements to push
+         * @return number of elements pushed, 0 if full
+         */
+        size_t try_push_n(T *const *in, size_t n)
+        {
+            const size_t h = _head.load(std::memory_order_relaxed);
+            if (h - _tail_cache + n > _capacity)
+            {
+                _tail_cache = _tail.load(std::memory_order_seq_cst);
+            }
+            n = std::min(n, _capacity - (h - _tail_cache));
+            if (_weigher != nullptr)
+            {
+                const size_t cur = _weight.load(std::memory_order_seq_cst);
+                size_t w = 0;
+                size_t k = 0;
+                while (k < n)
+                {
+                    const size_t w_k = _weigher(in[k]);
+                    if ((cur != 0 || k != 0) && cur + w + w_k > _limit)
+                    {
+                        break;
+                    }
+                    w += w_k;
+                    ++k;
+                }
+                n = k;
+                // account for weight before publishing so consumers never subtract first
+                _weight.fetch_add(w, std::memory_order_seq_cst);
+            }
+            for (size_t i = 0; i < n; ++i)
+            {
+                _buf[(h + i) & _mask].store(in[i], std::memory_order_relaxed);
+            }
+            if (n != 0)
+            {
+                _head.store(h + n, std::memory_order_seq_cst);
+                this->_counters.count_push(n, h + n - _tail.load(std::memory_order_relaxed));
+            }
+            return n;
+        }
+
+        /**
+         * @brief producer check if queue cannot accept an element
+         *
+         * @param ptr next element to push
+         * @return true if ring is full or weight limit would be exceeded
+         */
+        bool is_full(const T *ptr)
+        {
+            if (_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_seq_cst) >= _capacity)
+            {
+                return true;
+            }
+            if (_weigher == nullptr)
+            {
+                return false;
+            }
+            const size_t cur = _weight.load(std::memory_order_seq_cst);
+            return cur != 0 && cur + _weigher(ptr) > _limit;
+        }
+
+        /**
+         * @brief blocking pop with optional timeout, parks on futex only while empty
+         *
+         * @param[out] out array of at least max pointers to populate from front of queue
+         * @param max max number of elements to pop
+         * @param timeout max duration to wait for, nullptr = wait indefinitely
+         * @return number of elements popped, 0 if flushed or timeout reached
+         */
+        size_t pop_wait(T **out, size_t max, const std::chrono::nanoseconds *timeout)
+        {
+            if (max == 0)
+            {
+                return 0;
+            }
+            const auto deadline = std::chrono::steady_clock::now() +
+                                  ((timeout == nullptr) ? std::chrono::nanoseconds(0) : *timeout);
+            while (true)
+            {
+                if (_pop_flush.exchange(false, std::memory_order_seq_cst))
+                {
+                    return 0;
+                }
+                const size_t n = try_pop_n(out, max, _head_cache);
+                if (n != 0)
+                {
+                    this->_counters.count_pop(n);
+                    if (_push_wait.load(std::memory_order_seq_cst))
+                    {
+                        wake(_push_seq);
+                    }
+                    return n;
+                }
+                const uint32_t seq = _pop_seq.load(std::memory_order_seq_cst);
+                _pop_wait.store(true, std::memory_order_seq_cst);
+                bool timedout = false;
+                if (!_pop_flush.load(std::memory_order_seq_cst) &&
+                    _head.load(std::memory_order_seq_cst) <= _tail.load(std::memory_order_seq_cst))
+                {
+                    const std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+                    timedout = !park(_pop_seq, seq, timeout, deadline);
+                    this->_counters.count_pop_wait(wait_start);
+                }
+                _pop_wait.store(false, std::memory_order_relaxed);
+                if (timedout)
+                {
+                    return 0;
+                }
+            }
+        }
+
+        /**
+         * @brief blocking push with optional timeout, parks on futex only while full
+         *
+         * @param in array of n pointers to copy to queue
+         * @param n number of elements to push
+         * @param timeout max duration to wait for, nullptr = wait indefinitely
+         * @return number of elements pushed, less than n if flushed or timeout reached
+         */
+        size_t push_wait(T *const *in, size_t n, const std::chrono::nanoseconds *timeout)
+        {
+            const auto deadline = std::chrono::steady_clock::now() +
+                                  ((timeout == nullptr) ? std::chrono::nanoseconds(0) : *timeout);
+            size_t cnt = 0;
+            while (cnt < n)
+            {
+                if (_push_flush.exchange(false, std::memory_order_seq_cst))
+                {
+                    break;
+                }
+                const size_t k = try_push_n(&(in[cnt]), n - cnt);
+                if (k != 0)
+                {
+                    cnt += k;
+                    if (_pop_wait.load(std::memory_order_seq_cst))
+                    {
+                        wake(_pop_seq);
+                    }
+                    continue;
+                }
+                const uint32_t seq = _push_seq.load(std::memory_order_seq_cst);
+                _push_wait.store(true, std::memory_order_seq_cst);
+                bool timedout = false;
+                if (!_push_flush.load(std::memory_order_seq_cst) && is_full(in[cnt]))
+                {
+                    const std::chrono::steady_clock::time_point wait_start = std::chrono::steady_clock::now();
+                    timedout = !park(_push_seq, seq, timeout, deadline);
+                    this->_counters.count_push_wait(wait_start);
+                }
+                _push_wait.store(false, std::memory_order_relaxed);
+                if (timedout)
+                {
+                    break;
+                }
+            }
+            return cnt;
+        }
+
+        /**
+         * @brief park on futex sequence word until woken or deadline reached
+         *
+         * @param seq futex sequence word to park on
+         * @param expected value of sequence word observed before checking wait condition
+         * @param timeout max duration to wait for, nullptr = wait indefinitely
+         * @param deadline absolute deadline derived from timeout
+         * @return false if deadline reached, true otherwise
+         */
+        static bool park(std::atomic<uint32_t> &seq, uint32_t expected,
+                         const std::chrono::nanoseconds *timeout,
+                         const std::chrono::steady_clock::time_point &deadline)
+        {
+            if (timeout == nullptr)
+            {
+                return futex_wait(seq, expected);
+            }
+            const std::chrono::nanoseconds rem = deadline - std::chrono::steady_clock::now();
+            if (rem.count() <= 0)
+            {
+                return false;
+            }
+            return futex_wait(seq, expected, &rem);
+        }
+
+        /// @brief capacity of ring buffer (power of two)
+        const size_t _capacity;
+        /// @brief mask used to convert monotonic index to ring position
+        const size_t _mask;
+        /// @brief default flush callback to invoke
+        const FlushCallback _callback;
+        /// @brief max total weight of queued elements
+        const size_t _limit;
+        /// @brief weight callback (nullptr if unweighted)
+        const WeightCallback _weigher;
+        /// @brief ring buffer of pointers
+        std::atomic<T *> *_buf;
+        /// @brief total weight of queued elements
+        std::atomic<size_t> _weight;
+
+        /// @brief producer index (next position to write), only written by producer
+        alignas(CACHELINE_SZ) std::atomic<size_t> _head;
+        /// @brief producer local copy of consumer index
+        size_t _tail_cache;
+        /// @brief control flag to signal a flush to producer
+        std::atomic<bool> _push_flush;
+        /// @brief true while producer is parked or about to park
+        std::atomic<bool> _push_wait;
+        /// @brief futex word producer parks on
+        std::atomic<uint32_t> _push_seq;
+
+        /// @brief consumer index (next position to read), advanced by consumer and flushes
+        alignas(CACHELINE_SZ) std::atomic<size_t> _tail;
+        /// @brief consumer local copy of producer index
+        size_t _head_cache;
+        /// @brief control flag to signal a flush to consumer
+        std::atomic<bool> _pop_flush;
+        /// @brief true while consumer is parked or about to park
+        std::atomic<bool> _pop_wait;
+        /// @brief futex word consumer parks on
+        std::atomic<uint32_t> _pop_seq;
+    };
+
+}
\ No newline at end of file
@@ -4,22 +4,44 @@
  */
 #pragma once
 
+#include "util/canceltoken.h"
 #include "util/error.h"
+#include "util/executor.h"
+#include "util/loopstats.h"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
+#include <cstdint>
 #include <mutex>
 #include <thread>
 
 namespace whfa::util
 {
 
+    class Notifier;
+
     /**
      * @class whfa::util::Threader
      * @brief abstract base class for a threadsafe parallel thread worker
+     *
+     * state is published through a seqlock, so control calls and state polling never wait on
+     * execute_loop_body() (e.g. a blocking read or device write)
+     * execute_loop_body() runs without holding any Threader lock,
+     * derived classes synchronize their own resources with it using _mtx
+     *
+     * runs on its own dedicated thread, or when constructed with an Executor,
+     * each loop body iteration runs as a task on the executor's shared pool threads
+     *
+     * stopping, pausing, and destruction cancel the threader's CancelToken, so loop bodies
+     * that only block through the token or for at most CANCEL_WAIT at a time stop in bounded time
      */
     class Threader
     {
     public:
+        /// @brief max duration loop bodies should block for between cancellation checks
+        static constexpr std::chrono::milliseconds CANCEL_WAIT{50};
+
         /**
          * @struct whfa::util::Threader::State
          * @brief primitives describing thread operation, processing errors, and timestamp
@@ -34,6 +56,66 @@ namespace whfa::util
             int64_t timestamp;
         };
 
+        /**
+         * @enum whfa::util::Threader::SchedPolicy
+         * @brief enum defining the scheduling policy of a worker thread
+         */
+        enum SchedPolicy
+        {
+            /// @brief SCHED_OTHER, default time-sharing (priority ignored)
+            POLICY_OTHER,
+            /// @brief SCHED_FIFO, real-time first in first out
+            POLICY_FIFO,
+            /// @brief SCHED_RR, real-time round robin
+            POLICY_RR
+        };
+
+        /**
+         * @struct whfa::util::Threader::ThreadConfig
+         * @brief scheduling, placement, and naming of a worker thread
+         *
+         * real-time policies and memory locking require CAP_SYS_NICE / CAP_IPC_LOCK
+         * or sufficient RLIMIT_RTPRIO / RLIMIT_MEMLOCK
+         */
+        struct ThreadConfig
+        {
+            /// @brief scheduling policy
+            SchedPolicy policy;
+            /// @brief real-time priority (1 to 99 on linux, ignored for POLICY_OTHER)
+            int priority;
+            /// @brief bitmask of cpus (0 to 63) thread may run on, 0 = any cpu
+            uint64_t affinity;
+            /// @brief thread name shown by ps/top (truncated to 15 chars), nullptr = unchanged
+            const char *name;
+            /// @brief true to lock all current and future process memory (mlockall, process wide)
+            bool lock_memory;
+        };
+
+        /// @brief default thread configuration (default policy, any cpu, unnamed, unlocked memory)
+        static constexpr ThreadConfig DEF_THREAD_CONFIG = {.policy = POLICY_OTHER,
+                                                           .priority = 0,
+                                                           .affinity = 0,
+                                                           .name = nullptr,
+                                                           .lock_memory = false};
+
+        /**
+         * @struct whfa::util::Threader::BatchBudget
+         * @brief max number of loop body iterations run per state check
+         *
+         * a batch ends early once state stops running, or when pooled, once the loop body is not ready
+         */
+        struct BatchBudget
+        {
+            /// @brief max iterations per batch (0 treated as 1)
+            size_t iterations;
+            /// @brief max duration of a batch, checked after each iteration, 0 = unlimited
+            std::chrono::microseconds duration;
+        };
+
+        /// @brief default batch budget, one iteration per state check
+        static constexpr BatchBudget DEF_BATCH_BUDGET = {.iterations = 1,
+                                                         .duration = std::chrono::microseconds(0)};
+
         /**
          * @class whfa::util::Threader::StateHandler
          * @brief class for handling state callbacks
@@ -55,13 +137,19 @@ namespace whfa::util
         };
 
         /**
-         * @brief destructor that sets state to terminate and joins thread
+         * @brief destructor, derived destructors must call terminate() first (asserted)
+         *
+         * execute_loop_body() and is_ready() belong to the already destroyed derived class here,
+         * so the thread or pooled task must not be running anymore
          */
         virtual ~Threader();
 
         /**
          * @brief sets state to run thread loop
          *
+         * handler is invoked from whichever thread changes state, outside of any Threader lock,
+         * or from the notifier thread if set
+         *
          * @param handler state handler to be invoked upon internal state changes
          */
         void start(StateHandler *handler = nullptr);
@@ -76,45 +164,185 @@ namespace whfa::util
          */
         void pause();
 
+        /**
+         * @brief apply scheduling policy, cpu affinity, name, and memory locking to worker thread
+         *
+         * may be called at any time and from any thread, e.g. before start()
+         * every setting is attempted even if an earlier one fails
+         * pooled threaders share executor threads and cannot be configured
+         *
+         * @param config thread configuration to apply
+         * @return error int of first failed setting (errno value, e.g. EPERM), EINVAL if pooled, 0 on success
+         */
+        int configure_thread(const ThreadConfig &config);
+
+        /**
+         * @brief dispatch state handler calls asynchronously on a notifier thread
+         *
+         * worker loops then only post events, so slow handlers cannot add latency to them
+         * notifier must outlive threader (or be replaced first)
+         *
+         * @param notifier notifier to post state changes to, nullptr = invoke handler synchronously
+         * @param timestamps true to also post timestamp updates (coalesced, latest timestamp only)
+         */
+        void set_notifier(Notifier *notifier, bool timestamps = false);
+
         /**
          * @brief returns copy of state
          *
-         * @param[out] state copy of internal State
+         * lock-free, never blocks on the worker thread
+         * run and error are read consistently, timestamp is published separately
+         * and may be newer or older by one update
+         *
+         * @param[out] state consistent copy of internal State
+         */
+        void get_state(State &state) const;
+
+        /**
+         * @brief get latest timestamp
+         *
+         * a single atomic load, for polling position at high frequency
+         *
+         * @return latest timestamp set
+         */
+        int64_t get_timestamp() const;
+
+        /**
+         * @brief get time of latest progress, the latest timestamp update or start
+         *
+         * lock-free, for detecting stalled workers
+         *
+         * @return steady clock time of latest progress
+         */
+        std::chrono::steady_clock::time_point get_progress_time() const;
+
+        /**
+         * @brief get token cancelled while not running, for interrupting blocking operations
+         *
+         * cancelled by stop(), pause(), and destruction, reset by start()
+         *
+         * @return cancellation token of threader
          */
-        void get_state(State &state);
+        const CancelToken &get_cancel_token() const;
+
+        /**
+         * @brief get snapshot of loop body iteration counts and timing histograms
+         *
+         * lock-free, all 0 if built with WHFA_LOOP_STATS=0
+         * wait time only covers blocking the derived class reports through count_wait()
+         *
+         * @param[out] stats loop iteration counters and busy and wait time histograms
+         */
+        void get_stats(LoopStats &stats) const;
 
     protected:
         /**
          * @brief protected hidden constructor
+         *
+         * @param executor pool to run loop body iterations on, nullptr = dedicated thread
          */
-        Threader();
+        Threader(Executor *executor = nullptr);
 
         /**
          * @brief pure virtual method to define work to execute in thread
          * @see Threaer::execute_loop()
+         *
+         * when pooled, should not wait longer than Executor::IDLE_WAIT for input
          */
         virtual void execute_loop_body() = 0;
 
+        /**
+         * @brief check if loop body has work available without blocking
+         *
+         * only consulted when pooled, unready iterations are skipped so waiting costs no pool thread
+         *
+         * @return true if loop body should run, default true
+         */
+        virtual bool is_ready();
+
+        /**
+         * @brief wake pool threads parked on idle tasks, after readiness changed outside the executor
+         *
+         * no-op on a dedicated thread
+         */
+        void notify_ready();
+
+        /**
+         * @brief get start time of a blocking call within execute_loop_body()
+         * @see Threader::count_wait()
+         *
+         * @return current time, or epoch if loop stats are compiled out
+         */
+        std::chrono::steady_clock::time_point wait_start() const
+        {
+            if constexpr (LOOP_STATS_ENABLED)
+            {
+                return std::chrono::steady_clock::now();
+            }
+            return std::chrono::steady_clock::time_point();
+        }
+
+        /**
+         * @brief count time since start as waiting rather than busy in current loop body iteration
+         *
+         * only call from execute_loop_body(), e.g. around blocking queue calls
+         *
+         * @param start time blocking began, from wait_start()
+         */
+        void count_wait(const std::chrono::steady_clock::time_point &start)
+        {
+            if constexpr (LOOP_STATS_ENABLED)
+            {
+                _iter_wait += std::chrono::steady_clock::now() - start;
+            }
+        }
+
+        /**
+         * @brief set number of loop body iterations run per state check
+         *
+         * amortizes waiting on state (and executor requeueing when pooled) over several iterations,
+         * for loop bodies moving a single cheap item per iteration
+         * takes effect from the next batch
+         *
+         * @param budget max iterations and duration of each batch
+         */
+        void set_batch_budget(const BatchBudget &budget);
+
+        /**
+         * @brief check if loop body iterations run on a shared executor
+         *
+         * @return true if pooled, false if running on a dedicated thread
+         */
+        bool is_pooled() const;
+
         /**
          * @brief waits or executes thread loop according to state
          */
         void execute_loop();
 
         /**
-         * @brief returns const access to internal state
+         * @brief stop permanently and wait until no loop body iteration is running or will run
          *
-         * @return internal state for reading
+         * cancels blocking loop bodies, then joins the dedicated thread (or waits for the pooled task to unschedule)
+         * idempotent, the most derived destructor must call it first, before releasing state used by execute_loop_body()
          */
-        const State &get_state() const;
+        void terminate();
 
         /**
-         * @brief not threadsafe implementation of start()
+         * @brief returns copy of internal state
+         *
+         * @return consistent copy of internal State
+         */
+        State get_state() const;
+
+        /**
+         * @brief implementation of start()
          * @see Threader::start()
          */
         void set_state_start();
 
         /**
-         * @brief not threadsafe implementation of stop() while setting error
+         * @brief implementation of stop() while setting error
          * @see Threader::stop()
          *
          * @param error error value to set
@@ -122,7 +350,7 @@ namespace whfa::util
         void set_state_stop(int error = ENONE);
 
         /**
-         * @brief not threadsafe implementation of pause() while setting error
+         * @brief implementation of pause() while setting error
          * @see Threader::pause()
          *
          * @param error error value to set
@@ -130,29 +358,120 @@ namespace whfa::util
         void set_state_pause(int error = ENONE);
 
         /**
-         * @brief not threadsafe method to set state error
+         * @brief set state error
          *
          * @param error error value to set
          */
         void set_state_error(int error);
 
         /**
-         * @brief not threadsafe
+         * @brief set state timestamp
+         *
+         * lock-free, intended for the loop body only (single writer) and cheap enough per packet or frame
+         * also records progress time (see get_progress_time())
+         * only handled if notifier posts timestamps (coalesced), never invokes handler synchronously
+         *
+         * @param timestamp timestamp to set
          */
         void set_state_timestamp(int64_t timestamp);
 
-        /// @brief mutex for synchronizing access to state
+        /// @brief mutex for derived classes to synchronize their resources with execute_loop_body()
         std::mutex _mtx;
 
     private:
-        /// @brief internal state
-        State _state;
+        /**
+         * @class whfa::util::Threader::PoolTask
+         * @brief executor task running loop body iterations of a pooled threader
+         */
+        class PoolTask : public Executor::Task
+        {
+        public:
+            /**
+             * @brief constructor
+             * @param threader threader to run
+             */
+            PoolTask(Threader *threader);
+
+            /**
+             * @brief run one loop body iteration according to state
+             *
+             * @return TASK_DONE once stopped or terminating, TASK_IDLE if not ready, TASK_AGAIN otherwise
+             */
+            Result run() override;
+
+        private:
+            /// @brief threader to run
+            Threader *_threader;
+        };
+
+        /**
+         * @brief run one loop body iteration, timing it if loop stats are compiled in
+         */
+        void run_loop_body();
+
+        /**
+         * @brief run loop body iterations until budget is spent, state stops running, or cancelled
+         *
+         * @param budget budget copied while holding _state_mtx
+         * @param check_ready true to also stop once is_ready() returns false (pooled)
+         */
+        void run_batch(const BatchBudget &budget, bool check_ready);
+
+        /**
+         * @brief not threadsafe publishing of state to seqlock, _state_mtx must be held
+         *
+         * @param state state to publish
+         * @param timestamp true to also publish timestamp, false to leave it to set_state_timestamp()
+         */
+        void write_state(const State &state, bool timestamp = true);
+
+        /**
+         * @brief invoke handler with state if set, or post to notifier if set
+         *
+         * @param handler handler copied while holding _state_mtx
+         * @param notifier notifier copied while holding _state_mtx
+         * @param state state to handle
+         */
+        static void handle_state(StateHandler *handler, Notifier *notifier, const State &state);
+
+        /// @brief seqlock sequence number, odd while state is being written
+        std::atomic<uint64_t> _seq;
+        /// @brief true if thread should execute thread_loop_body()
+        std::atomic<bool> _run;
+        /// @brief error value
+        std::atomic<int> _error;
+        /// @brief timestamp, written outside the seqlock by set_state_timestamp()
+        std::atomic<int64_t> _timestamp;
+        /// @brief steady clock time of latest progress in ns since clock epoch
+        std::atomic<int64_t> _progress_ns;
+        /// @brief mutex serializing state writers and thread waiting (never held while loop body runs)
+        std::mutex _state_mtx;
         /// @brief state callback handler (nullptr if no callback)
         StateHandler *_handler;
         /// @brief true if thread should terminate, hidden logic not exposed in State
         bool _terminate;
+        /// @brief token cancelled whenever state stops running or thread terminates
+        CancelToken _cancel;
+        /// @brief loop body iterations run per state check
+        BatchBudget _budget;
         /// @brief codition variable for thread waiting and notifying
         std::condition_variable _cond;
+        /// @brief executor running loop body iterations (nullptr if dedicated thread)
+        Executor *_executor;
+        /// @brief task submitted to executor
+        PoolTask _task;
+        /// @brief true while task is queued or running on executor
+        bool _scheduled;
+        /// @brief notifier to post handler calls to (nullptr if synchronous)
+        Notifier *_notifier;
+        /// @brief true if timestamp updates are posted to notifier
+        std::atomic<bool> _notify_ts;
+        /// @brief true while a coalesced timestamp update is queued on notifier
+        std::atomic<bool> _ts_pending;
+        /// @brief loop body iteration counters and timing histograms
+        LoopCounters _loop_counters;
+        /// @brief time counted as waiting in current loop body iteration (loop thread only)
+        std::chrono::steady_clock::duration _iter_wait;
         /// @brief the thread that is running
         std::thread _thread;
     };
@@ -0,0 +1,241 @@
+/**
+ * @file util/waitpolicy.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+#include "util/futex.h"
+
+#include <condition_variable>
+#include <mutex>
+
+namespace whfa::util
+{
+
+    /**
+     * @brief hint to the processor that the calling thread is busy waiting
+     */
+    inline void cpu_relax()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#elif defined(__aarch64__) || defined(__arm__)
+        asm volatile("yield" ::: "memory");
+#endif
+    }
+
+    /// @brief default number of spin iterations for spinning wait policies
+    constexpr unsigned int DEF_WAIT_SPIN = 512;
+
+    /**
+     * @struct whfa::util::BlockWait
+     * @brief wait policy that immediately blocks on a condition variable
+     */
+    struct BlockWait
+    {
+        /// @brief number of spin iterations before blocking
+        static constexpr unsigned int SPIN = 0;
+        /// @brief true if blocking parks on a futex instead of a condition variable
+        static constexpr bool FUTEX = false;
+    };
+
+    /**
+     * @struct whfa::util::SpinWait<N>
+     * @brief wait policy that spins (with pause) a bounded number of times before blocking on a condition variable
+     */
+    template <unsigned int N = DEF_WAIT_SPIN>
+    struct SpinWait
+    {
+        /// @brief number of spin iterations before blocking
+        static constexpr unsigned int SPIN = N;
+        /// @brief true if blocking parks on a futex instead of a condition variable
+        static constexpr bool FUTEX = false;
+    };
+
+    /**
+     * @struct whfa::util::SpinFutexWait<N>
+     * @brief wait policy that spins (with pause) a bounded number of times before parking on a futex
+     *
+     * notifying is free of syscalls while no thread is parked
+     */
+    template <unsigned int N = DEF_WAIT_SPIN>
+    struct SpinFutexWait
+    {
+        /// @brief number of spin iterations before blocking
+        static constexpr unsigned int SPIN = N;
+        /// @brief true if blocking parks on a futex instead of a condition variable
+        static constexpr bool FUTEX = true;
+    };
+
+    /**
+     * @class whfa::util::Parker<Policy>
+     * @brief condition variable replacement implementing a wait policy
+     *
+     * same usage as std::condition_variable with std::mutex:
+     * waiting releases the held lock and reacquires it before returning,
+     * spurious wakeups are possible, notifying should follow a state change made under the lock
+     * notifying never acquires the caller's mutex, so it may be called while holding any lock
+     */
+    template <typename Policy>
+    class Parker
+    {
+    public:
+        /**
+         * @brief constructor
+         */
+        Parker()
+            : _seq(0),
+              _num_wait(0)
+        {
+        }
+
+        /**
+         * @brief release lock, wait for notification, and reacquire lock
+         *
+         * @param lk held lock protecting waited on state
+         */
+        void wait(std::unique_lock<std::mutex> &lk)
+        {
+            wait_impl(lk, nullptr);
+        }
+
+        /**
+         * @brief release lock, wait for notification or timeout, and reacquire lock
+         *
+         * @param lk held lock protecting waited on state
+         * @param timeout max duration to wait for
+         * @return timeout if timeout reached, no_timeout otherwise
+         */
+        template <typename Rep, typename Period>
+        std::cv_status wait_for(std::unique_lock<std::mutex> &lk,
+                                const std::chrono::duration<Rep, Period> &timeout)
+        {
+            const std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() +
+                                                                   std::chrono::duration_cast<std::chrono::nanoseconds>(timeout);
+            return wait_impl(lk, &deadline);
+        }
+
+        /**
+         * @brief release lock, wait for notification or deadline, and reacquire lock
+         *
+         * @param lk held lock protecting waited on state
+         * @param deadline time to stop waiting at
+         * @return timeout if deadline reached, no_timeout otherwise
+         */
+        std::cv_status wait_until(std::unique_lock<std::mutex> &lk,
+                                  const std::chrono::steady_clock::time_point &deadline)
+        {
+            return wait_impl(lk, &deadline);
+        }
+
+        /**
+         * @brief wake all waiting threads
+         */
+        void notify_all()
+        {
+            if (Policy::SPIN == 0 && !Policy::FUTEX)
+            {
+                _cond.notify_all();
+                return;
+            }
+            if (_num_wait.load(std::memory_order_seq_cst) == 0)
+            {
+                return;
+            }
+            _seq.fetch_add(1, std::memory_order_seq_cst);
+            if (Policy::FUTEX)
+            {
+                futex_wake(_seq);
+            }
+            else
+            {
+                // waiters check sequence under park lock before blocking, cannot miss this notification
+                {
+                    std::lock_guard<std::mutex> park_lk(_park_mtx);
+                }
+                _cond.notify_all();
+            }
+        }
+
+    protected:
+        /**
+         * @brief spin then block according to policy
+         *
+         * @param lk held lock protecting waited on state
+         * @param deadline time to stop waiting at, nullptr = wait indefinitely
+         * @return timeout if deadline reached, no_timeout otherwise
+         */
+        std::cv_status wait_impl(std::unique_lock<std::mutex> &lk,
+                                 const std::chrono::steady_clock::time_point *deadline)
+        {
+            if (Policy::SPIN == 0 && !Policy::FUTEX)
+            {
+                if (deadline == nullptr)
+                {
+                    _cond.wait(lk);
+                    return std::cv_status::no_timeout;
+                }
+                return _cond.wait_until(lk, *deadline);
+            }
+
+            // sequence read and registration under lock, notifiers change state under lock first
+            const uint32_t seq = _seq.load(std::memory_order_seq_cst);
+            _num_wait.fetch_add(1, std::memory_order_seq_cst);
+            std::cv_status rv = std::cv_status::no_timeout;
+            lk.unlock();
+            bool notified = false;
+            for (unsigned int i = 0; i < Policy::SPIN; ++i)
+            {
+                if (_seq.load(std::memory_order_acquire) != seq)
+                {
+                    notified = true;
+                    break;
+                }
+                cpu_relax();
+            }
+            if (!notified && Policy::FUTEX)
+            {
+                if (deadline == nullptr)
+                {
+                    futex_wait(_seq, seq);
+                }
+                else
+                {
+                    const std::chrono::nanoseconds rem = *deadline - std::chrono::steady_clock::now();
+                    if (rem.count() <= 0 || !futex_wait(_seq, seq, &rem))
+                    {
+                        rv = std::cv_status::timeout;
+                    }
+                }
+            }
+            if (!notified && !Policy::FUTEX)
+            {
+                std::unique_lock<std::mutex> park_lk(_park_mtx);
+                while (_seq.load(std::memory_order_seq_cst) == seq && rv == std::cv_status::no_timeout)
+                {
+                    if (deadline == nullptr)
+                    {
+                        _cond.wait(park_lk);
+                    }
+                    else
+                    {
+                        rv = _cond.wait_until(park_lk, *deadline);
+                    }
+                }
+            }
+            lk.lock();
+            _num_wait.fetch_sub(1, std::memory_order_seq_cst);
+            return rv;
+        }
+
+        /// @brief notification sequence, futex word when parking on futex
+        std::atomic<uint32_t> _seq;
+        /// @brief number of threads spinning or blocked
+        std::atomic<uint32_t> _num_wait;
+        /// @brief mutex guarding sequence check before blocking when not parking on futex
+        std::mutex _park_mtx;
+        /// @brief condition variable for blocking when not parking on futex
+        std::condition_variable _cond;
+    };
+
+}
\ No newline at end of file
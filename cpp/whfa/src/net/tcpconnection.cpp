@@ -4,6 +4,8 @@
  */
 #include "net/tcpconnection.h"
 
+#include <cerrno>
+
 #include <arpa/inet.h>
 #include <poll.h>
 #include <sys/socket.h>
@@ -97,7 +99,8 @@ namespace whfa::net
      */
 
     TCPConnection::TCPConnection(int fd)
-        : _fd(fd)
+        : _fd(fd),
+          _cancel(nullptr)
     {
     }
 
@@ -167,6 +170,11 @@ namespace whfa::net
 
     bool TCPConnection::recv(void *buf, size_t size, bool block)
     {
+        if (block && _cancel != nullptr)
+        {
+            // wait in poll so cancellation can wake the receive
+            return recv_poll(buf, size, -1);
+        }
         std::lock_guard<std::mutex> m_lk(_msg_mtx);
         const int flags = block ? 0 : MSG_DONTWAIT;
         uint8_t *data = static_cast<uint8_t *>(buf);
@@ -184,15 +192,9 @@ namespace whfa::net
     {
         std::lock_guard<std::mutex> m_lk(_msg_mtx);
         uint8_t *data = static_cast<uint8_t *>(buf);
-        struct pollfd pfd
-        {
-            .fd = _fd,
-            .events = POLLIN
-        };
         while (size > 0)
         {
-            const int rv = poll(&pfd, 1, timeout);
-            if (rv > 0 && pfd.revents & POLLIN)
+            if (wait(POLLIN, timeout))
             {
                 if (!recv_loop_body(_fd, data, size, MSG_DONTWAIT) &&
                     (errno != EAGAIN) && (errno != EWOULDBLOCK))
@@ -210,6 +212,11 @@ namespace whfa::net
 
     bool TCPConnection::send(const void *buf, size_t size, bool block)
     {
+        if (block && _cancel != nullptr)
+        {
+            // wait in poll so cancellation can wake the send
+            return send_poll(buf, size, -1);
+        }
         std::lock_guard<std::mutex> m_lk(_msg_mtx);
         const int flags = block ? 0 : MSG_DONTWAIT;
         const uint8_t *data = static_cast<const uint8_t *>(buf);
@@ -227,15 +234,9 @@ namespace whfa::net
     {
         std::lock_guard<std::mutex> m_lk(_msg_mtx);
         const uint8_t *data = static_cast<const uint8_t *>(buf);
-        struct pollfd pfd
-        {
-            .fd = _fd,
-            .events = POLLOUT
-        };
         while (size > 0)
         {
-            const int rv = poll(&pfd, 1, timeout);
-            if (rv > 0 && pfd.revents & POLLIN)
+            if (wait(POLLOUT, timeout))
             {
                 if (!send_loop_body(_fd, data, size, MSG_DONTWAIT) &&
                     (errno != EAGAIN) && (errno != EWOULDBLOCK))
@@ -256,4 +257,51 @@ namespace whfa::net
         std::lock_guard<std::mutex> s_lk(_sck_mtx);
         close_conn(_fd, shutdown);
     }
+
+    void TCPConnection::set_cancel_token(const util::CancelToken *token)
+    {
+        _cancel = token;
+    }
+
+    /**
+     * whfa::net::TCPConnection protected methods
+     */
+
+    bool TCPConnection::wait(short events, int timeout)
+    {
+        struct pollfd pfds[2] = {{.fd = _fd, .events = events, .revents = 0},
+                                 {.fd = -1, .events = POLLIN, .revents = 0}};
+        nfds_t npfd = 1;
+        if (_cancel != nullptr)
+        {
+            if (_cancel->is_cancelled())
+            {
+                errno = ECANCELED;
+                return false;
+            }
+            pfds[1].fd = _cancel->get_fd();
+            npfd = 2;
+        }
+        int rv;
+        while ((rv = poll(pfds, npfd, timeout)) < 0 && errno == EINTR)
+        {
+        }
+        if (rv < 0)
+        {
+            return false;
+        }
+        if (npfd == 2 && (pfds[1].revents & POLLIN) != 0)
+        {
+            errno = ECANCELED;
+            return false;
+        }
+        if (rv == 0)
+        {
+            errno = ETIMEDOUT;
+            return false;
+        }
+        // errors and hangups are reported by the following recv/send
+        return (pfds[0].revents & (events | POLLERR | POLLHUP)) != 0;
+    }
+
 }
\ No newline at end of file
@@ -4,6 +4,7 @@
  */
 #include "net/tcpramfile.h"
 
+#include <cerrno>
 #include <cstring>
 
 namespace
@@ -36,6 +37,7 @@ namespace
      * @param[out] fsz file size in bytes
      * @param[out] rd_pos read position in file in bytes
      * @param[out] rv_pos receive position in file in bytes
+     * @param token cancel token of receiving threader, only applied once file size is received
      * @return true on success
      */
     inline bool init_ramfile(
@@ -43,9 +45,14 @@ namespace
         uint8_t *&data,
         uint64_t &fsz,
         uint64_t &rd_pos,
-        uint64_t &rv_pos)
+        uint64_t &rv_pos,
+        const whfa::util::CancelToken *token)
     {
-        if (!conn.recv(&fsz, sizeof(fsz)))
+        // token stays cancelled from a previous close until start(), so size exchange ignores it
+        conn.set_cancel_token(nullptr);
+        const bool received = conn.recv(&fsz, sizeof(fsz));
+        conn.set_cancel_token(token);
+        if (!received)
         {
             close_ramfile(conn, data);
             return false;
@@ -76,6 +83,7 @@ namespace whfa::net
 
     TCPRAMFile::~TCPRAMFile()
     {
+        terminate();
         close();
     }
 
@@ -89,7 +97,7 @@ namespace whfa::net
         {
             set_state_stop(errno);
         }
-        else if (!init_ramfile(_conn, _data, _filesz, _read_pos, _recv_pos))
+        else if (!init_ramfile(_conn, _data, _filesz, _read_pos, _recv_pos, &get_cancel_token()))
         {
             set_state_stop(errno);
         }
@@ -110,7 +118,7 @@ namespace whfa::net
         {
             set_state_stop(errno);
         }
-        else if (!init_ramfile(_conn, _data, _filesz, _read_pos, _recv_pos))
+        else if (!init_ramfile(_conn, _data, _filesz, _read_pos, _recv_pos, &get_cancel_token()))
         {
             set_state_stop(errno);
         }
@@ -187,12 +195,22 @@ namespace whfa::net
         return success;
     }
 
-    void TCPRAMFile::close()
+    uint64_t TCPRAMFile::get_position()
     {
-        std::lock_guard<std::mutex> lk(_mtx);
         std::lock_guard<std::mutex> rd_lk(_read_mtx);
-        close_ramfile(_conn, _data);
+        return _read_pos;
+    }
+
+    void TCPRAMFile::close()
+    {
+        // cancel any blocked recv before waiting for the loop body to release _mtx
         set_state_stop();
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            std::lock_guard<std::mutex> rd_lk(_read_mtx);
+            close_ramfile(_conn, _data);
+        }
+        _recv_cond.notify_all();
     }
 
     uint64_t TCPRAMFile::get_blocksize()
@@ -213,6 +231,8 @@ namespace whfa::net
 
     void TCPRAMFile::execute_loop_body()
     {
+        // receive buffer is freed by close() under the same lock
+        std::unique_lock<std::mutex> lk(_mtx);
         const uint64_t sz = std::min(_blocksz, _filesz - _recv_pos);
         if (_data == nullptr || sz == 0)
         {
@@ -222,10 +242,12 @@ namespace whfa::net
         {
             _recv_pos += sz;
         }
-        else
+        else if (errno != ECANCELED)
         {
+            // cancellation by stop or pause is not an error state
             set_state_pause(errno);
         }
+        lk.unlock();
         _recv_cond.notify_all();
     }
 }
\ No newline at end of file
@@ -3,10 +3,23 @@
  * @author Robert Griffith
  */
 #include "pcm/context.h"
+#include "pcm/probecache.h"
+#include "util/dbpqueue.h"
+#include "util/spscpqueue.h"
 
 namespace
 {
 
+    /// @brief convenience alias for context
+    using WPContext = whfa::pcm::Context;
+
+    /// @brief max number of times to read stage positions while looking for a consistent snapshot
+    constexpr size_t __POSITION_TRIES = 4;
+    /// @brief max bytes read while analyzing streams of a cached input (libav minimum is 32)
+    constexpr int64_t __CACHED_PROBESIZE = 32 * 1024;
+    /// @brief max duration analyzed of streams of a cached input in AV_TIME_BASE units
+    constexpr int64_t __CACHED_ANALYZE_DURATION = AV_TIME_BASE / 10;
+
     /**
      * @brief frees format context and sets to nullptr
      * @param[out] format format context to free and set to nullptr
@@ -46,7 +59,238 @@ namespace
     }
 
     /**
-     * @brief used when flushing context packet queue
+     * @brief fill in stream parameters the opened input's header and short analysis left unset
+     *
+     * @param format opened format context
+     * @param cached cached parameters of input
+     */
+    void fill_cached(AVFormatContext *format, const whfa::pcm::ProbeCache::Entry &cached)
+    {
+        if (cached.stream_idx >= static_cast<int>(format->nb_streams))
+        {
+            return;
+        }
+        AVStream *stream = format->streams[cached.stream_idx];
+        AVCodecParameters *params = stream->codecpar;
+        if (params->codec_id == AV_CODEC_ID_NONE)
+        {
+            params->codec_id = static_cast<AVCodecID>(cached.codec_id);
+        }
+        if (params->format < 0)
+        {
+            params->format = cached.sample_format;
+        }
+        if (params->bits_per_raw_sample == 0)
+        {
+            params->bits_per_raw_sample = cached.bitdepth;
+        }
+        if (params->channels == 0)
+        {
+            params->channels = cached.channels;
+        }
+        if (params->channel_layout == 0)
+        {
+            params->channel_layout = cached.channel_layout;
+        }
+        if (params->sample_rate == 0)
+        {
+            params->sample_rate = cached.rate;
+        }
+        if (params->block_align == 0)
+        {
+            params->block_align = cached.block_align;
+        }
+        if (params->frame_size == 0)
+        {
+            params->frame_size = cached.frame_size;
+        }
+        if (stream->time_base.num == 0)
+        {
+            stream->time_base = {cached.timebase_num, cached.timebase_den};
+        }
+        if (stream->duration == AV_NOPTS_VALUE)
+        {
+            stream->duration = cached.duration;
+        }
+    }
+
+    /**
+     * @brief make cache entry of opened input
+     *
+     * @param format opened format context
+     * @param stream_idx index of audio stream
+     * @return cache entry
+     */
+    whfa::pcm::ProbeCache::Entry make_cached(const AVFormatContext *format, int stream_idx)
+    {
+        const AVStream *stream = format->streams[stream_idx];
+        const AVCodecParameters *params = stream->codecpar;
+        return {.format_name = format->iformat->name,
+                .stream_idx = stream_idx,
+                .codec_id = params->codec_id,
+                .sample_format = params->format,
+                .bitdepth = params->bits_per_raw_sample,
+                .channels = params->channels,
+                .channel_layout = params->channel_layout,
+                .rate = params->sample_rate,
+                .block_align = params->block_align,
+                .frame_size = params->frame_size,
+                .timebase_num = stream->time_base.num,
+                .timebase_den = stream->time_base.den,
+                .duration = stream->duration};
+    }
+
+    /**
+     * @brief AVIOContext read callback reading from byte source
+     *
+     * @param opaque byte source
+     * @param buf buffer to read into
+     * @param size max number of bytes to read
+     * @return number of bytes read, AVERROR_EOF if none
+     */
+    int read_source(void *opaque, uint8_t *buf, int size)
+    {
+        const uint64_t n = static_cast<whfa::util::ByteSource *>(opaque)->read(buf, static_cast<uint64_t>(size));
+        return (n == 0) ? AVERROR_EOF : static_cast<int>(n);
+    }
+
+    /**
+     * @brief AVIOContext seek callback seeking byte source
+     *
+     * @param opaque byte source
+     * @param offset byte offset to seek to
+     * @param whence position from which offset is applied, or AVSEEK_SIZE
+     * @return new read position or file size, negative error on failure
+     */
+    int64_t seek_source(void *opaque, int64_t offset, int whence)
+    {
+        whfa::util::ByteSource *source = static_cast<whfa::util::ByteSource *>(opaque);
+        if (whence & AVSEEK_SIZE)
+        {
+            return static_cast<int64_t>(source->get_filesize());
+        }
+        if (!source->seek(offset, whence & ~AVSEEK_FORCE))
+        {
+            return AVERROR(EINVAL);
+        }
+        return static_cast<int64_t>(source->get_position());
+    }
+
+    /**
+     * @brief open libav input and its best audio stream's codec
+     *
+     * contexts are freed upon error (except pb, owned by caller)
+     *
+     * @param url libav stream string to source (only a name hint if pb is set)
+     * @param cached cached parameters of input to skip format detection and shorten analysis, nullptr = none
+     * @param config codec options
+     * @param[out] format format context opened
+     * @param[out] codec codec context opened
+     * @param[out] stream_idx index of audio stream
+     * @param pb custom I/O context to read from, nullptr = open url
+     * @return error int, 0 on success
+     */
+    int open_input(const char *url, const whfa::pcm::ProbeCache::Entry *cached,
+                   const whfa::pcm::Context::DecoderConfig &config,
+                   AVFormatContext *&format, AVCodecContext *&codec, int &stream_idx,
+                   AVIOContext *pb = nullptr)
+    {
+        AVInputFormat *iformat = nullptr;
+        if (cached != nullptr || pb != nullptr)
+        {
+            format = avformat_alloc_context();
+        }
+        if (cached != nullptr)
+        {
+            iformat = av_find_input_format(cached->format_name.c_str());
+            format->probesize = __CACHED_PROBESIZE;
+            format->max_analyze_duration = __CACHED_ANALYZE_DURATION;
+        }
+        if (pb != nullptr)
+        {
+            format->pb = pb;
+            format->flags |= AVFMT_FLAG_CUSTOM_IO;
+        }
+        int rv;
+        if ((rv = avformat_open_input(&format, url, iformat, nullptr)) != 0)
+        {
+            return rv;
+        }
+        if ((rv = avformat_find_stream_info(format, nullptr)) < 0)
+        {
+            free_format(format);
+            return rv;
+        }
+        if (cached != nullptr)
+        {
+            fill_cached(format, *cached);
+        }
+
+        AVCodec *dec;
+        if ((rv = av_find_best_stream(format, AVMEDIA_TYPE_AUDIO, -1, -1, &dec, 0)) < 0)
+        {
+            free_format(format);
+            return rv;
+        }
+        stream_idx = rv;
+
+        AVCodecParameters *params = format->streams[stream_idx]->codecpar;
+        codec = avcodec_alloc_context3(dec);
+        if ((rv = avcodec_parameters_to_context(codec, params)) < 0)
+        {
+            free_context(format, codec, stream_idx);
+            return rv;
+        }
+        // must be set before opening, libav settles on effective values while opening
+        codec->thread_count = config.threads;
+        codec->thread_type = config.thread_type;
+        if (config.low_delay)
+        {
+            codec->flags |= AV_CODEC_FLAG_LOW_DELAY;
+        }
+        codec->skip_frame = config.skip_frame;
+        if ((rv = avcodec_open2(codec, dec, nullptr)) != 0)
+        {
+            free_context(format, codec, stream_idx);
+            return rv;
+        }
+        return 0;
+    }
+
+    /**
+     * @brief open libav input using and updating probe cache
+     *
+     * contexts are freed upon error
+     *
+     * @param url libav stream string to source
+     * @param cache probe cache, nullptr = always probe fully
+     * @param config codec options
+     * @param[out] format format context opened
+     * @param[out] codec codec context opened
+     * @param[out] stream_idx index of audio stream
+     * @return error int, 0 on success
+     */
+    int open_cached(const char *url, whfa::pcm::ProbeCache *cache,
+                    const whfa::pcm::Context::DecoderConfig &config,
+                    AVFormatContext *&format, AVCodecContext *&codec, int &stream_idx)
+    {
+        whfa::pcm::ProbeCache::Entry cached;
+        if (cache != nullptr && cache->lookup(url, cached) &&
+            open_input(url, &cached, config, format, codec, stream_idx) == 0)
+        {
+            return 0;
+        }
+        // not cached, or stale entry (e.g. remote content changed)
+        const int rv = open_input(url, nullptr, config, format, codec, stream_idx);
+        if (rv == 0 && cache != nullptr)
+        {
+            cache->store(url, make_cached(format, stream_idx));
+        }
+        return rv;
+    }
+
+    /**
+     * @brief used when context packet pool is full or destroyed
      *
      * @param packet libav packet to free
      */
@@ -59,7 +303,7 @@ namespace
     }
 
     /**
-     * @brief used when flushing context frame queue
+     * @brief used when context frame pool is full or destroyed
      *
      * @param frame libav frame to free
      */
@@ -70,6 +314,121 @@ namespace
             av_frame_free(&frame);
         }
     }
+
+    /**
+     * @brief used when broadcasting context frame queue to multiple consumers
+     *
+     * @param frame libav frame to reference
+     * @return new frame referencing the same data buffers, nullptr for nullptr (EOF)
+     */
+    AVFrame *clone_frame(const AVFrame *frame)
+    {
+        return (frame == nullptr) ? nullptr : av_frame_clone(frame);
+    }
+
+    /**
+     * @brief used when bounding context packet queue by bytes
+     *
+     * @param packet libav packet to weigh
+     * @return packet data size in bytes, 0 for nullptr
+     */
+    size_t weigh_packet_bytes(const AVPacket *packet)
+    {
+        return (packet == nullptr || packet->size < 0) ? 0 : static_cast<size_t>(packet->size);
+    }
+
+    /**
+     * @brief used when bounding context frame queue by bytes
+     *
+     * @param frame libav frame to weigh
+     * @return decoded sample data size in bytes, 0 for nullptr
+     */
+    size_t weigh_frame_bytes(const AVFrame *frame)
+    {
+        if (frame == nullptr)
+        {
+            return 0;
+        }
+        const int bw = av_get_bytes_per_sample(static_cast<AVSampleFormat>(frame->format));
+        return static_cast<size_t>(frame->nb_samples) * frame->channels * bw;
+    }
+
+    /**
+     * @brief used when bounding context frame queue by duration
+     *
+     * @param frame libav frame to weigh
+     * @return decoded sample duration in microseconds, 0 for nullptr
+     */
+    size_t weigh_frame_duration(const AVFrame *frame)
+    {
+        if (frame == nullptr || frame->sample_rate <= 0)
+        {
+            return 0;
+        }
+        return static_cast<size_t>(av_rescale_q(frame->nb_samples,
+                                                AVRational{1, frame->sample_rate},
+                                                AV_TIME_BASE_Q));
+    }
+
+    /**
+     * @brief allocate pointer queue of specified implementation
+     *
+     * @param spec queue implementation and bounds
+     * @param callback default flush callback of queue
+     * @param weight weight callback used if bounded by payload
+     * @return heap allocated queue
+     */
+    template <typename T>
+    whfa::util::PQueue<T> *make_queue(const WPContext::QueueSpec &spec,
+                                      typename whfa::util::PQueue<T>::FlushCallback callback,
+                                      typename whfa::util::PQueue<T>::WeightCallback weight)
+    {
+        if (spec.bound == WPContext::QueueBound::BOUND_COUNT)
+        {
+            weight = nullptr;
+        }
+        whfa::util::PQueue<T> *q = nullptr;
+        switch (spec.type)
+        {
+        case WPContext::QueueType::SPSC_RING:
+            q = new whfa::util::SPSCPQueue<T>(spec.capacity, callback, spec.limit, weight);
+            break;
+        case WPContext::QueueType::DUAL_SPIN:
+            q = new whfa::util::DBPQueue<T, whfa::util::SpinWait<>>(spec.capacity, callback, spec.limit, weight);
+            break;
+        case WPContext::QueueType::DUAL_SPIN_FUTEX:
+            q = new whfa::util::DBPQueue<T, whfa::util::SpinFutexWait<>>(spec.capacity, callback, spec.limit, weight);
+            break;
+        case WPContext::QueueType::DUAL_BLOCKING:
+        default:
+            q = new whfa::util::DBPQueue<T>(spec.capacity, callback, spec.limit, weight);
+            break;
+        }
+        return q;
+    }
+
+    /**
+     * @brief allocate broadcast frame queue if specified
+     *
+     * @param spec queue implementation and bounds
+     * @param callback default flush callback of queue
+     * @return heap allocated queue, nullptr if spec is not a broadcast type
+     */
+    whfa::util::BPQueue<AVFrame> *make_broadcast_queue(const WPContext::QueueSpec &spec,
+                                                       whfa::util::BPQueue<AVFrame>::FlushCallback callback)
+    {
+        switch (spec.type)
+        {
+        case WPContext::QueueType::BROADCAST_BLOCKING:
+            return new whfa::util::BPQueue<AVFrame>(spec.capacity, callback, clone_frame,
+                                                    whfa::util::BPQueue<AVFrame>::SLOW_BLOCK);
+        case WPContext::QueueType::BROADCAST_DROPPING:
+            return new whfa::util::BPQueue<AVFrame>(spec.capacity, callback, clone_frame,
+                                                    whfa::util::BPQueue<AVFrame>::SLOW_DROP);
+        default:
+            return nullptr;
+        }
+    }
 }
 
 namespace whfa::pcm
@@ -79,10 +438,58 @@ namespace whfa::pcm
      * whfa::pcm::Context::Worker public methods
      */
 
-    Context::Worker::Worker(Context &context)
-        : Threader(),
-          _ctxt(&context)
+    Context::Worker::Worker(Context &context, Stage stage, util::Executor *executor)
+        : Threader(executor),
+          _ctxt(&context),
+          _stage(stage),
+          _pending_eof(false),
+          _eof_gen(0)
+    {
+    }
+
+    std::chrono::microseconds Context::Worker::get_queue_wait() const
     {
+        return is_pooled() ? util::Executor::IDLE_WAIT : CANCEL_WAIT;
+    }
+
+    /**
+     * whfa::pcm::Context::Worker protected methods
+     */
+
+    void Context::Worker::set_position(int64_t timestamp)
+    {
+        set_state_timestamp(timestamp);
+        _ctxt->_positions[_stage].timestamp.store(timestamp, std::memory_order_release);
+    }
+
+    void Context::Worker::set_pending_eof()
+    {
+        AVCodecContext *cdc_ctxt;
+        std::mutex *cdc_mtx = _ctxt->get_codec(cdc_ctxt);
+        _pending_eof = cdc_mtx != nullptr;
+        if (_pending_eof)
+        {
+            _eof_gen = _ctxt->get_codec_generation();
+            cdc_mtx->unlock();
+        }
+    }
+
+    bool Context::Worker::take_pending_eof()
+    {
+        if (!_pending_eof)
+        {
+            return false;
+        }
+        _pending_eof = false;
+        AVCodecContext *cdc_ctxt;
+        std::mutex *cdc_mtx = _ctxt->get_codec(cdc_ctxt);
+        if (cdc_mtx == nullptr)
+        {
+            return false;
+        }
+        const bool current = _ctxt->get_codec_generation() == _eof_gen;
+        cdc_mtx->unlock();
+        return current;
     }
 
     /**
@@ -104,76 +511,272 @@ namespace whfa::pcm
         avformat_network_deinit();
     }
 
+    bool Context::same_output(const StreamSpec &a, const StreamSpec &b)
+    {
+        return a.format == b.format && a.bitdepth == b.bitdepth && a.channels == b.channels && a.rate == b.rate;
+    }
+
+    bool Context::matches_frame(const StreamSpec &spec, const AVFrame &frame)
+    {
+        return frame.format == spec.format && frame.channels == spec.channels && frame.sample_rate == spec.rate;
+    }
+
+    bool Context::is_boundary(const AVPacket &packet)
+    {
+        return packet.stream_index == BOUNDARY_STREAM;
+    }
+
     /**
      * whfa::pcm::Context public methods
      */
 
-    Context::Context(size_t pkt_qcap, size_t frm_qcap)
+    Context::Context(size_t pkt_qcap, size_t frm_qcap, QueueType pkt_qtype, QueueType frm_qtype)
+        : Context({.type = pkt_qtype,
+                   .capacity = pkt_qcap,
+                   .bound = BOUND_COUNT,
+                   .limit = 0},
+                  {.type = frm_qtype,
+                   .capacity = frm_qcap,
+                   .bound = BOUND_COUNT,
+                   .limit = 0})
+    {
+    }
+
+    Context::Context(const QueueSpec &pkt_qspec, const QueueSpec &frm_qspec)
         : _fmt_ctxt(nullptr),
           _cdc_ctxt(nullptr),
           _stm_idx(-1),
-          _pkt_q(pkt_qcap, free_packet),
-          _frm_q(frm_qcap, free_frame)
+          _fmt_gen(0),
+          _cdc_gen(0),
+          _pending_cdc(nullptr),
+          _next_fmt(nullptr),
+          _next_cdc(nullptr),
+          _next_stm(-1),
+          _probe_cache(nullptr),
+          _avio(nullptr),
+          _avio_buf(nullptr),
+          _avio_bufsz(0),
+          _interrupt_cb({.callback = nullptr,
+                         .opaque = nullptr}),
+          _pkt_pool(pkt_qspec.capacity + POOL_SLACK, av_packet_alloc, av_packet_unref, free_packet),
+          _frm_pool(frm_qspec.capacity + POOL_SLACK, av_frame_alloc, av_frame_unref, free_frame),
+          _pkt_q(make_queue<AVPacket>(pkt_qspec, [this](AVPacket *packet)
+                                      { release_packet(packet); },
+                                      weigh_packet_bytes)),
+          _frm_bq(make_broadcast_queue(frm_qspec, [this](AVFrame *frame)
+                                       { release_frame(frame); })),
+          _frm_q((_frm_bq != nullptr)
+                     ? _frm_bq->subscribe()
+                     : make_queue<AVFrame>(frm_qspec, [this](AVFrame *frame)
+                                           { release_frame(frame); },
+                                           (frm_qspec.bound == BOUND_DURATION)
+                                               ? weigh_frame_duration
+                                               : weigh_frame_bytes))
     {
+        reset_positions();
     }
 
     Context::~Context()
     {
         close();
+        if (_frm_bq != nullptr)
+        {
+            // owns default consumer _frm_q
+            delete _frm_bq;
+        }
+        else
+        {
+            delete _frm_q;
+        }
+        delete _pkt_q;
+        av_free(_avio_buf);
     }
 
-    int Context::open(const char *url)
+    int Context::open(const char *url, const DecoderConfig &config)
     {
+        cancel_next();
         std::lock_guard<std::mutex> f_lk(_fmt_mtx);
         std::lock_guard<std::mutex> c_lk(_cdc_mtx);
 
-        free_context(_fmt_ctxt, _cdc_ctxt, _stm_idx);
-        _frm_q.flush();
-        _pkt_q.flush();
+        free_input();
+        _frm_q->flush();
+        _pkt_q->flush();
+        reset_positions();
 
-        int rv;
-        if ((rv = avformat_open_input(&_fmt_ctxt, url, nullptr, nullptr)) != 0)
+        const int rv = open_cached(url, _probe_cache.load(std::memory_order_acquire), config,
+                                   _fmt_ctxt, _cdc_ctxt, _stm_idx);
+        if (rv == 0)
         {
-            return rv;
+            // only applied once opened, opening is bounded by its caller rather than by workers' state
+            _fmt_ctxt->interrupt_callback = _interrupt_cb;
         }
-        if ((rv = avformat_find_stream_info(_fmt_ctxt, nullptr)) < 0)
+        return rv;
+    }
+
+    int Context::open(util::ByteSource &source, const char *name, const DecoderConfig &config)
+    {
+        cancel_next();
+        std::lock_guard<std::mutex> f_lk(_fmt_mtx);
+        std::lock_guard<std::mutex> c_lk(_cdc_mtx);
+
+        free_input();
+        _frm_q->flush();
+        _pkt_q->flush();
+        reset_positions();
+
+        if (_avio_buf == nullptr)
         {
-            free_format(_fmt_ctxt);
-            return rv;
+            _avio_buf = static_cast<uint8_t *>(av_malloc(AVIO_BUFSZ));
+            _avio_bufsz = AVIO_BUFSZ;
+            if (_avio_buf == nullptr)
+            {
+                return AVERROR(ENOMEM);
+            }
+        }
+        _avio = avio_alloc_context(_avio_buf, _avio_bufsz, 0, &source, read_source, nullptr, seek_source);
+        if (_avio == nullptr)
+        {
+            return AVERROR(ENOMEM);
         }
+        // owned (and possibly reallocated) by I/O context until freed
+        _avio_buf = nullptr;
 
-        AVCodec *codec;
-        if ((rv = av_find_best_stream(_fmt_ctxt, AVMEDIA_TYPE_AUDIO, -1, -1, &codec, 0)) < 0)
+        // byte sources are not cached, they have no stable key
+        const int rv = open_input((name == nullptr) ? "" : name, nullptr, config,
+                                  _fmt_ctxt, _cdc_ctxt, _stm_idx, _avio);
+        if (rv != 0)
         {
-            free_format(_fmt_ctxt);
+            free_avio();
             return rv;
         }
-        _stm_idx = rv;
+        _fmt_ctxt->interrupt_callback = _interrupt_cb;
+        return 0;
+    }
 
-        AVCodecParameters *params = _fmt_ctxt->streams[_stm_idx]->codecpar;
-        _cdc_ctxt = avcodec_alloc_context3(codec);
-        if ((rv = avcodec_parameters_to_context(_cdc_ctxt, params)) < 0)
+    void Context::close()
+    {
+        cancel_next();
         {
-            free_context(_fmt_ctxt, _cdc_ctxt, _stm_idx);
-            return rv;
+            std::lock_guard<std::mutex> f_lk(_fmt_mtx);
+            std::lock_guard<std::mutex> c_lk(_cdc_mtx);
+            free_input();
         }
-        if ((rv = avcodec_open2(_cdc_ctxt, codec, nullptr)) != 0)
+        _frm_q->flush();
+        _pkt_q->flush();
+    }
+
+    int Context::prepare_next(const char *url, const DecoderConfig &config)
+    {
+        AVFormatContext *fmt_ctxt = nullptr;
+        AVCodecContext *cdc_ctxt = nullptr;
+        int stm_idx = -1;
+        // probing may block on I/O, so only the prepared input is locked (briefly, once probed)
+        const int rv = open_cached(url, _probe_cache.load(std::memory_order_acquire), config,
+                                   fmt_ctxt, cdc_ctxt, stm_idx);
+        if (rv != 0)
         {
-            free_context(_fmt_ctxt, _cdc_ctxt, _stm_idx);
             return rv;
         }
+        std::lock_guard<std::mutex> n_lk(_next_mtx);
+        free_context(_next_fmt, _next_cdc, _next_stm);
+        _next_fmt = fmt_ctxt;
+        _next_cdc = cdc_ctxt;
+        _next_stm = stm_idx;
         return 0;
     }
 
-    void Context::close()
+    void Context::cancel_next()
+    {
+        std::lock_guard<std::mutex> n_lk(_next_mtx);
+        free_context(_next_fmt, _next_cdc, _next_stm);
+    }
+
+    bool Context::has_next()
     {
+        std::lock_guard<std::mutex> n_lk(_next_mtx);
+        return _next_fmt != nullptr;
+    }
+
+    bool Context::advance_format()
+    {
+        std::lock_guard<std::mutex> n_lk(_next_mtx);
+        if (_next_fmt == nullptr)
         {
-            std::lock_guard<std::mutex> f_lk(_fmt_mtx);
-            std::lock_guard<std::mutex> c_lk(_cdc_mtx);
-            free_context(_fmt_ctxt, _cdc_ctxt, _stm_idx);
+            return false;
+        }
+        std::lock_guard<std::mutex> f_lk(_fmt_mtx);
+        std::lock_guard<std::mutex> c_lk(_cdc_mtx);
+        free_format(_fmt_ctxt);
+        free_avio();
+        _fmt_ctxt = _next_fmt;
+        _stm_idx = _next_stm;
+        _fmt_ctxt->interrupt_callback = _interrupt_cb;
+        // queued packets of ended input still need the current codec
+        free_codec(_pending_cdc);
+        _pending_cdc = _next_cdc;
+        _next_fmt = nullptr;
+        _next_cdc = nullptr;
+        _next_stm = -1;
+        return true;
+    }
+
+    bool Context::has_pending_codec() const
+    {
+        return _pending_cdc != nullptr;
+    }
+
+    bool Context::advance_codec()
+    {
+        if (_pending_cdc == nullptr)
+        {
+            return false;
+        }
+        free_codec(_cdc_ctxt);
+        _cdc_ctxt = _pending_cdc;
+        _pending_cdc = nullptr;
+        ++_cdc_gen;
+        return true;
+    }
+
+    void Context::invalidate_packets()
+    {
+        _pkt_q->advance_epoch();
+        ++_fmt_gen;
+    }
+
+    void Context::invalidate_frames()
+    {
+        if (!advance_codec() && _cdc_ctxt != nullptr)
+        {
+            avcodec_flush_buffers(_cdc_ctxt);
+            ++_cdc_gen;
+        }
+        _frm_q->advance_epoch();
+    }
+
+    uint64_t Context::get_format_generation() const
+    {
+        return _fmt_gen;
+    }
+
+    uint64_t Context::get_codec_generation() const
+    {
+        return _cdc_gen;
+    }
+
+    void Context::set_probe_cache(ProbeCache *cache)
+    {
+        _probe_cache.store(cache, std::memory_order_release);
+    }
+
+    void Context::set_interrupt_callback(const AVIOInterruptCB &callback)
+    {
+        std::lock_guard<std::mutex> f_lk(_fmt_mtx);
+        _interrupt_cb = callback;
+        if (_fmt_ctxt != nullptr)
+        {
+            _fmt_ctxt->interrupt_callback = callback;
         }
-        _frm_q.flush();
-        _pkt_q.flush();
     }
 
     bool Context::get_stream_spec(StreamSpec &spec)
@@ -196,6 +799,20 @@ namespace whfa::pcm
         return rv;
     }
 
+    bool Context::get_decoder_config(DecoderConfig &config)
+    {
+        std::lock_guard<std::mutex> c_lk(_cdc_mtx);
+        if (_cdc_ctxt == nullptr)
+        {
+            return false;
+        }
+        config.threads = _cdc_ctxt->thread_count;
+        config.thread_type = _cdc_ctxt->active_thread_type;
+        config.low_delay = (_cdc_ctxt->flags & AV_CODEC_FLAG_LOW_DELAY) != 0;
+        config.skip_frame = _cdc_ctxt->skip_frame;
+        return true;
+    }
+
     std::mutex *Context::get_format(AVFormatContext *&format, int &stream_idx)
     {
         _fmt_mtx.lock();
@@ -221,14 +838,122 @@ namespace whfa::pcm
         return &_cdc_mtx;
     }
 
-    util::DBPQueue<AVPacket> &Context::get_packet_queue()
+    util::PQueue<AVPacket> &Context::get_packet_queue()
+    {
+        return *_pkt_q;
+    }
+
+    util::PQueue<AVFrame> &Context::get_frame_queue()
+    {
+        return *_frm_q;
+    }
+
+    AVPacket *Context::acquire_packet()
+    {
+        return _pkt_pool.acquire();
+    }
+
+    void Context::release_packet(AVPacket *&packet)
+    {
+        _pkt_pool.release(packet);
+        packet = nullptr;
+    }
+
+    AVFrame *Context::acquire_frame()
     {
-        return _pkt_q;
+        return _frm_pool.acquire();
     }
 
-    util::DBPQueue<AVFrame> &Context::get_frame_queue()
+    void Context::release_frame(AVFrame *&frame)
     {
-        return _frm_q;
+        _frm_pool.release(frame);
+        frame = nullptr;
+    }
+
+    void Context::get_pool_allocs(uint64_t &pkt_allocs, uint64_t &frm_allocs)
+    {
+        pkt_allocs = _pkt_pool.get_allocs();
+        frm_allocs = _frm_pool.get_allocs();
+    }
+
+    util::PQueue<AVFrame> *Context::subscribe_frame_queue()
+    {
+        return (_frm_bq == nullptr) ? nullptr : _frm_bq->subscribe();
+    }
+
+    bool Context::unsubscribe_frame_queue(util::PQueue<AVFrame> *queue)
+    {
+        if (_frm_bq == nullptr || queue == nullptr || queue == _frm_q)
+        {
+            return false;
+        }
+        return _frm_bq->unsubscribe(static_cast<util::BPQueue<AVFrame>::Consumer *>(queue));
+    }
+
+    bool Context::get_position(Position &pos) const
+    {
+        int64_t prev[NUM_STAGES];
+        int64_t cur[NUM_STAGES];
+        for (size_t s = 0; s < NUM_STAGES; ++s)
+        {
+            cur[s] = _positions[s].timestamp.load(std::memory_order_acquire);
+        }
+        bool consistent = false;
+        for (size_t i = 1; i < __POSITION_TRIES && !consistent; ++i)
+        {
+            // double collect, unchanged across two reads means no stage moved in between
+            consistent = true;
+            for (size_t s = 0; s < NUM_STAGES; ++s)
+            {
+                prev[s] = cur[s];
+                cur[s] = _positions[s].timestamp.load(std::memory_order_acquire);
+                consistent = consistent && cur[s] == prev[s];
+            }
+        }
+        pos.read = cur[STAGE_READ];
+        pos.decode = cur[STAGE_DECODE];
+        pos.output = cur[STAGE_OUTPUT];
+        return consistent;
+    }
+
+    void Context::get_queue_stats(util::QueueStats &pkt_stats, util::QueueStats &frm_stats)
+    {
+        _pkt_q->get_stats(pkt_stats);
+        _frm_q->get_stats(frm_stats);
+    }
+
+    /**
+     * whfa::pcm::Context protected methods
+     */
+
+    void Context::reset_positions()
+    {
+        for (PositionSlot &slot : _positions)
+        {
+            slot.timestamp.store(0, std::memory_order_release);
+        }
+    }
+
+    void Context::free_input()
+    {
+        ++_fmt_gen;
+        ++_cdc_gen;
+        free_context(_fmt_ctxt, _cdc_ctxt, _stm_idx);
+        free_codec(_pending_cdc);
+        free_avio();
+    }
+
+    void Context::free_avio()
+    {
+        if (_avio == nullptr)
+        {
+            return;
+        }
+        // libav may have replaced the buffer, keep whichever it holds now
+        av_free(_avio_buf);
+        _avio_buf = _avio->buffer;
+        _avio_bufsz = _avio->buffer_size;
+        avio_context_free(&_avio);
     }
 
 }
\ No newline at end of file
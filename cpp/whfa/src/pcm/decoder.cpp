@@ -5,6 +5,9 @@
 #include "pcm/decoder.h"
 #include "util/error.h"
 
+#include <algorithm>
+#include <cstdint>
+
 namespace whfa::pcm
 {
 
@@ -12,9 +15,21 @@ namespace whfa::pcm
      * whfa::pcm::Decoder public methods
      */
 
-    Decoder::Decoder(Context &context)
-        : Worker(context)
+    Decoder::Decoder(Context &context, util::Executor *executor)
+        : Worker(context, Context::STAGE_DECODE, executor),
+          _resume(false),
+          _draining(false),
+          _nheld(0),
+          _gen(0)
+    {
+        set_batch_budget(ITEM_BATCH_BUDGET);
+    }
+
+    Decoder::~Decoder()
     {
+        // a running iteration may still be pushing held frames
+        terminate();
+        release_held();
     }
 
     /**
@@ -23,21 +38,26 @@ namespace whfa::pcm
 
     void Decoder::execute_loop_body()
     {
-        util::DBPQueue<AVPacket> &pkt_queue = _ctxt->get_packet_queue();
-        util::DBPQueue<AVFrame> &frm_queue = _ctxt->get_frame_queue();
-        AVPacket *packet;
-        if (!pkt_queue.pop(packet))
+        util::PQueue<AVPacket> &pkt_queue = _ctxt->get_packet_queue();
+        util::PQueue<AVFrame> &frm_queue = _ctxt->get_frame_queue();
+        AVPacket *packet = nullptr;
+        if (!_resume)
         {
-            // due to flush, not an error state
-            return;
+            const std::chrono::steady_clock::time_point pop_start = wait_start();
+            const bool popped = pkt_queue.pop(packet, get_queue_wait());
+            count_wait(pop_start);
+            if (!popped)
+            {
+                // due to flush or wait timeout, not an error state
+                return;
+            }
         }
-        if (packet == nullptr)
+        if (packet == nullptr && !_resume)
         {
-            // EOF, stop & forward
+            // EOF, forward & stop
+            AVFrame *eof = nullptr;
+            push_n_until_cancelled(frm_queue, &eof, 1);
             set_state_stop();
-            while (!frm_queue.push(nullptr))
-            {
-            }
             return;
         }
 
@@ -45,38 +65,138 @@ namespace whfa::pcm
         std::mutex *cdc_mtx = _ctxt->get_codec(cdc_ctxt);
         if (cdc_mtx == nullptr)
         {
+            if (packet != nullptr)
+            {
+                _ctxt->release_packet(packet);
+            }
             set_state_stop(util::EINVCODEC);
             return;
         }
 
-        int rv = avcodec_send_packet(cdc_ctxt, packet);
-        if (rv == 0 || rv == AVERROR(EAGAIN))
+        const uint64_t gen = _ctxt->get_codec_generation();
+        if (gen != _gen)
+        {
+            // codec flushed or replaced by a seek or open, frames held from it and its drain are stale
+            release_held();
+            _draining = false;
+            _gen = gen;
+        }
+
+        int64_t pts = AV_NOPTS_VALUE;
+        _resume = false;
+        int rv = 0;
+        if (_nheld != 0 && !push_held(frm_queue, pts))
+        {
+            // still no room, remaining frames stay in codec until held frames are pushed
+            _resume = true;
+            rv = AVERROR(EAGAIN);
+        }
+        else if (packet != nullptr && Context::is_boundary(*packet))
+        {
+            _ctxt->release_packet(packet);
+            if (!_ctxt->has_pending_codec())
+            {
+                // switched by a seek, boundary is stale
+                cdc_mtx->unlock();
+                return;
+            }
+            // delayed frames are the tail of the ended input, dropping them would cut it short
+            // they are received like any other frames, so a full frame queue resumes draining next iteration
+            _draining = true;
+            rv = avcodec_send_packet(cdc_ctxt, nullptr);
+        }
+        else if (packet != nullptr)
+        {
+            rv = avcodec_send_packet(cdc_ctxt, packet);
+            // decoder holds its own reference to packet data
+            _ctxt->release_packet(packet);
+        }
+        if (!_resume && (rv == 0 || rv == AVERROR(EAGAIN)))
         {
             do
             {
-                AVFrame *frame = av_frame_alloc();
+                AVFrame *frame = _ctxt->acquire_frame();
                 rv = avcodec_receive_frame(cdc_ctxt, frame);
                 if (rv == 0)
                 {
-                    if (frm_queue.push(frame))
-                    {
-                        set_state_timestamp(frame->pts);
-                        frame = nullptr;
-                    }
+                    _held[_nheld++] = frame;
+                }
+                else
+                {
+                    // error or no more frames in packet
+                    _ctxt->release_frame(frame);
                 }
-                if (frame != nullptr)
+                // frames decoded from one packet are pushed together
+                if ((_nheld == MAX_FRAME_BATCH || (rv != 0 && _nheld != 0)) && !push_held(frm_queue, pts))
                 {
-                    // flush, error, or no more frames in packet
-                    av_frame_free(&frame);
+                    // frame queue full (or cancelled), resume pushing and receiving next iteration
+                    _resume = true;
+                    rv = AVERROR(EAGAIN);
                 }
             } while (rv == 0);
         }
+        if (_draining && !_resume)
+        {
+            // a drained codec reports EOF, EAGAIN means a seek already switched codecs (nothing left to drain)
+            if (rv != AVERROR(EAGAIN))
+            {
+                _ctxt->advance_codec();
+                _gen = _ctxt->get_codec_generation();
+            }
+            _draining = false;
+            rv = AVERROR(EAGAIN);
+        }
         cdc_mtx->unlock();
 
+        if (pts != AV_NOPTS_VALUE)
+        {
+            set_position(pts);
+        }
         if (rv != AVERROR(EAGAIN))
         {
             set_state_pause(rv);
         }
     }
 
+    bool Decoder::is_ready()
+    {
+        util::PQueue<AVFrame> &frm_queue = _ctxt->get_frame_queue();
+        if (_nheld != 0)
+        {
+            return frm_queue.has_room(frm_queue.weigh(_held[0]));
+        }
+        return (_resume || _ctxt->get_packet_queue().get_size() != 0) && frm_queue.has_room();
+    }
+
+    bool Decoder::push_held(util::PQueue<AVFrame> &frm_queue, int64_t &pts)
+    {
+        // pushed frames may be released by consumers, only read timestamps before pushing
+        int64_t ts[MAX_FRAME_BATCH];
+        for (size_t i = 0; i < _nheld; ++i)
+        {
+            ts[i] = _held[i]->pts;
+        }
+        const std::chrono::steady_clock::time_point push_start = wait_start();
+        // pool threads never wait on the frame queue (e.g. its weight limit), frames stay held until is_ready()
+        const size_t cnt = is_pooled() ? frm_queue.push_n(_held, _nheld, std::chrono::nanoseconds::zero())
+                                       : push_n_until_cancelled(frm_queue, _held, _nheld);
+        count_wait(push_start);
+        if (cnt != 0)
+        {
+            pts = ts[cnt - 1];
+            std::copy(&(_held[cnt]), &(_held[_nheld]), _held);
+            _nheld -= cnt;
+        }
+        return _nheld == 0;
+    }
+
+    void Decoder::release_held()
+    {
+        for (size_t i = 0; i < _nheld; ++i)
+        {
+            _ctxt->release_frame(_held[i]);
+        }
+        _nheld = 0;
+    }
+
 }
\ No newline at end of file
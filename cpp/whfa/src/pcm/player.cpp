@@ -261,15 +261,20 @@ namespace whfa::pcm
      * whfa::pcm::Player public methods
      */
 
-    Player::Player(Context &context)
-        : Worker(context),
+    Player::Player(Context &context, util::PQueue<AVFrame> *frames)
+        : Worker(context, Context::STAGE_OUTPUT),
           _dev(nullptr),
-          _writer(nullptr)
+          _frm_q((frames == nullptr) ? &(context.get_frame_queue()) : frames),
+          _writer(nullptr),
+          _configured(false),
+          _resample(DEF_RESAMPLE),
+          _latency_us(DEF_LATENCY_US)
     {
     }
 
     Player::~Player()
     {
+        terminate();
         close();
     }
 
@@ -283,6 +288,7 @@ namespace whfa::pcm
             snd_pcm_close(_dev);
         }
 
+        _configured = false;
         const int rv = snd_pcm_open(&_dev, devname, SND_PCM_STREAM_PLAYBACK, 0);
         const bool err = rv != 0;
         if (err)
@@ -297,32 +303,7 @@ namespace whfa::pcm
     bool Player::configure(bool resample, unsigned int latency_us)
     {
         std::lock_guard<std::mutex> lk(_mtx);
-
-        if (_dev == nullptr)
-        {
-            return false;
-        }
-
-        if (!_ctxt->get_stream_spec(_spec))
-        {
-            set_state_stop(util::EINVSTREAM);
-            return false;
-        }
-
-        if (_writer != nullptr)
-        {
-            delete _writer;
-        }
-        _writer = get_dev_writer(_dev, _spec);
-
-        const int rv = configure_dev(_dev, _spec, resample, latency_us);
-        if (rv != 0)
-        {
-            set_state_stop(rv);
-            return false;
-        }
-
-        return true;
+        return configure_dev_locked(resample, latency_us);
     }
 
     void Player::close()
@@ -342,6 +323,7 @@ namespace whfa::pcm
             rv |= snd_pcm_close(_dev);
             _dev = nullptr;
         }
+        _configured = false;
         set_state_stop(rv);
     }
 
@@ -351,17 +333,46 @@ namespace whfa::pcm
 
     void Player::execute_loop_body()
     {
+        {
+            // check device before popping, so frames and EOF stay queued while no device is open
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (_dev == nullptr)
+            {
+                set_state_stop();
+                return;
+            }
+            if (take_pending_eof())
+            {
+                // EOF popped while no device was open, drain and stop
+                set_state_stop(snd_pcm_drain(_dev));
+                return;
+            }
+        }
 
-        if (_dev == nullptr)
+        AVFrame *frame;
+        const std::chrono::steady_clock::time_point pop_start = wait_start();
+        const bool popped = _frm_q->pop(frame, get_queue_wait());
+        count_wait(pop_start);
+        if (!popped)
         {
-            set_state_stop();
+            // due to flush or wait timeout, not an error state
             return;
         }
 
-        AVFrame *frame;
-        if (!_ctxt->get_frame_queue().pop(frame))
+        // device is only held while writing, so waiting on the frame queue never blocks open or close
+        std::lock_guard<std::mutex> lk(_mtx);
+        if (_dev == nullptr)
         {
-            // due to flush, not an error state
+            // closed while waiting, EOF is kept for the next device
+            if (frame == nullptr)
+            {
+                set_pending_eof();
+            }
+            else
+            {
+                _ctxt->release_frame(frame);
+            }
+            set_state_stop();
             return;
         }
         if (frame == nullptr)
@@ -370,14 +381,61 @@ namespace whfa::pcm
             set_state_stop(snd_pcm_drain(_dev));
             return;
         }
+        if (!Context::matches_frame(_spec, *frame) && !configure_dev_locked(_resample, _latency_us))
+        {
+            // failure sets error state
+            _ctxt->release_frame(frame);
+            return;
+        }
 
         const int rv = _writer->handle(*frame);
-        set_state_timestamp(frame->pts);
-        av_frame_free(&frame);
+        set_position(frame->pts);
+        _ctxt->release_frame(frame);
         if (rv != 0)
         {
             set_state_pause(rv);
         }
     }
 
+    bool Player::configure_dev_locked(bool resample, unsigned int latency_us)
+    {
+        if (_dev == nullptr)
+        {
+            return false;
+        }
+
+        Context::StreamSpec spec;
+        if (!_ctxt->get_stream_spec(spec))
+        {
+            set_state_stop(util::EINVSTREAM);
+            return false;
+        }
+        if (_configured && resample == _resample && latency_us == _latency_us && Context::same_output(spec, _spec))
+        {
+            // draining would leave a gap between inputs the device can already play
+            _spec = spec;
+            return true;
+        }
+        _spec = spec;
+        _resample = resample;
+        _latency_us = latency_us;
+        _configured = false;
+
+        if (_writer != nullptr)
+        {
+            delete _writer;
+        }
+        _writer = get_dev_writer(_dev, _spec);
+
+        const int rv = configure_dev(_dev, _spec, resample, latency_us);
+        if (rv != 0)
+        {
+            set_state_stop(rv);
+            return false;
+        }
+
+        _configured = true;
+        return true;
+    }
+
 }
\ No newline at end of file
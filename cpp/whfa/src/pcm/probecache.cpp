@@ -0,0 +1,142 @@
+/**
+ * @file pcm/probecache.cpp
+ * @author Robert Griffith
+ */
+#include "pcm/probecache.h"
+
+#include <cstring>
+#include <fstream>
+#include <sstream>
+
+#include <sys/stat.h>
+
+namespace
+{
+
+    /// @brief separator of fields in cache file lines
+    constexpr char __FIELD_SEP = '\t';
+    /// @brief url prefix of local files
+    constexpr const char *__FILE_PROTOCOL = "file:";
+
+    /**
+     * @brief parse cache file line
+     *
+     * @param line line to parse
+     * @param[out] key cache key
+     * @param[out] entry cached parameters
+     * @return false if malformed
+     */
+    bool parse_line(const std::string &line, std::string &key, whfa::pcm::ProbeCache::Entry &entry)
+    {
+        std::istringstream iss(line);
+        if (!std::getline(iss, key, __FIELD_SEP) || key.empty() ||
+            !std::getline(iss, entry.format_name, __FIELD_SEP) || entry.format_name.empty())
+        {
+            return false;
+        }
+        iss >> entry.stream_idx >> entry.codec_id >> entry.sample_format >> entry.bitdepth >>
+            entry.channels >> entry.channel_layout >> entry.rate >> entry.block_align >> entry.frame_size >>
+            entry.timebase_num >> entry.timebase_den >> entry.duration;
+        return !iss.fail() && entry.stream_idx >= 0 && entry.timebase_den != 0;
+    }
+
+}
+
+namespace whfa::pcm
+{
+
+    /**
+     * whfa::pcm::ProbeCache static public methods
+     */
+
+    bool ProbeCache::make_key(const char *url, std::string &key)
+    {
+        if (url == nullptr || strchr(url, __FIELD_SEP) != nullptr || strchr(url, '\n') != nullptr)
+        {
+            return false;
+        }
+        const size_t plen = strlen(__FILE_PROTOCOL);
+        const bool file = strncmp(url, __FILE_PROTOCOL, plen) == 0;
+        if (!file && strstr(url, "://") != nullptr)
+        {
+            // remote, contents cannot be checked without reading them
+            key = url;
+            return true;
+        }
+
+        const char *path = file ? url + plen : url;
+        struct stat st;
+        if (stat(path, &st) != 0)
+        {
+            return false;
+        }
+        std::ostringstream oss;
+        oss << path << '|' << st.st_size << '|' << st.st_mtim.tv_sec << '.' << st.st_mtim.tv_nsec;
+        key = oss.str();
+        return true;
+    }
+
+    /**
+     * whfa::pcm::ProbeCache public methods
+     */
+
+    ProbeCache::ProbeCache(const char *path)
+        : _path(path)
+    {
+        std::ifstream ifs(_path);
+        std::string line;
+        std::string key;
+        Entry entry;
+        while (std::getline(ifs, line))
+        {
+            if (parse_line(line, key, entry))
+            {
+                _entries[key] = entry;
+            }
+        }
+    }
+
+    bool ProbeCache::lookup(const char *url, Entry &entry)
+    {
+        std::string key;
+        if (!make_key(url, key))
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lk(_mtx);
+        const std::unordered_map<std::string, Entry>::const_iterator it = _entries.find(key);
+        if (it == _entries.end())
+        {
+            return false;
+        }
+        entry = it->second;
+        return true;
+    }
+
+    bool ProbeCache::store(const char *url, const Entry &entry)
+    {
+        std::string key;
+        if (!make_key(url, key) || entry.format_name.empty() ||
+            entry.format_name.find_first_of("\t\n") != std::string::npos)
+        {
+            return false;
+        }
+        std::lock_guard<std::mutex> lk(_mtx);
+        _entries[key] = entry;
+
+        std::ofstream ofs(_path, std::ios::app);
+        ofs << key << __FIELD_SEP << entry.format_name << __FIELD_SEP
+            << entry.stream_idx << ' ' << entry.codec_id << ' ' << entry.sample_format << ' '
+            << entry.bitdepth << ' ' << entry.channels << ' ' << entry.channel_layout << ' '
+            << entry.rate << ' ' << entry.block_align << ' ' << entry.frame_size << ' '
+            << entry.timebase_num << ' ' << entry.timebase_den << ' ' << entry.duration << '\n';
+        return static_cast<bool>(ofs);
+    }
+
+    size_t ProbeCache::get_size()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        return _entries.size();
+    }
+
+}
\ No newline at end of file
@@ -23,9 +23,28 @@ namespace whfa::pcm
      * whfa::pcm::Reader public methods
      */
 
-    Reader::Reader(Context &context)
-        : Worker(context)
+    Reader::Reader(Context &context, util::Executor *executor)
+        : Worker(context, Context::STAGE_READ, executor),
+          _interrupts(0),
+          _boundary(false),
+          _held(nullptr),
+          _held_gen(0)
     {
+        set_batch_budget(ITEM_BATCH_BUDGET);
+        _ctxt->set_interrupt_callback({.callback = interrupt,
+                                       .opaque = this});
+    }
+
+    Reader::~Reader()
+    {
+        // interrupt a blocked read and wait for the loop body before the callback and held packet are removed
+        terminate();
+        _ctxt->set_interrupt_callback({.callback = nullptr,
+                                       .opaque = nullptr});
+        if (_held != nullptr)
+        {
+            _ctxt->release_packet(_held);
+        }
     }
 
     bool Reader::seek(int64_t pos_pts)
@@ -36,7 +55,10 @@ namespace whfa::pcm
 
         AVFormatContext *fmt_ctxt;
         int s_idx;
+        // interrupt a blocked read so seeking never waits on a stalled input
+        _interrupts.fetch_add(1, std::memory_order_acq_rel);
         std::mutex *fmt_mtx = _ctxt->get_format(fmt_ctxt, s_idx);
+        _interrupts.fetch_sub(1, std::memory_order_acq_rel);
         if (fmt_mtx == nullptr)
         {
             err = util::EINVFORMAT;
@@ -50,28 +72,17 @@ namespace whfa::pcm
             const int64_t clip_pts = min_i64(max_i64(conv_pts, 0), dur_pts);
             const int flags = (clip_pts < get_state().timestamp) ? AVSEEK_FLAG_BACKWARD : 0;
             const int rv = av_seek_frame(fmt_ctxt, s_idx, clip_pts, flags);
-            _ctxt->get_packet_queue().flush();
+            _ctxt->invalidate_packets();
             fmt_mtx->unlock();
 
             if (rv < 0)
             {
                 err = rv;
             }
-            else
+            else if (!reset_codec())
             {
-                AVCodecContext *cdc_ctxt;
-                std::mutex *cdc_mtx = _ctxt->get_codec(cdc_ctxt);
-                if (cdc_mtx == nullptr)
-                {
-                    err = util::EINVCODEC;
-                    stop = true;
-                }
-                else
-                {
-                    avcodec_flush_buffers(cdc_ctxt);
-                    _ctxt->get_frame_queue().flush();
-                    cdc_mtx->unlock();
-                }
+                err = util::EINVCODEC;
+                stop = true;
             }
         }
         if (err != 0)
@@ -97,7 +108,10 @@ namespace whfa::pcm
 
         AVFormatContext *fmt_ctxt;
         int s_idx;
+        // interrupt a blocked read so seeking never waits on a stalled input
+        _interrupts.fetch_add(1, std::memory_order_acq_rel);
         std::mutex *fmt_mtx = _ctxt->get_format(fmt_ctxt, s_idx);
+        _interrupts.fetch_sub(1, std::memory_order_acq_rel);
         if (fmt_mtx == nullptr)
         {
             err = util::EINVFORMAT;
@@ -110,28 +124,17 @@ namespace whfa::pcm
             const int64_t clip_pts = min_i64(max_i64(conv_pts, 0), dur_pts);
             const int flags = (clip_pts < get_state().timestamp) ? AVSEEK_FLAG_BACKWARD : 0;
             const int rv = av_seek_frame(fmt_ctxt, s_idx, clip_pts, flags);
-            _ctxt->get_packet_queue().flush();
+            _ctxt->invalidate_packets();
             fmt_mtx->unlock();
 
             if (rv < 0)
             {
                 err = rv;
             }
-            else
+            else if (!reset_codec())
             {
-                AVCodecContext *cdc_ctxt;
-                std::mutex *cdc_mtx = _ctxt->get_codec(cdc_ctxt);
-                if (cdc_mtx == nullptr)
-                {
-                    err = util::EINVCODEC;
-                    stop = true;
-                }
-                else
-                {
-                    avcodec_flush_buffers(cdc_ctxt);
-                    _ctxt->get_frame_queue().flush();
-                    cdc_mtx->unlock();
-                }
+                err = util::EINVCODEC;
+                stop = true;
             }
         }
         if (err != 0)
@@ -155,7 +158,11 @@ namespace whfa::pcm
 
     void Reader::execute_loop_body()
     {
-        util::DBPQueue<AVPacket> &pkt_queue = _ctxt->get_packet_queue();
+        util::PQueue<AVPacket> &pkt_queue = _ctxt->get_packet_queue();
+        if (_boundary && !push_boundary(pkt_queue))
+        {
+            return;
+        }
 
         std::mutex *fmt_mtx;
         AVFormatContext *fmt_ctxt;
@@ -167,39 +174,140 @@ namespace whfa::pcm
             return;
         }
 
-        AVPacket *packet = av_packet_alloc();
-        int rv;
-        while ((rv = av_read_frame(fmt_ctxt, packet)) == 0)
+        int rv = 0;
+        AVPacket *packet = _held;
+        _held = nullptr;
+        if (packet != nullptr && _held_gen != _ctxt->get_format_generation())
+        {
+            // read before a seek or reopen
+            _ctxt->release_packet(packet);
+            packet = nullptr;
+        }
+        if (packet != nullptr)
+        {
+            push_packet(pkt_queue, packet);
+        }
+        else if ((packet = _ctxt->acquire_packet()) == nullptr)
+        {
+            // out of memory, reported without changing run state, read retried next iteration
+            fmt_mtx->unlock();
+            set_state_error(AVERROR(ENOMEM));
+            return;
+        }
+        else
         {
-            if (packet->stream_index == s_idx)
+            while ((rv = av_read_frame(fmt_ctxt, packet)) == 0)
             {
-                if (pkt_queue.push(packet))
+                if (packet->stream_index == s_idx)
                 {
-                    set_state_timestamp(packet->pts + packet->duration);
-                    packet = nullptr;
+                    push_packet(pkt_queue, packet);
+                    break;
                 }
-                break;
+                // reuse packet for next read
+                av_packet_unref(packet);
             }
         }
         fmt_mtx->unlock();
 
         if (packet != nullptr)
         {
-            // flush or no desired packet found, not an error state
-            av_packet_free(&packet);
+            // flush, cancellation, or no desired packet found, not an error state
+            _ctxt->release_packet(packet);
+        }
+        if (rv == AVERROR_EOF && _ctxt->advance_format())
+        {
+            // gapless, next input is read once decoder knows where to switch codecs
+            _boundary = true;
+            push_boundary(pkt_queue);
         }
-        if (rv == AVERROR_EOF)
+        else if (rv == AVERROR_EOF)
         {
-            // EOF, stop and forward
+            // EOF, forward and stop
+            AVPacket *eof = nullptr;
+            push_n_until_cancelled(pkt_queue, &eof, 1);
             set_state_stop();
-            while (!pkt_queue.push(nullptr))
-            {
-            }
         }
-        else if (rv != 0)
+        else if (rv != 0 && rv != AVERROR_EXIT)
         {
+            // interrupted reads (AVERROR_EXIT) are due to stop, pause, or seek, not an error state
             set_state_pause(rv);
         }
     }
 
+    bool Reader::reset_codec()
+    {
+        AVCodecContext *cdc_ctxt;
+        std::mutex *cdc_mtx = _ctxt->get_codec(cdc_ctxt);
+        if (cdc_mtx == nullptr)
+        {
+            return false;
+        }
+        // boundary packet may be discarded with the packets of the ended input, so its codec
+        // is switched here rather than by the decoder
+        _ctxt->invalidate_frames();
+        cdc_mtx->unlock();
+        // pooled workers parked on full queues must poll again to discard the invalidated elements
+        notify_ready();
+        return true;
+    }
+
+    bool Reader::is_ready()
+    {
+        util::PQueue<AVPacket> &pkt_queue = _ctxt->get_packet_queue();
+        return pkt_queue.has_room((_held == nullptr) ? 0 : pkt_queue.weigh(_held));
+    }
+
+    void Reader::push_packet(util::PQueue<AVPacket> &pkt_queue, AVPacket *&packet)
+    {
+        if (is_pooled() && !pkt_queue.has_room(pkt_queue.weigh(packet)))
+        {
+            // weight limit reached, pool threads never wait on it, so held until is_ready() sees room
+            _held = packet;
+            _held_gen = _ctxt->get_format_generation();
+            packet = nullptr;
+            return;
+        }
+        // pushed packet may be released by consumer, only read timestamp before pushing
+        const int64_t ts = packet->pts + packet->duration;
+        const std::chrono::steady_clock::time_point push_start = wait_start();
+        const bool pushed = push_n_until_cancelled(pkt_queue, &packet, 1) == 1;
+        count_wait(push_start);
+        if (pushed)
+        {
+            set_position(ts);
+            packet = nullptr;
+        }
+    }
+
+    bool Reader::push_boundary(util::PQueue<AVPacket> &pkt_queue)
+    {
+        AVPacket *boundary = _ctxt->acquire_packet();
+        if (boundary == nullptr)
+        {
+            set_state_error(AVERROR(ENOMEM));
+            return false;
+        }
+        boundary->stream_index = Context::BOUNDARY_STREAM;
+        if (push_n_until_cancelled(pkt_queue, &boundary, 1) != 1)
+        {
+            _ctxt->release_packet(boundary);
+            return false;
+        }
+        _boundary = false;
+        return true;
+    }
+
+    /**
+     * whfa::pcm::Reader static protected methods
+     */
+
+    int Reader::interrupt(void *opaque)
+    {
+        const Reader *reader = static_cast<const Reader *>(opaque);
+        return (reader->get_cancel_token().is_cancelled() ||
+                reader->_interrupts.load(std::memory_order_acquire) != 0)
+                   ? 1
+                   : 0;
+    }
+
 }
\ No newline at end of file
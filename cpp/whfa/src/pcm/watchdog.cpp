@@ -0,0 +1,229 @@
+/**
+ * @file pcm/watchdog.cpp
+ * @author Robert Griffith
+ */
+#include "pcm/watchdog.h"
+
+#include <limits>
+
+#include <poll.h>
+
+namespace
+{
+
+    /// @brief weight of newest sample in smoothed buffer trend
+    constexpr double __TREND_WEIGHT = 0.25;
+    /// @brief max seconds per second buffer drains at by playback alone, faster drops are seeks or flushes
+    constexpr double __MAX_DRAIN = 2.0;
+
+    /**
+     * @brief check if worker is running
+     *
+     * @param worker worker to check
+     * @return true if running
+     */
+    bool is_running(const whfa::util::Threader *worker)
+    {
+        whfa::util::Threader::State state;
+        worker->get_state(state);
+        return state.run;
+    }
+
+    /**
+     * @brief convert seconds to milliseconds, saturating
+     *
+     * @param seconds seconds to convert
+     * @return milliseconds
+     */
+    std::chrono::milliseconds to_millis(double seconds)
+    {
+        const double ms = seconds * 1000.0;
+        if (!(ms < static_cast<double>(std::numeric_limits<int64_t>::max())))
+        {
+            return std::chrono::milliseconds::max();
+        }
+        return std::chrono::milliseconds(static_cast<int64_t>(ms));
+    }
+
+}
+
+namespace whfa::pcm
+{
+
+    /**
+     * whfa::pcm::Watchdog::EventHandler public methods
+     */
+
+    Watchdog::EventHandler::~EventHandler()
+    {
+    }
+
+    /**
+     * whfa::pcm::Watchdog public methods
+     */
+
+    Watchdog::Watchdog(Context &context, const Config &config)
+        : Threader(),
+          _ctxt(&context),
+          _config(config),
+          _workers(),
+          _evt_handler(nullptr),
+          _timebase(0),
+          _sampled(false),
+          _prev_buffered(0),
+          _buffered(0),
+          _trend(0),
+          _starving(false),
+          _stalled()
+    {
+    }
+
+    Watchdog::~Watchdog()
+    {
+        // wake from interval wait and wait for it to return, handler may be destroyed after watchdog
+        terminate();
+        std::lock_guard<std::mutex> lk(_mtx);
+        _evt_handler = nullptr;
+    }
+
+    void Watchdog::watch(Context::Stage stage, const util::Threader *worker)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _workers[stage] = worker;
+        _stalled[stage] = false;
+    }
+
+    void Watchdog::set_event_handler(EventHandler *handler)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _evt_handler = handler;
+    }
+
+    bool Watchdog::configure()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        _sampled = false;
+        _trend = 0;
+        _starving = false;
+
+        Context::StreamSpec spec;
+        if (!_ctxt->get_stream_spec(spec))
+        {
+            _timebase = 0;
+            set_state_stop(util::EINVSTREAM);
+            return false;
+        }
+        _timebase = av_q2d(spec.timebase);
+        return true;
+    }
+
+    /**
+     * whfa::pcm::Watchdog protected methods
+     */
+
+    void Watchdog::execute_loop_body()
+    {
+        // cancelled on stop or pause, so waiting never delays them
+        pollfd pfd = {.fd = get_cancel_token().get_fd(),
+                      .events = POLLIN,
+                      .revents = 0};
+        poll(&pfd, 1, static_cast<int>(_config.interval.count()));
+        if (get_cancel_token().is_cancelled())
+        {
+            return;
+        }
+
+        std::lock_guard<std::mutex> lk(_mtx);
+        const util::Threader *output = _workers[Context::STAGE_OUTPUT];
+        const util::Threader *reader = _workers[Context::STAGE_READ];
+        if (_timebase == 0 || (output != nullptr && !is_running(output)))
+        {
+            // not draining while output is paused or stopped, trend restarts once it resumes
+            _sampled = false;
+            return;
+        }
+
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        Context::Position pos;
+        _ctxt->get_position(pos);
+        sample_buffer(now, pos, reader == nullptr || is_running(reader));
+        sample_progress(now);
+    }
+
+    void Watchdog::sample_buffer(std::chrono::steady_clock::time_point now, const Context::Position &pos, bool reading)
+    {
+        const double buffered = static_cast<double>(pos.read - pos.output) * _timebase;
+        if (pos.output == 0 || buffered < 0)
+        {
+            // nothing output yet, or read position moved behind output (seek)
+            _sampled = false;
+            return;
+        }
+        _buffered = buffered;
+        if (!_sampled)
+        {
+            _sampled = true;
+            _prev_time = now;
+            _prev_buffered = buffered;
+            return;
+        }
+
+        const double elapsed = std::chrono::duration<double>(now - _prev_time).count();
+        const double slope = (buffered - _prev_buffered) / elapsed;
+        _prev_time = now;
+        _prev_buffered = buffered;
+        if (elapsed <= 0 || slope < -__MAX_DRAIN)
+        {
+            // seek or flush, previous trend no longer applies
+            _trend = 0;
+            return;
+        }
+        _trend += __TREND_WEIGHT * (slope - _trend);
+
+        const double starvation = std::chrono::duration<double>(_config.starvation).count();
+        const double tte = (_trend < 0) ? buffered / -_trend : std::numeric_limits<double>::infinity();
+        if (!_starving && reading && tte < starvation)
+        {
+            _starving = true;
+            emit(EVENT_STARVING, Context::STAGE_OUTPUT);
+        }
+        else if (_starving && tte >= starvation * 2)
+        {
+            _starving = false;
+            emit(EVENT_BUFFERED, Context::STAGE_OUTPUT);
+        }
+    }
+
+    void Watchdog::sample_progress(std::chrono::steady_clock::time_point now)
+    {
+        for (size_t s = 0; s < Context::NUM_STAGES; ++s)
+        {
+            const util::Threader *worker = _workers[s];
+            if (worker == nullptr)
+            {
+                continue;
+            }
+            const bool stalled = is_running(worker) && now - worker->get_progress_time() >= _config.stall;
+            if (stalled != _stalled[s])
+            {
+                _stalled[s] = stalled;
+                emit(stalled ? EVENT_STALLED : EVENT_RESUMED, static_cast<Context::Stage>(s));
+            }
+        }
+    }
+
+    void Watchdog::emit(EventType type, Context::Stage stage)
+    {
+        if (_evt_handler == nullptr)
+        {
+            return;
+        }
+        const Event event = {.type = type,
+                             .stage = stage,
+                             .buffered = to_millis(_buffered),
+                             .time_to_empty = to_millis((_trend < 0) ? _buffered / -_trend
+                                                                     : std::numeric_limits<double>::infinity())};
+        _evt_handler->handle(event);
+    }
+
+}
\ No newline at end of file
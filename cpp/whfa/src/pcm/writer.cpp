@@ -445,15 +445,18 @@ namespace whfa::pcm
      * whfa::pcm::Writer public methods
      */
 
-    Writer::Writer(Context &context)
-        : Worker(context),
+    Writer::Writer(Context &context, util::PQueue<AVFrame> *frames, util::Executor *executor)
+        : Worker(context, Context::STAGE_OUTPUT, executor),
           _mode(OutputType::FILE_RAW),
+          _frm_q((frames == nullptr) ? &(context.get_frame_queue()) : frames),
           _writer(nullptr)
     {
+        set_batch_budget(ITEM_BATCH_BUDGET);
     }
 
     Writer::~Writer()
     {
+        terminate();
         close();
     }
 
@@ -512,21 +515,52 @@ namespace whfa::pcm
 
     void Writer::execute_loop_body()
     {
-        if (!_ofs.is_open())
         {
-            set_state_stop();
-            return;
+            // check file before popping, so frames and EOF stay queued while no file can be written
+            std::lock_guard<std::mutex> lk(_mtx);
+            if (!_ofs.is_open())
+            {
+                set_state_stop();
+                return;
+            }
+            else if (!_ofs)
+            {
+                set_state_pause(_ofs.rdstate());
+                return;
+            }
+            if (take_pending_eof())
+            {
+                // EOF popped while no file was open, stop and close
+                set_state_stop();
+                _ofs.close();
+                return;
+            }
         }
-        else if (!_ofs)
+
+        AVFrame *frame;
+        const std::chrono::steady_clock::time_point pop_start = wait_start();
+        const bool popped = _frm_q->pop(frame, get_queue_wait());
+        count_wait(pop_start);
+        if (!popped)
         {
-            set_state_pause(_ofs.rdstate());
+            // due to flush or wait timeout, not an error state
             return;
         }
 
-        AVFrame *frame;
-        if (!_ctxt->get_frame_queue().pop(frame))
+        // file is only held while writing, so waiting on the frame queue never blocks open or close
+        std::lock_guard<std::mutex> lk(_mtx);
+        if (!_ofs.is_open())
         {
-            // due to flush, not an error state
+            // closed while waiting, EOF is kept for the next file
+            if (frame == nullptr)
+            {
+                set_pending_eof();
+            }
+            else
+            {
+                _ctxt->release_frame(frame);
+            }
+            set_state_stop();
             return;
         }
         if (frame == nullptr)
@@ -536,14 +570,28 @@ namespace whfa::pcm
             _ofs.close();
             return;
         }
+        if (!Context::matches_frame(_spec, *frame))
+        {
+            // next input decodes to a different format than the file holds
+            _ctxt->release_frame(frame);
+            set_state_stop(util::EINVSTREAM);
+            _ofs.close();
+            return;
+        }
 
         const int rv = _writer->handle(*frame);
-        set_state_timestamp(frame->pts);
-        av_frame_free(&frame);
+        set_position(frame->pts);
+        _ctxt->release_frame(frame);
         if (rv != 0)
         {
             set_state_pause(rv);
         }
     }
 
+    bool Writer::is_ready()
+    {
+        // is_ready() and the loop body never run concurrently, so the pending EOF needs no lock
+        return _pending_eof || _frm_q->get_size() != 0;
+    }
+
 }
\ No newline at end of file
@@ -0,0 +1,71 @@
+/**
+ * @file util/canceltoken.cpp
+ * @author Robert Griffith
+ */
+#include "util/canceltoken.h"
+
+#include <cerrno>
+#include <cstdint>
+
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+namespace whfa::util
+{
+
+    /**
+     * whfa::util::CancelToken public methods
+     */
+
+    CancelToken::CancelToken()
+        : _cancelled(false),
+          _fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK))
+    {
+    }
+
+    CancelToken::~CancelToken()
+    {
+        if (_fd >= 0)
+        {
+            ::close(_fd);
+        }
+    }
+
+    void CancelToken::cancel()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        if (_cancelled.exchange(true, std::memory_order_seq_cst) || _fd < 0)
+        {
+            return;
+        }
+        const uint64_t one = 1;
+        // nonblocking, only fails if count would overflow
+        while (write(_fd, &one, sizeof(one)) < 0 && errno == EINTR)
+        {
+        }
+    }
+
+    void CancelToken::reset()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        if (!_cancelled.exchange(false, std::memory_order_seq_cst) || _fd < 0)
+        {
+            return;
+        }
+        uint64_t count;
+        while (read(_fd, &count, sizeof(count)) < 0 && errno == EINTR)
+        {
+        }
+    }
+
+    bool CancelToken::is_cancelled() const
+    {
+        return _cancelled.load(std::memory_order_acquire);
+    }
+
+    int CancelToken::get_fd() const
+    {
+        return _fd;
+    }
+
+}
\ No newline at end of file
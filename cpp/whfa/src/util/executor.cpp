@@ -0,0 +1,205 @@
+/**
+ * @file util/executor.cpp
+ * @author Robert Griffith
+ */
+#include "util/executor.h"
+
+#include <algorithm>
+
+namespace whfa::util
+{
+
+    /**
+     * whfa::util::Executor::Task public methods
+     */
+
+    Executor::Task::~Task()
+    {
+    }
+
+    /**
+     * whfa::util::Executor public methods
+     */
+
+    Executor::Executor(size_t nthreads)
+        : _lanes(std::max<size_t>((nthreads == 0) ? std::thread::hardware_concurrency() : nthreads, 1)),
+          _next(0),
+          _ntasks(0),
+          _nwait(0),
+          _npark(0),
+          _wakes(0),
+          _terminate(false)
+    {
+        _threads.reserve(_lanes.size());
+        for (size_t i = 0; i < _lanes.size(); ++i)
+        {
+            _threads.emplace_back(&Executor::execute_loop, this, i);
+        }
+    }
+
+    Executor::~Executor()
+    {
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _terminate = true;
+        }
+        _cond.notify_all();
+        _park_cond.notify_all();
+        for (std::thread &t : _threads)
+        {
+            t.join();
+        }
+    }
+
+    void Executor::submit(Task *task)
+    {
+        enqueue(_next.fetch_add(1, std::memory_order_relaxed) % _lanes.size(), task);
+        // lane may belong to a parked thread
+        wake();
+    }
+
+    void Executor::wake()
+    {
+        _wakes.fetch_add(1, std::memory_order_seq_cst);
+        if (_npark.load(std::memory_order_seq_cst) != 0)
+        {
+            // parked threads check _wakes under _mtx, so locking prevents a lost wakeup
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+            }
+            _park_cond.notify_all();
+        }
+    }
+
+    size_t Executor::get_num_threads() const
+    {
+        return _threads.size();
+    }
+
+    /**
+     * whfa::util::Executor protected methods
+     */
+
+    void Executor::execute_loop(size_t idx)
+    {
+        // number of consecutive idle tasks run, parking once a full lane of tasks was idle
+        size_t idle = 0;
+        size_t nlocal = 0;
+        // wakes seen before polling the current run of idle tasks
+        uint64_t wakes = _wakes.load(std::memory_order_seq_cst);
+        while (true)
+        {
+            Task *task = take(idx, nlocal);
+            if (task == nullptr)
+            {
+                std::unique_lock<std::mutex> lk(_mtx);
+                _nwait.fetch_add(1, std::memory_order_seq_cst);
+                _cond.wait(lk, [&]
+                           { return _terminate || _ntasks.load(std::memory_order_seq_cst) != 0; });
+                _nwait.fetch_sub(1, std::memory_order_seq_cst);
+                idle = 0;
+                wakes = _wakes.load(std::memory_order_seq_cst);
+                if (_terminate)
+                {
+                    return;
+                }
+                continue;
+            }
+            if (idle > nlocal)
+            {
+                // still own the task while parked
+                enqueue(idx, task);
+                std::unique_lock<std::mutex> lk(_mtx);
+                if (_wakes.load(std::memory_order_seq_cst) == wakes)
+                {
+                    // nothing did work since polling began, so only a wake can make these tasks ready
+                    _npark.fetch_add(1, std::memory_order_seq_cst);
+                    _park_cond.wait_for(lk, IDLE_PARK, [&]
+                                        { return _terminate || _wakes.load(std::memory_order_seq_cst) != wakes; });
+                    _npark.fetch_sub(1, std::memory_order_seq_cst);
+                }
+                else
+                {
+                    // other tasks are doing work, back off briefly before polling again
+                    _park_cond.wait_for(lk, IDLE_WAIT, [&]
+                                        { return _terminate; });
+                }
+                idle = 0;
+                wakes = _wakes.load(std::memory_order_seq_cst);
+                if (_terminate)
+                {
+                    return;
+                }
+                continue;
+            }
+
+            switch (task->run())
+            {
+            case Task::TASK_DONE:
+                idle = 0;
+                break;
+            case Task::TASK_IDLE:
+                idle++;
+                enqueue(idx, task);
+                break;
+            case Task::TASK_AGAIN:
+            default:
+                idle = 0;
+                enqueue(idx, task);
+                // work done may have made parked tasks ready (e.g. popping makes room for a producer)
+                wake();
+                wakes = _wakes.load(std::memory_order_seq_cst);
+                break;
+            }
+        }
+    }
+
+    Executor::Task *Executor::take(size_t idx, size_t &nlocal)
+    {
+        Task *task = nullptr;
+        nlocal = 0;
+        for (size_t i = 0; i < _lanes.size() && task == nullptr; ++i)
+        {
+            Lane &lane = _lanes[(idx + i) % _lanes.size()];
+            std::lock_guard<std::mutex> lk(lane.mtx);
+            if (!lane.tasks.empty())
+            {
+                if (i == 0)
+                {
+                    nlocal = lane.tasks.size();
+                    task = lane.tasks.front();
+                    lane.tasks.pop_front();
+                }
+                else
+                {
+                    // steal from back, furthest from the owner's next task
+                    task = lane.tasks.back();
+                    lane.tasks.pop_back();
+                }
+            }
+        }
+        if (task != nullptr)
+        {
+            _ntasks.fetch_sub(1, std::memory_order_seq_cst);
+        }
+        return task;
+    }
+
+    void Executor::enqueue(size_t idx, Task *task)
+    {
+        {
+            std::lock_guard<std::mutex> lk(_lanes[idx].mtx);
+            _lanes[idx].tasks.push_back(task);
+        }
+        _ntasks.fetch_add(1, std::memory_order_seq_cst);
+        if (_nwait.load(std::memory_order_seq_cst) != 0)
+        {
+            // waiting threads check _ntasks under _mtx, so locking prevents a lost wakeup
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+            }
+            _cond.notify_one();
+        }
+    }
+
+}
\ No newline at end of file
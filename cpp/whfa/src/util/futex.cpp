@@ -0,0 +1,58 @@
+/**
+ * @file util/futex.cpp
+ * @author Robert Griffith
+ */
+#include "util/futex.h"
+
+#include <cerrno>
+#include <climits>
+#include <ctime>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+namespace
+{
+
+    /**
+     * @brief get address of atomic futex word for syscall use
+     *
+     * @param word atomic futex word
+     * @return address of underlying 32-bit integer
+     */
+    inline uint32_t *word_addr(std::atomic<uint32_t> &word)
+    {
+        static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t),
+                      "futex word must be a plain 32-bit integer");
+        return reinterpret_cast<uint32_t *>(&word);
+    }
+
+}
+
+namespace whfa::util
+{
+
+    bool futex_wait(std::atomic<uint32_t> &word, uint32_t expected,
+                    const std::chrono::nanoseconds *timeout)
+    {
+        struct timespec ts;
+        struct timespec *tsp = nullptr;
+        if (timeout != nullptr)
+        {
+            const int64_t ns = (timeout->count() < 0) ? 0 : timeout->count();
+            ts.tv_sec = static_cast<time_t>(ns / 1000000000);
+            ts.tv_nsec = static_cast<long>(ns % 1000000000);
+            tsp = &ts;
+        }
+        const long rv = syscall(SYS_futex, word_addr(word), FUTEX_WAIT_PRIVATE,
+                                expected, tsp, nullptr, 0);
+        return !(rv != 0 && errno == ETIMEDOUT);
+    }
+
+    void futex_wake(std::atomic<uint32_t> &word)
+    {
+        syscall(SYS_futex, word_addr(word), FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+    }
+
+}
\ No newline at end of file
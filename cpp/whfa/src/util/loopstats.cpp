@@ -0,0 +1,60 @@
+/**
+ * @file util/loopstats.cpp
+ * @author Robert Griffith
+ */
+#include "util/loopstats.h"
+
+namespace whfa::util
+{
+
+    /**
+     * whfa::util::LoopCounters public methods
+     */
+
+    LoopCounters::LoopCounters()
+        : _iterations(0),
+          _busy_ns(0),
+          _wait_ns(0)
+    {
+        for (size_t i = 0; i < LoopStats::NBUCKETS; ++i)
+        {
+            _busy_hist[i].store(0, std::memory_order_relaxed);
+            _wait_hist[i].store(0, std::memory_order_relaxed);
+        }
+    }
+
+    void LoopCounters::count_iteration(uint64_t busy_ns, uint64_t wait_ns)
+    {
+        // single writer, so plain load and store avoids locked read-modify-write instructions
+        _iterations.store(_iterations.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        _busy_ns.store(_busy_ns.load(std::memory_order_relaxed) + busy_ns, std::memory_order_relaxed);
+        _wait_ns.store(_wait_ns.load(std::memory_order_relaxed) + wait_ns, std::memory_order_relaxed);
+        std::atomic<uint64_t> &b = _busy_hist[bucket(busy_ns)];
+        b.store(b.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic<uint64_t> &w = _wait_hist[bucket(wait_ns)];
+        w.store(w.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    void LoopCounters::get_stats(LoopStats &stats) const
+    {
+        stats.iterations = _iterations.load(std::memory_order_relaxed);
+        stats.busy_ns = _busy_ns.load(std::memory_order_relaxed);
+        stats.wait_ns = _wait_ns.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < LoopStats::NBUCKETS; ++i)
+        {
+            stats.busy_hist[i] = _busy_hist[i].load(std::memory_order_relaxed);
+            stats.wait_hist[i] = _wait_hist[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    size_t LoopCounters::bucket(uint64_t ns)
+    {
+        if (ns == 0)
+        {
+            return 0;
+        }
+        const size_t b = static_cast<size_t>(63 - __builtin_clzll(ns));
+        return (b < LoopStats::NBUCKETS) ? b : LoopStats::NBUCKETS - 1;
+    }
+
+}
\ No newline at end of file
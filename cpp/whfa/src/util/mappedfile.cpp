@@ -0,0 +1,194 @@
+/**
+ * @file util/mappedfile.cpp
+ * @author Robert Griffith
+ */
+#include "util/mappedfile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace
+{
+
+    /**
+     * @brief round offset down to start of its page
+     *
+     * @param offset byte offset
+     * @return page aligned byte offset
+     */
+    uint64_t page_floor(uint64_t offset)
+    {
+        static const uint64_t page = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+        return offset - (offset % page);
+    }
+
+}
+
+namespace whfa::util
+{
+
+    /**
+     * whfa::util::MappedFile public methods
+     */
+
+    MappedFile::MappedFile(uint64_t readahead)
+        : _readahead(readahead),
+          _data(nullptr),
+          _filesz(0),
+          _read_pos(0),
+          _adv_begin(0),
+          _adv_end(0)
+    {
+    }
+
+    MappedFile::~MappedFile()
+    {
+        close();
+    }
+
+    bool MappedFile::open(const char *path)
+    {
+        close();
+        std::lock_guard<std::mutex> lk(_mtx);
+        const int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+        struct stat st;
+        if (fstat(fd, &st) != 0)
+        {
+            const int err = errno;
+            ::close(fd);
+            errno = err;
+            return false;
+        }
+        if (!S_ISREG(st.st_mode) || st.st_size == 0)
+        {
+            ::close(fd);
+            errno = EINVAL;
+            return false;
+        }
+        void *data = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        // mapping holds its own reference to the file
+        ::close(fd);
+        if (data == MAP_FAILED)
+        {
+            return false;
+        }
+        _data = static_cast<uint8_t *>(data);
+        _filesz = static_cast<uint64_t>(st.st_size);
+        _read_pos = 0;
+        _adv_begin = 0;
+        _adv_end = 0;
+        // advice only, failure leaves default read-ahead
+        madvise(_data, _filesz, MADV_SEQUENTIAL);
+        advise();
+        return true;
+    }
+
+    void MappedFile::close()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        if (_data != nullptr)
+        {
+            munmap(_data, _filesz);
+            _data = nullptr;
+        }
+        _filesz = 0;
+        _read_pos = 0;
+    }
+
+    bool MappedFile::is_open()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        return _data != nullptr;
+    }
+
+    uint64_t MappedFile::read(uint8_t *buf, uint64_t size)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        size = std::min(size, _filesz - _read_pos);
+        if (_data == nullptr || size == 0)
+        {
+            return 0;
+        }
+        memcpy(buf, &(_data[_read_pos]), size);
+        _read_pos += size;
+        advise();
+        return size;
+    }
+
+    bool MappedFile::seek(int64_t offset, int whence)
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        if (_data == nullptr)
+        {
+            return false;
+        }
+        const bool neg = offset < 0;
+        const int64_t signed_mag = neg ? -offset : offset;
+        uint64_t mag;
+        memcpy(&mag, &signed_mag, sizeof(mag));
+        uint64_t base;
+        switch (whence)
+        {
+        case SEEK_SET:
+            base = 0;
+            break;
+        case SEEK_CUR:
+            base = _read_pos;
+            break;
+        case SEEK_END:
+            base = _filesz;
+            break;
+        default:
+            return false;
+        }
+        const uint64_t pos = neg ? (base - mag) : (base + mag);
+        if ((neg && pos > base) || (!neg && pos < base) || pos > _filesz)
+        {
+            return false;
+        }
+        _read_pos = pos;
+        advise();
+        return true;
+    }
+
+    uint64_t MappedFile::get_position()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        return _read_pos;
+    }
+
+    uint64_t MappedFile::get_filesize()
+    {
+        std::lock_guard<std::mutex> lk(_mtx);
+        return _filesz;
+    }
+
+    /**
+     * whfa::util::MappedFile protected methods
+     */
+
+    void MappedFile::advise()
+    {
+        // re-advise once read position passes half of window (or leaves it on seek), keeping a window ahead
+        const bool in_window = _read_pos >= _adv_begin && _read_pos < _adv_end;
+        if (_read_pos >= _filesz || (in_window && (_read_pos + _readahead / 2 < _adv_end || _adv_end == _filesz)))
+        {
+            return;
+        }
+        _adv_begin = page_floor(_read_pos);
+        _adv_end = std::min(_filesz, _read_pos + _readahead);
+        madvise(&(_data[_adv_begin]), _adv_end - _adv_begin, MADV_WILLNEED);
+    }
+
+}
\ No newline at end of file
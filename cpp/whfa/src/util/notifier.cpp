@@ -0,0 +1,219 @@
+/**
+ * @file util/notifier.cpp
+ * @author Robert Griffith
+ */
+#include "util/notifier.h"
+#include "util/futex.h"
+
+namespace
+{
+
+    /**
+     * @brief round capacity up to nearest power of two
+     *
+     * @param capacity minimum capacity
+     * @return power of two capacity
+     */
+    size_t round_capacity(size_t capacity)
+    {
+        size_t c = 1;
+        while (c < capacity)
+        {
+            c <<= 1;
+        }
+        return c;
+    }
+
+}
+
+namespace whfa::util
+{
+
+    /**
+     * whfa::util::Notifier public methods
+     */
+
+    Notifier::Notifier(size_t capacity)
+        : _capacity(round_capacity(capacity)),
+          _mask(_capacity - 1),
+          _cells(new Cell[_capacity]),
+          _enq(0),
+          _deq(0),
+          _signal(0),
+          _waiting(false),
+          _handled(0),
+          _ndrain(0),
+          _terminate(false)
+    {
+        for (size_t i = 0; i < _capacity; ++i)
+        {
+            _cells[i].seq.store(i, std::memory_order_relaxed);
+        }
+        _thread = std::thread(&Notifier::execute_loop, this);
+    }
+
+    Notifier::~Notifier()
+    {
+        _terminate.store(true, std::memory_order_seq_cst);
+        wake();
+        _thread.join();
+        delete[] _cells;
+    }
+
+    void Notifier::post(Threader::StateHandler *handler, const Threader::State &state)
+    {
+        const Event event = {.handler = handler,
+                             .state = state,
+                             .threader = nullptr,
+                             .pending = nullptr};
+        while (!try_push(event))
+        {
+            // state changes are never dropped, full queue only while handlers are far behind
+            std::this_thread::yield();
+        }
+        wake();
+    }
+
+    void Notifier::post_timestamp(const Threader *threader, Threader::StateHandler *handler,
+                                  std::atomic<bool> *pending)
+    {
+        const Event event = {.handler = handler,
+                             .state = {.run = false,
+                                       .error = 0,
+                                       .timestamp = 0},
+                             .threader = threader,
+                             .pending = pending};
+        if (!try_push(event))
+        {
+            pending->store(false, std::memory_order_release);
+            return;
+        }
+        wake();
+    }
+
+    void Notifier::drain()
+    {
+        if (std::this_thread::get_id() == _thread.get_id())
+        {
+            return;
+        }
+        const size_t target = _enq.load(std::memory_order_seq_cst);
+        _ndrain.fetch_add(1, std::memory_order_seq_cst);
+        while (true)
+        {
+            const uint32_t handled = _handled.load(std::memory_order_seq_cst);
+            if (_deq.load(std::memory_order_seq_cst) >= target)
+            {
+                break;
+            }
+            futex_wait(_handled, handled);
+        }
+        _ndrain.fetch_sub(1, std::memory_order_seq_cst);
+    }
+
+    /**
+     * whfa::util::Notifier protected methods
+     */
+
+    bool Notifier::try_push(const Event &event)
+    {
+        size_t pos = _enq.load(std::memory_order_relaxed);
+        Cell *cell;
+        while (true)
+        {
+            cell = &(_cells[pos & _mask]);
+            const size_t seq = cell->seq.load(std::memory_order_acquire);
+            const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (dif == 0)
+            {
+                if (_enq.compare_exchange_weak(pos, pos + 1, std::memory_order_seq_cst))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                return false;
+            }
+            else
+            {
+                pos = _enq.load(std::memory_order_relaxed);
+            }
+        }
+        cell->event = event;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Notifier::try_pop(Event &event)
+    {
+        const size_t pos = _deq.load(std::memory_order_relaxed);
+        Cell &cell = _cells[pos & _mask];
+        if (cell.seq.load(std::memory_order_acquire) != pos + 1)
+        {
+            return false;
+        }
+        event = cell.event;
+        cell.seq.store(pos + _capacity, std::memory_order_release);
+        return true;
+    }
+
+    void Notifier::wake()
+    {
+        _signal.fetch_add(1, std::memory_order_seq_cst);
+        if (_waiting.load(std::memory_order_seq_cst))
+        {
+            futex_wake(_signal);
+        }
+    }
+
+    void Notifier::execute_loop()
+    {
+        Event event;
+        while (true)
+        {
+            if (try_pop(event))
+            {
+                if (event.pending == nullptr)
+                {
+                    event.handler->handle(event.state);
+                }
+                else
+                {
+                    // cleared first so any later update is posted again rather than lost
+                    event.pending->store(false, std::memory_order_seq_cst);
+                    Threader::State state;
+                    event.threader->get_state(state);
+                    event.handler->handle(state);
+                }
+                _deq.fetch_add(1, std::memory_order_seq_cst);
+                if (_ndrain.load(std::memory_order_seq_cst) != 0)
+                {
+                    _handled.fetch_add(1, std::memory_order_seq_cst);
+                    futex_wake(_handled);
+                }
+                continue;
+            }
+
+            if (_enq.load(std::memory_order_seq_cst) != _deq.load(std::memory_order_relaxed))
+            {
+                // event claimed but still being written
+                std::this_thread::yield();
+                continue;
+            }
+            if (_terminate.load(std::memory_order_seq_cst))
+            {
+                break;
+            }
+            _waiting.store(true, std::memory_order_seq_cst);
+            const uint32_t signal = _signal.load(std::memory_order_seq_cst);
+            if (_enq.load(std::memory_order_seq_cst) == _deq.load(std::memory_order_relaxed) &&
+                !_terminate.load(std::memory_order_seq_cst))
+            {
+                futex_wait(_signal, signal);
+            }
+            _waiting.store(false, std::memory_order_seq_cst);
+        }
+    }
+
+}
\ No newline at end of file
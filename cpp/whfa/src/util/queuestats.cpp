@@ -0,0 +1,87 @@
+/**
+ * @file util/queuestats.cpp
+ * @author Robert Griffith
+ */
+#include "util/queuestats.h"
+
+namespace
+{
+
+    /**
+     * @brief get nanoseconds elapsed since start
+     *
+     * @param start time to measure from
+     * @return elapsed nanoseconds
+     */
+    inline uint64_t elapsed_ns(const std::chrono::steady_clock::time_point &start)
+    {
+        const auto d = std::chrono::steady_clock::now() - start;
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(d).count());
+    }
+
+}
+
+namespace whfa::util
+{
+
+    /**
+     * whfa::util::QueueCounters public methods
+     */
+
+    QueueCounters::QueueCounters()
+        : _pushes(0),
+          _push_wait_ns(0),
+          _high_water(0),
+          _pops(0),
+          _pop_wait_ns(0),
+          _swaps(0),
+          _flushed(0)
+    {
+    }
+
+    void QueueCounters::count_push(uint64_t n, uint64_t size)
+    {
+        _pushes.fetch_add(n, std::memory_order_relaxed);
+        uint64_t hw = _high_water.load(std::memory_order_relaxed);
+        while (size > hw && !_high_water.compare_exchange_weak(hw, size, std::memory_order_relaxed))
+        {
+        }
+    }
+
+    void QueueCounters::count_pop(uint64_t n)
+    {
+        _pops.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void QueueCounters::count_flush(uint64_t n)
+    {
+        _flushed.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void QueueCounters::count_swap()
+    {
+        _swaps.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void QueueCounters::count_push_wait(const std::chrono::steady_clock::time_point &start)
+    {
+        _push_wait_ns.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+    }
+
+    void QueueCounters::count_pop_wait(const std::chrono::steady_clock::time_point &start)
+    {
+        _pop_wait_ns.fetch_add(elapsed_ns(start), std::memory_order_relaxed);
+    }
+
+    void QueueCounters::get_stats(QueueStats &stats) const
+    {
+        stats.pushes = _pushes.load(std::memory_order_relaxed);
+        stats.pops = _pops.load(std::memory_order_relaxed);
+        stats.flushed = _flushed.load(std::memory_order_relaxed);
+        stats.push_wait_ns = _push_wait_ns.load(std::memory_order_relaxed);
+        stats.pop_wait_ns = _pop_wait_ns.load(std::memory_order_relaxed);
+        stats.high_water = _high_water.load(std::memory_order_relaxed);
+        stats.swaps = _swaps.load(std::memory_order_relaxed);
+    }
+
+}
\ No newline at end of file
@@ -3,6 +3,44 @@
  * @author Robert Griffith
  */
 #include "util/threader.h"
+#include "util/notifier.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+namespace
+{
+
+    /// @brief max length of thread name including null terminator
+    constexpr size_t __THREADNAMESZ = 16;
+
+    /**
+     * @brief convert scheduling policy to pthread policy
+     *
+     * @param policy threader scheduling policy
+     * @return pthread scheduling policy
+     */
+    int to_sched_policy(whfa::util::Threader::SchedPolicy policy)
+    {
+        switch (policy)
+        {
+        case whfa::util::Threader::POLICY_FIFO:
+            return SCHED_FIFO;
+        case whfa::util::Threader::POLICY_RR:
+            return SCHED_RR;
+        case whfa::util::Threader::POLICY_OTHER:
+        default:
+            return SCHED_OTHER;
+        }
+    }
+
+}
 
 namespace whfa::util
 {
@@ -21,122 +59,445 @@ namespace whfa::util
 
     Threader::~Threader()
     {
-        {
-            std::lock_guard<std::mutex> lock(_mtx);
-            _terminate = true;
-        }
-        _cond.notify_all();
-        _thread.join();
+        // loop body methods of derived classes are already destroyed, so they must have terminated first
+        assert(_terminate && !_scheduled && !_thread.joinable());
+        terminate();
     }
 
     void Threader::start(StateHandler *handler)
     {
         {
-            std::lock_guard<std::mutex> lock(_mtx);
+            std::lock_guard<std::mutex> lock(_state_mtx);
             _handler = handler;
-            set_state_start();
         }
-        _cond.notify_all();
+        set_state_start();
     }
 
     void Threader::stop()
     {
-        std::lock_guard<std::mutex> lock(_mtx);
         set_state_stop();
     }
 
     void Threader::pause()
     {
-        std::lock_guard<std::mutex> lock(_mtx);
         set_state_pause();
     }
 
-    void Threader::get_state(State &state)
+    int Threader::configure_thread(const ThreadConfig &config)
+    {
+        if (is_pooled())
+        {
+            return EINVAL;
+        }
+        const pthread_t handle = _thread.native_handle();
+        int err = 0;
+        int rv;
+
+        sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = (config.policy == POLICY_OTHER) ? 0 : config.priority;
+        if ((rv = pthread_setschedparam(handle, to_sched_policy(config.policy), &param)) != 0 && err == 0)
+        {
+            err = rv;
+        }
+
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        for (size_t i = 0; i < CPU_SETSIZE; ++i)
+        {
+            if (config.affinity == 0 || (i < 64 && (config.affinity & (static_cast<uint64_t>(1) << i)) != 0))
+            {
+                CPU_SET(i, &cpus);
+            }
+        }
+        if ((rv = pthread_setaffinity_np(handle, sizeof(cpus), &cpus)) != 0 && err == 0)
+        {
+            err = rv;
+        }
+
+        if (config.name != nullptr)
+        {
+            char name[__THREADNAMESZ];
+            strncpy(name, config.name, __THREADNAMESZ - 1);
+            name[__THREADNAMESZ - 1] = '\0';
+            if ((rv = pthread_setname_np(handle, name)) != 0 && err == 0)
+            {
+                err = rv;
+            }
+        }
+
+        if (config.lock_memory && mlockall(MCL_CURRENT | MCL_FUTURE) != 0 && err == 0)
+        {
+            err = errno;
+        }
+        return err;
+    }
+
+    void Threader::set_notifier(Notifier *notifier, bool timestamps)
+    {
+        Notifier *old;
+        {
+            std::lock_guard<std::mutex> lock(_state_mtx);
+            old = _notifier;
+            _notifier = notifier;
+            _notify_ts.store(notifier != nullptr && timestamps, std::memory_order_release);
+        }
+        if (old != nullptr && old != notifier)
+        {
+            // queued events may still reference this threader
+            old->drain();
+        }
+    }
+
+    void Threader::get_state(State &state) const
+    {
+        state = get_state();
+    }
+
+    int64_t Threader::get_timestamp() const
+    {
+        return _timestamp.load(std::memory_order_acquire);
+    }
+
+    std::chrono::steady_clock::time_point Threader::get_progress_time() const
     {
-        std::lock_guard<std::mutex> lock(_mtx);
-        state = _state;
+        return std::chrono::steady_clock::time_point(
+            std::chrono::steady_clock::duration(_progress_ns.load(std::memory_order_relaxed)));
+    }
+
+    const CancelToken &Threader::get_cancel_token() const
+    {
+        return _cancel;
+    }
+
+    void Threader::get_stats(LoopStats &stats) const
+    {
+        _loop_counters.get_stats(stats);
     }
 
     /**
      * whfa::util::Threader protected methods
      */
 
-    Threader::Threader()
-        : _state({.run = false,
-                  .error = 0,
-                  .timestamp = 0}),
+    Threader::Threader(Executor *executor)
+        : _seq(0),
+          _run(false),
+          _error(0),
+          _timestamp(0),
+          _progress_ns(std::chrono::steady_clock::now().time_since_epoch().count()),
           _handler(nullptr),
           _terminate(false),
-          _thread(&Threader::execute_loop, this)
+          _budget(DEF_BATCH_BUDGET),
+          _executor(executor),
+          _task(this),
+          _scheduled(false),
+          _notifier(nullptr),
+          _notify_ts(false),
+          _ts_pending(false),
+          _iter_wait(0)
+    {
+        if (_executor == nullptr)
+        {
+            _thread = std::thread(&Threader::execute_loop, this);
+        }
+    }
+
+    bool Threader::is_ready()
     {
+        return true;
+    }
+
+    void Threader::notify_ready()
+    {
+        if (_executor != nullptr)
+        {
+            _executor->wake();
+        }
+    }
+
+    void Threader::set_batch_budget(const BatchBudget &budget)
+    {
+        std::lock_guard<std::mutex> lock(_state_mtx);
+        _budget = budget;
+    }
+
+    bool Threader::is_pooled() const
+    {
+        return _executor != nullptr;
     }
 
     void Threader::execute_loop()
     {
+        BatchBudget budget;
         do
         {
-            std::unique_lock<std::mutex> lock(_mtx);
-            _cond.wait(lock, [=]
-                       { return _state.run || _terminate; });
-            // entire loop body remains locked
-            if (_terminate)
             {
-                break;
+                std::unique_lock<std::mutex> lock(_state_mtx);
+                _cond.wait(lock, [=]
+                           { return _run.load(std::memory_order_relaxed) || _terminate; });
+                if (_terminate)
+                {
+                    break;
+                }
+                budget = _budget;
             }
-            execute_loop_body();
-            lock.unlock();
+            // loop body runs unlocked, control calls and state polling do not wait on it
+            run_batch(budget, false);
         } while (true);
     }
 
-    const Threader::State &Threader::get_state() const
+    void Threader::terminate()
     {
-        return _state;
+        {
+            std::unique_lock<std::mutex> lock(_state_mtx);
+            _terminate = true;
+            // blocking loop bodies give up within a bounded time
+            _cancel.cancel();
+            // pooled task finishes its current iteration, then sees termination and clears schedule
+            _cond.wait(lock, [=]
+                       { return !_scheduled; });
+        }
+        _cond.notify_all();
+        if (_thread.joinable())
+        {
+            _thread.join();
+        }
+        if (_notifier != nullptr)
+        {
+            // queued timestamp updates read this threader's state
+            _notifier->drain();
+        }
+    }
+
+    Threader::State Threader::get_state() const
+    {
+        State state;
+        uint64_t seq;
+        do
+        {
+            // retry while a writer is mid-update or updated during the copy
+            while (((seq = _seq.load(std::memory_order_acquire)) & 1) != 0)
+            {
+            }
+            // acquiring keeps the recheck of the sequence number after every field
+            state.run = _run.load(std::memory_order_acquire);
+            state.error = _error.load(std::memory_order_acquire);
+            state.timestamp = _timestamp.load(std::memory_order_acquire);
+        } while (_seq.load(std::memory_order_relaxed) != seq);
+        return state;
     }
 
     void Threader::set_state_start()
     {
-        _state.run = true;
-        _state.error = 0;
-        _state.timestamp = 0;
-        if (_handler != nullptr)
+        const State state = {.run = true,
+                             .error = 0,
+                             .timestamp = 0};
+        StateHandler *handler;
+        Notifier *notifier;
+        bool submit = false;
         {
-            _handler->handle(_state);
+            std::lock_guard<std::mutex> lock(_state_mtx);
+            if (!_terminate)
+            {
+                _cancel.reset();
+            }
+            // starting counts as progress, a worker is not stalled before its first update
+            _progress_ns.store(std::chrono::steady_clock::now().time_since_epoch().count(),
+                               std::memory_order_relaxed);
+            write_state(state);
+            handler = _handler;
+            notifier = _notifier;
+            if (_executor != nullptr && !_scheduled && !_terminate)
+            {
+                _scheduled = true;
+                submit = true;
+            }
         }
+        if (submit)
+        {
+            _executor->submit(&_task);
+        }
+        _cond.notify_all();
+        handle_state(handler, notifier, state);
     }
 
     void Threader::set_state_stop(int error)
     {
-        _state.run = false;
-        _state.timestamp = 0;
-        _state.error = error;
-        if (_handler != nullptr)
+        const State state = {.run = false,
+                             .error = error,
+                             .timestamp = 0};
+        StateHandler *handler;
+        Notifier *notifier;
         {
-            _handler->handle(_state);
+            std::lock_guard<std::mutex> lock(_state_mtx);
+            write_state(state);
+            _cancel.cancel();
+            handler = _handler;
+            notifier = _notifier;
         }
+        handle_state(handler, notifier, state);
     }
 
     void Threader::set_state_pause(int error)
     {
-        _state.run = false;
-        _state.error = error;
-        if (_handler != nullptr)
+        State state;
+        StateHandler *handler;
+        Notifier *notifier;
         {
-            _handler->handle(_state);
+            std::lock_guard<std::mutex> lock(_state_mtx);
+            state = {.run = false,
+                     .error = error,
+                     .timestamp = _timestamp.load(std::memory_order_acquire)};
+            // timestamp untouched, a concurrent set_state_timestamp() is not rolled back
+            write_state(state, false);
+            _cancel.cancel();
+            handler = _handler;
+            notifier = _notifier;
         }
+        handle_state(handler, notifier, state);
     }
 
     void Threader::set_state_error(int error)
     {
-        _state.error = error;
-        if (_handler != nullptr)
+        State state;
+        StateHandler *handler;
+        Notifier *notifier;
         {
-            _handler->handle(_state);
+            std::lock_guard<std::mutex> lock(_state_mtx);
+            state = {.run = _run.load(std::memory_order_relaxed),
+                     .error = error,
+                     .timestamp = _timestamp.load(std::memory_order_acquire)};
+            write_state(state, false);
+            handler = _handler;
+            notifier = _notifier;
         }
+        handle_state(handler, notifier, state);
     }
 
     void Threader::set_state_timestamp(int64_t timestamp)
     {
-        _state.timestamp = timestamp;
+        // single writer slot, no seqlock or lock needed for one atomic 64-bit value
+        _timestamp.store(timestamp, std::memory_order_release);
+        _progress_ns.store(std::chrono::steady_clock::now().time_since_epoch().count(), std::memory_order_relaxed);
+        if (!_notify_ts.load(std::memory_order_acquire) || _ts_pending.exchange(true, std::memory_order_seq_cst))
+        {
+            // not posting timestamps, or coalesced into the update already queued
+            return;
+        }
+        StateHandler *handler;
+        Notifier *notifier;
+        {
+            std::lock_guard<std::mutex> lock(_state_mtx);
+            handler = _handler;
+            notifier = _notify_ts.load(std::memory_order_relaxed) ? _notifier : nullptr;
+        }
+        if (handler != nullptr && notifier != nullptr)
+        {
+            notifier->post_timestamp(this, handler, &_ts_pending);
+        }
+        else
+        {
+            _ts_pending.store(false, std::memory_order_seq_cst);
+        }
+    }
+
+    /**
+     * whfa::util::Threader::PoolTask public methods
+     */
+
+    Threader::PoolTask::PoolTask(Threader *threader)
+        : _threader(threader)
+    {
+    }
+
+    Executor::Task::Result Threader::PoolTask::run()
+    {
+        BatchBudget budget;
+        {
+            std::lock_guard<std::mutex> lock(_threader->_state_mtx);
+            if (_threader->_terminate || !_threader->_run.load(std::memory_order_relaxed))
+            {
+                // rescheduled by next start()
+                _threader->_scheduled = false;
+                _threader->_cond.notify_all();
+                return TASK_DONE;
+            }
+            budget = _threader->_budget;
+        }
+        if (!_threader->is_ready())
+        {
+            return TASK_IDLE;
+        }
+        _threader->run_batch(budget, true);
+        return TASK_AGAIN;
+    }
+
+    /**
+     * whfa::util::Threader private methods
+     */
+
+    void Threader::run_loop_body()
+    {
+        if constexpr (LOOP_STATS_ENABLED)
+        {
+            _iter_wait = std::chrono::steady_clock::duration::zero();
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            execute_loop_body();
+            const std::chrono::steady_clock::duration total = std::chrono::steady_clock::now() - start;
+            const std::chrono::steady_clock::duration wait = std::min(_iter_wait, total);
+            _loop_counters.count_iteration(
+                static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(total - wait).count()),
+                static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(wait).count()));
+        }
+        else
+        {
+            execute_loop_body();
+        }
+    }
+
+    void Threader::run_batch(const BatchBudget &budget, bool check_ready)
+    {
+        const bool timed = budget.duration.count() > 0;
+        const std::chrono::steady_clock::time_point deadline =
+            timed ? std::chrono::steady_clock::now() + budget.duration : std::chrono::steady_clock::time_point();
+        size_t n = 0;
+        do
+        {
+            run_loop_body();
+            // relaxed, stopping mid-batch only needs to be seen eventually
+        } while (++n < budget.iterations && _run.load(std::memory_order_relaxed) && !_cancel.is_cancelled() &&
+                 (!timed || std::chrono::steady_clock::now() < deadline) &&
+                 (!check_ready || is_ready()));
+    }
+
+    void Threader::write_state(const State &state, bool timestamp)
+    {
+        const uint64_t seq = _seq.load(std::memory_order_relaxed);
+        _seq.store(seq + 1, std::memory_order_relaxed);
+        // releasing publishes the odd sequence number to any reader that sees a new field
+        _run.store(state.run, std::memory_order_release);
+        _error.store(state.error, std::memory_order_release);
+        if (timestamp)
+        {
+            _timestamp.store(state.timestamp, std::memory_order_release);
+        }
+        _seq.store(seq + 2, std::memory_order_release);
+    }
+
+    void Threader::handle_state(StateHandler *handler, Notifier *notifier, const State &state)
+    {
+        if (handler == nullptr)
+        {
+            return;
+        }
+        if (notifier != nullptr)
+        {
+            notifier->post(handler, state);
+        }
+        else
+        {
+            handler->handle(state);
+        }
     }
 
 }
\ No newline at end of file
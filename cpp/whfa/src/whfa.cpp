@@ -2,18 +2,29 @@
  * @file whfa.cpp
  * @author Robert Griffith
  *
- * @todo load config file, communicate w/ app clients, use ramfiles
+ * @todo load config file, communicate w/ app clients
  */
+#include "net/tcpramfile.h"
 #include "pcm/decoder.h"
 #include "pcm/player.h"
+#include "pcm/probecache.h"
 #include "pcm/reader.h"
+#include "pcm/watchdog.h"
 #include "pcm/writer.h"
+#include "util/mappedfile.h"
+#include "util/notifier.h"
 
+#include <cerrno>
 #include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
 #include <fstream>
+#include <memory>
 #include <mutex>
+#include <string>
 
+namespace wn = whfa::net;
 namespace wp = whfa::pcm;
 namespace wu = whfa::util;
 
@@ -24,6 +35,93 @@ namespace
     using WUTState = wu::Threader::State;
     /// @brief convenience alias for thread state handler
     using WUTStateHandler = wu::Threader::StateHandler;
+    /// @brief convenience alias for thread configuration
+    using WUTConfig = wu::Threader::ThreadConfig;
+
+    /// @brief real-time priority of player thread (above reader, decoder, and most system threads)
+    constexpr int __PLAYER_RT_PRIORITY = 80;
+    /// @brief number of threads shared by reader, decoder, and writer when converting files
+    constexpr size_t __OFFLINE_THREADS = 1;
+    /// @brief environment variable naming probe cache file, unset = no cache
+    constexpr const char *__PROBE_CACHE_ENV = "WHFA_PROBE_CACHE";
+    /// @brief environment variable setting number of decoding threads, unset = no threading
+    constexpr const char *__DECODER_THREADS_ENV = "WHFA_DECODER_THREADS";
+    /// @brief input prefix of files received over TCP, followed by <addr>:<port>
+    constexpr const char *__RAMFILE_PREFIX = "ramfile:";
+    /// @brief input prefix of local files read through a memory mapping, followed by <path>
+    constexpr const char *__MMAP_PREFIX = "mmap:";
+
+    /**
+     * @brief parse ramfile input
+     *
+     * @param input input argument
+     * @param[out] addr IP address to connect to
+     * @param[out] port port to connect to
+     * @return true if input is a valid ramfile input
+     */
+    bool parse_ramfile(const char *input, std::string &addr, uint16_t &port)
+    {
+        const size_t plen = strlen(__RAMFILE_PREFIX);
+        if (strncmp(input, __RAMFILE_PREFIX, plen) != 0)
+        {
+            return false;
+        }
+        const char *sep = strrchr(input + plen, ':');
+        if (sep == nullptr || sep == input + plen)
+        {
+            return false;
+        }
+        char *end;
+        const unsigned long p = strtoul(sep + 1, &end, 10);
+        if (*end != '\0' || end == sep + 1 || p == 0 || p > UINT16_MAX)
+        {
+            return false;
+        }
+        addr.assign(input + plen, sep);
+        port = static_cast<uint16_t>(p);
+        return true;
+    }
+
+    /**
+     * @brief configure worker thread, warning on failure (e.g. no real-time permission)
+     *
+     * @param t worker to configure
+     * @param config thread configuration
+     */
+    void configure_worker(wu::Threader &t, const WUTConfig &config)
+    {
+        const int rv = t.configure_thread(config);
+        if (rv != 0)
+        {
+            std::cerr << "WARNING: failed to fully configure thread " << config.name << std::endl;
+            wu::print_error(rv);
+        }
+    }
+
+    /**
+     * @brief print worker loop iteration counts, busy and wait time, and busy time histogram
+     *
+     * @param t worker to print stats of
+     * @param name name of worker
+     */
+    void print_loop_stats(const wu::Threader &t, const char *name)
+    {
+        if (!wu::LOOP_STATS_ENABLED)
+        {
+            return;
+        }
+        wu::LoopStats stats;
+        t.get_stats(stats);
+        std::cout << "LOOP STATS (" << name << "): " << stats.iterations << " iterations, "
+                  << stats.busy_ns / 1000000 << "ms busy, " << stats.wait_ns / 1000000 << "ms waiting" << std::endl;
+        for (size_t i = 0; i < wu::LoopStats::NBUCKETS; ++i)
+        {
+            if (stats.busy_hist[i] != 0)
+            {
+                std::cout << "    busy >= " << (static_cast<uint64_t>(1) << i) << "ns: " << stats.busy_hist[i] << std::endl;
+            }
+        }
+    }
 
     /**
      * @brief print CLI usage
@@ -32,9 +130,15 @@ namespace
     {
         std::cout << "\
 usage:\n\
-   <application> <input url> -play <output device name>\n\
-   <application> <input url> -raw <output file name>\n\
-   <application> <input url> -wav <output file name>\n\
+   <application> <input url> -play <output device name> [next input url]\n\
+   <application> <input url> -raw <output file name> [next input url]\n\
+   <application> <input url> -wav <output file name> [next input url]\n\
+input:\n\
+   ramfile:<addr>:<port>  receive file over TCP from a ramfile server, decoding it as it arrives\n\
+   mmap:<path>            read local file through a memory mapping, letting the page cache read ahead\n\
+environment:\n\
+   WHFA_PROBE_CACHE=<file>  cache probed stream parameters to start known inputs sooner\n\
+   WHFA_DECODER_THREADS=<n> decode on n threads (0 = one per core) if codec supports it\n\
 \n";
     }
 
@@ -117,6 +221,37 @@ usage:\n\
         std::condition_variable *_cv;
     };
 
+    class WatchdogEH : public wp::Watchdog::EventHandler
+    {
+    public:
+        /**
+         * @brief handle watchdog event by warning on stderr
+         *
+         * @param e event
+         */
+        void handle(const wp::Watchdog::Event &e) override
+        {
+            static const char *stages[wp::Context::NUM_STAGES] = {"Reader", "Decoder", "Player"};
+            switch (e.type)
+            {
+            case wp::Watchdog::EVENT_STARVING:
+                std::cerr << "WARNING: starvation predicted in " << e.time_to_empty.count() << "ms ("
+                          << e.buffered.count() << "ms buffered)" << std::endl;
+                break;
+            case wp::Watchdog::EVENT_BUFFERED:
+                std::cerr << "WATCHDOG: buffering recovered (" << e.buffered.count() << "ms buffered)" << std::endl;
+                break;
+            case wp::Watchdog::EVENT_STALLED:
+                std::cerr << "WARNING: " << stages[e.stage] << " stalled (" << e.buffered.count() << "ms buffered)"
+                          << std::endl;
+                break;
+            case wp::Watchdog::EVENT_RESUMED:
+                std::cerr << "WATCHDOG: " << stages[e.stage] << " resumed" << std::endl;
+                break;
+            }
+        }
+    };
+
 }
 
 /**
@@ -128,7 +263,7 @@ usage:\n\
  */
 int main(int argc, char **argv)
 {
-    if (argc != 4)
+    if (argc != 4 && argc != 5)
     {
         print_usage();
         return 1;
@@ -136,38 +271,125 @@ int main(int argc, char **argv)
 
     std::mutex wait_mtx;
     std::condition_variable wait_cond;
+    const bool play = strcmp(argv[2], "-play") == 0;
+
+    // received into memory while decoding, declared first to outlive the context's use of it
+    wn::TCPRAMFile ramfile;
+    std::string ramfile_addr;
+    uint16_t ramfile_port;
+    wu::MappedFile mapped;
 
     wp::Context c;
+    // known inputs start playing sooner when their stream parameters need not be probed again
+    std::unique_ptr<wp::ProbeCache> probe_cache;
+    const char *probe_cache_path = getenv(__PROBE_CACHE_ENV);
+    if (probe_cache_path != nullptr)
+    {
+        probe_cache.reset(new wp::ProbeCache(probe_cache_path));
+        c.set_probe_cache(probe_cache.get());
+    }
+    // CPU-heavy codecs keep up on slow cores by decoding on several threads
+    wp::Context::DecoderConfig dec_config = wp::Context::DEF_DECODER_CONFIG;
+    const char *decoder_threads = getenv(__DECODER_THREADS_ENV);
+    if (decoder_threads != nullptr)
+    {
+        dec_config.threads = atoi(decoder_threads);
+    }
 
     // state handlers instantiated first for proper destruction order
     BaseSH r_sh(c, "Reader");
     BaseSH d_sh(c, "Decoder");
     NotifierSH p_sh(c, wait_cond, "Player");
     NotifierSH w_sh(c, wait_cond, "Writer");
+    WatchdogEH wd_eh;
+    // handlers log and may close the context, so keep them off the worker threads
+    wu::Notifier n;
+    // converting files has no real-time output to keep fed, so stages take turns on one thread
+    // rather than handing every packet and frame across threads
+    std::unique_ptr<wu::Executor> offline;
+    if (!play)
+    {
+        offline.reset(new wu::Executor(__OFFLINE_THREADS));
+    }
 
-    wp::Reader r(c);
-    wp::Decoder d(c);
+    wp::Reader r(c, offline.get());
+    wp::Decoder d(c, offline.get());
     wp::Player p(c);
-    wp::Writer w(c);
+    wp::Writer w(c, nullptr, offline.get());
+    // destroyed first, it watches the other workers
+    wp::Watchdog wd(c);
 
     wu::Threader::State state;
     int rv;
 
+    r.set_notifier(&n);
+    d.set_notifier(&n);
+    p.set_notifier(&n);
+    w.set_notifier(&n);
+
+    // player preemption causes underruns, so only it runs real-time with memory locked
+    // pooled workers share executor threads and cannot be configured
+    WUTConfig config = wu::Threader::DEF_THREAD_CONFIG;
+    if (play)
+    {
+        config.name = "whfa-reader";
+        configure_worker(r, config);
+        config.name = "whfa-decoder";
+        configure_worker(d, config);
+        config.name = "whfa-player";
+        config.policy = wu::Threader::POLICY_FIFO;
+        config.priority = __PLAYER_RT_PRIORITY;
+        config.lock_memory = true;
+        configure_worker(p, config);
+    }
+
     std::cout << "initializing libav formats & networking" << std::endl;
     wp::Context::register_formats();
     wp::Context::enable_networking();
 
     std::cout << "openining " << argv[1] << std::endl;
-    rv = c.open(argv[1]);
+    if (parse_ramfile(argv[1], ramfile_addr, ramfile_port))
+    {
+        if (!ramfile.open(ramfile_addr.c_str(), ramfile_port))
+        {
+            std::cerr << "failed to connect to ramfile server: " << argv[1] << std::endl;
+            return 1;
+        }
+        ramfile.start();
+        rv = c.open(ramfile, argv[1], dec_config);
+    }
+    else if (strncmp(argv[1], __MMAP_PREFIX, strlen(__MMAP_PREFIX)) == 0)
+    {
+        if (!mapped.open(argv[1] + strlen(__MMAP_PREFIX)))
+        {
+            std::cerr << "failed to map input: " << argv[1] << " (" << strerror(errno) << ")" << std::endl;
+            return 1;
+        }
+        rv = c.open(mapped, argv[1] + strlen(__MMAP_PREFIX), dec_config);
+    }
+    else
+    {
+        rv = c.open(argv[1], dec_config);
+    }
     if (rv != 0)
     {
         std::cerr << "failed to open input: " << argv[1] << std::endl;
         wu::print_error(rv);
         return 1;
     }
+    // codec may not support threading, or libav may settle on fewer threads than requested
+    wp::Context::DecoderConfig effective;
+    if (c.get_decoder_config(effective))
+    {
+        std::cout << "decoding on " << effective.threads << " thread(s)"
+                  << ((effective.thread_type & FF_THREAD_FRAME) ? ", frame threaded"
+                      : (effective.thread_type & FF_THREAD_SLICE) ? ", slice threaded"
+                                                                    : "")
+                  << std::endl;
+    }
 
     std::cout << "parsing option: " << argv[2] << std::endl;
-    if (strcmp(argv[2], "-play") == 0)
+    if (play)
     {
         // playing to device
         if (!p.open(argv[3]))
@@ -179,6 +401,16 @@ int main(int argc, char **argv)
         }
         p.configure(); // using default resample & latency
         p.start(&p_sh);
+
+        // warn before a stalled read becomes an audible underrun
+        wd.watch(wp::Context::STAGE_READ, &r);
+        wd.watch(wp::Context::STAGE_DECODE, &d);
+        wd.watch(wp::Context::STAGE_OUTPUT, &p);
+        wd.set_event_handler(&wd_eh);
+        if (wd.configure())
+        {
+            wd.start();
+        }
     }
     else
     {
@@ -214,9 +446,28 @@ int main(int argc, char **argv)
     d.start(&d_sh);
     r.start(&r_sh);
 
+    if (argc == 5)
+    {
+        // probed while the first input plays, continued from without a gap
+        std::cout << "preparing " << argv[4] << std::endl;
+        rv = c.prepare_next(argv[4], dec_config);
+        if (rv != 0)
+        {
+            std::cerr << "failed to prepare next input: " << argv[4] << std::endl;
+            wu::print_error(rv);
+        }
+    }
+
     std::unique_lock<std::mutex> wait_lk(wait_mtx);
     wait_cond.wait(wait_lk);
     std::cout << "DONE: no longer waiting" << std::endl;
+    wp::Context::Position pos;
+    c.get_position(pos);
+    std::cout << "POSITION: read " << pos.read << ", decoded " << pos.decode << ", output " << pos.output << std::endl;
+    print_loop_stats(r, "Reader");
+    print_loop_stats(d, "Decoder");
+    print_loop_stats(p, "Player");
+    print_loop_stats(w, "Writer");
 
     // all threaders join threads in destructor
     // context, player, and writer both close in destructor
@@ -4,6 +4,7 @@
  */
 #include "test/net.h"
 #include "test/pcm.h"
+#include "test/util.h"
 
 #include <cstring>
 #include <iostream>
@@ -76,6 +77,19 @@ int main(int argc, char **argv)
         print_usage();
     }
 
+    // test util
+    std::cout << "testing util queues" << std::endl;
+    wt::test_dbpqueue();
+    wt::test_bpqueue();
+    wt::test_ppool();
+    wt::test_executor();
+    wt::test_notifier();
+    wt::test_loopstats();
+    wt::test_batching();
+    wt::test_cancel();
+    wt::test_spscpqueue();
+    wt::test_mappedfile();
+
     // test net
     for (const char *p_s : ports)
     {
@@ -92,6 +106,9 @@ int main(int argc, char **argv)
 
     // test pcm
     std::cout << "testing base pcm functionality with url: " << url << std::endl;
+    wt::test_pool_flush();
+    wt::test_watchdog();
+    wt::test_seek_boundary(url);
     wt::test_write_raw(url);
     wt::test_write_wav(url);
     for (const char *d : devs)
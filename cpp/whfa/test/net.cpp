@@ -7,6 +7,8 @@
 #include "net/tcpconnection.h"
 #include "net/tcpramfile.h"
 
+#include <chrono>
+#include <condition_variable>
 #include <cstring>
 #include <iostream>
 #include <random>
@@ -28,6 +30,8 @@ namespace
     constexpr size_t __NBUFSENDS = 8;
     /// @brief number of buffers to send from each side
     constexpr size_t __NBUFS = 2 * __NBUFSENDS;
+    /// @brief max duration closing a ramfile may take while its sender is stalled
+    constexpr std::chrono::milliseconds __CLOSEBOUND(500);
 
     /// @brief random number generator
     std::default_random_engine __gen;
@@ -273,6 +277,62 @@ namespace
         __f.close();
     }
 
+    /**
+     * @brief client sending file size then stalling until released
+     *
+     * @param port local port to test connection with self
+     * @param[out] release set to true to stop stalling
+     * @param[out] cond condition variable notified upon setting release
+     */
+    void test_tcpramfile_client_stall(uint16_t port, bool *release, std::condition_variable *cond)
+    {
+        wn::TCPConnection c;
+        if (!c.connect("127.0.0.1", port))
+        {
+            std::cerr << __PRFXCLNT << "failed to connect as client" << std::endl;
+            return;
+        }
+        const uint64_t fsz = static_cast<uint64_t>(__NBUFS * __BUFSZ);
+        if (!c.send(&fsz, sizeof(fsz)))
+        {
+            std::cerr << __PRFXCLNT << "failed to send filesize" << std::endl;
+        }
+        std::unique_lock<std::mutex> lk(__gen_mtx);
+        cond->wait(lk, [=]
+                   { return *release; });
+        c.close();
+    }
+
+    /**
+     * @brief server testing closing ramfile while its recv is blocked
+     *
+     * @param port local port to test connection with self
+     */
+    void test_tcpramfile_server_cancel(uint16_t port)
+    {
+        std::unique_lock<std::mutex> lk(__mtx);
+        if (!__f.open(port))
+        {
+            std::cerr << __PRFXSRVR << "failed to open ramfile" << std::endl;
+            return;
+        }
+        __f.start();
+        std::this_thread::sleep_for(__CLOSEBOUND / 5);
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        __f.close();
+        if (std::chrono::steady_clock::now() - start >= __CLOSEBOUND)
+        {
+            std::cerr << __PRFXSRVR << "close waited on stalled sender" << std::endl;
+        }
+        wu::Threader::State s;
+        __f.get_state(s);
+        if (s.run || s.error != 0)
+        {
+            std::cerr << __PRFXSRVR << "cancelled recv left invalid state" << std::endl;
+            wu::print_error(s.error);
+        }
+    }
+
 }
 
 namespace whfa::test
@@ -312,6 +372,18 @@ namespace whfa::test
         test_tcpramfile_server_seek(port, bufs_s);
         t_c_s.join();
         compare_bufs(bufs_c, bufs_s);
+        // closing while sender stalls mid-file
+        std::cout << "testing closing with stalled sender" << std::endl;
+        bool release = false;
+        std::condition_variable release_cond;
+        std::thread t_c_c(test_tcpramfile_client_stall, port, &release, &release_cond);
+        test_tcpramfile_server_cancel(port);
+        {
+            std::lock_guard<std::mutex> lk(__gen_mtx);
+            release = true;
+        }
+        release_cond.notify_all();
+        t_c_c.join();
         // cleanup
         delete bufs_c;
         delete bufs_s;
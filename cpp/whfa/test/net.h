@@ -17,7 +17,7 @@ namespace whfa::test
     void test_tcpconnection(uint16_t port);
 
     /**
-     * @brief test TCPRAMFile
+     * @brief test TCPRAMFile, including closing while the sender stalls
      *
      * @param port local port to use for connection
      */
@@ -7,12 +7,16 @@
 #include "pcm/decoder.h"
 #include "pcm/player.h"
 #include "pcm/reader.h"
+#include "pcm/watchdog.h"
 #include "pcm/writer.h"
 
 #include <condition_variable>
 #include <iostream>
 #include <fstream>
+#include <limits>
 #include <mutex>
+#include <thread>
+#include <vector>
 
 namespace wp = whfa::pcm;
 namespace wu = whfa::util;
@@ -22,6 +26,14 @@ namespace
 
     /// @brief base of output test filenames
     constexpr const char *__TESTFILENAMEBASE = "test_output";
+    /// @brief watchdog thresholds under test
+    constexpr wp::Watchdog::Config __WDCONFIG = {.interval = std::chrono::milliseconds(20),
+                                                 .starvation = std::chrono::milliseconds(500),
+                                                 .stall = std::chrono::milliseconds(1000)};
+    /// @brief duration between synthetic watchdog samples
+    constexpr std::chrono::milliseconds __WDSTEP(100);
+    /// @brief max number of synthetic watchdog samples per phase
+    constexpr size_t __WDMAXSTEPS = 1000;
 
     /// @brief convenience alias for thread state
     using WUTState = wu::Threader::State;
@@ -151,6 +163,130 @@ namespace
         }
     }
 
+    /**
+     * @class EventRecorder
+     * @brief watchdog event handler recording received events
+     */
+    class EventRecorder : public wp::Watchdog::EventHandler
+    {
+    public:
+        /**
+         * @brief record event
+         *
+         * @param event event to record
+         */
+        void handle(const wp::Watchdog::Event &event) override
+        {
+            events.push_back(event);
+        }
+
+        /// @brief received events in order
+        std::vector<wp::Watchdog::Event> events;
+    };
+
+    /**
+     * @class TestWatchdog
+     * @brief watchdog sampling synthetic positions (in milliseconds) and times instead of its context
+     */
+    class TestWatchdog : public wp::Watchdog
+    {
+    public:
+        /**
+         * @brief constructor
+         *
+         * @param c pcm context (never sampled)
+         */
+        TestWatchdog(wp::Context &c)
+            : Watchdog(c, __WDCONFIG)
+        {
+            _timebase = 0.001;
+        }
+
+        /**
+         * @brief sample synthetic read and output positions
+         *
+         * @param now time of sample
+         * @param read read position in milliseconds
+         * @param output output position in milliseconds
+         * @return predicted seconds until output starves after sampling, infinity if not draining
+         */
+        double sample(std::chrono::steady_clock::time_point now, int64_t read, int64_t output)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            const wp::Context::Position pos = {.read = read, .decode = read, .output = output};
+            sample_buffer(now, pos, true);
+            return (_trend < 0) ? _buffered / -_trend : std::numeric_limits<double>::infinity();
+        }
+
+        /**
+         * @brief check watched workers for stalls at synthetic time
+         *
+         * @param now time of sample
+         */
+        void sample_workers(std::chrono::steady_clock::time_point now)
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            sample_progress(now);
+        }
+    };
+
+    /**
+     * @class StallWorker
+     * @brief threader that runs without progress until told to
+     */
+    class StallWorker : public wu::Threader
+    {
+    public:
+        /**
+         * @brief destructor, waits for loop body before members are destroyed
+         */
+        virtual ~StallWorker()
+        {
+            terminate();
+        }
+
+        /**
+         * @brief record progress
+         *
+         * @param timestamp new timestamp
+         */
+        void progress(int64_t timestamp)
+        {
+            set_state_timestamp(timestamp);
+        }
+
+    protected:
+        /**
+         * @brief idle without updating timestamp
+         */
+        void execute_loop_body() override
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    };
+
+    /**
+     * @brief check number of recorded events of a type
+     *
+     * @param rec recorded events
+     * @param type event type to count
+     * @param expected expected count
+     * @param when description of when the count is checked
+     */
+    void check_events(const EventRecorder &rec, wp::Watchdog::EventType type, size_t expected, const char *when)
+    {
+        size_t n = 0;
+        for (const wp::Watchdog::Event &e : rec.events)
+        {
+            n += (e.type == type) ? 1 : 0;
+        }
+        if (n != expected)
+        {
+            std::cerr << "ERROR: " << n << " watchdog events of type " << type << " " << when
+                      << " (expected " << expected << ")" << std::endl;
+        }
+    }
+
     /**
      * @brief test pcm writing of specified output type
      *
@@ -197,6 +333,59 @@ namespace
         std::cout << "starting reader thread" << std::endl;
         __r.start(&__r_sh);
     }
+
+    /**
+     * @brief check codec was switched to next input's by seek
+     *
+     * @param prev codec context of ended input
+     * @param name name of seek tested
+     */
+    void check_seek_codec(AVCodecContext *prev, const char *name)
+    {
+        AVCodecContext *cdc_ctxt;
+        std::mutex *cdc_mtx = __c.get_codec(cdc_ctxt);
+        if (cdc_mtx == nullptr)
+        {
+            std::cerr << "ERROR: no codec after " << name << std::endl;
+            return;
+        }
+        if (__c.has_pending_codec() || cdc_ctxt == prev)
+        {
+            std::cerr << "ERROR: " << name << " across boundary kept ended input's codec" << std::endl;
+        }
+        cdc_mtx->unlock();
+    }
+
+    /**
+     * @brief advance context to prepared next input as reader does at end of stream
+     *
+     * @param url url to prepare as next input
+     * @param[out] prev codec context of ended input
+     * @return false if next input was not advanced to
+     */
+    bool advance_input(const char *url, AVCodecContext *&prev)
+    {
+        int rv = __c.prepare_next(url);
+        if (rv != 0)
+        {
+            std::cerr << "failed to prepare next input: " << url << std::endl;
+            wu::print_error(rv);
+            return false;
+        }
+        std::mutex *cdc_mtx = __c.get_codec(prev);
+        if (cdc_mtx == nullptr)
+        {
+            std::cerr << "ERROR: no codec before boundary" << std::endl;
+            return false;
+        }
+        cdc_mtx->unlock();
+        if (!__c.advance_format())
+        {
+            std::cerr << "ERROR: failed to advance to next input" << std::endl;
+            return false;
+        }
+        return true;
+    }
 }
 
 namespace whfa::test
@@ -242,6 +431,204 @@ namespace whfa::test
         std::cout << "DONE with " << __func__ << std::endl;
     }
 
+    void test_pool_flush()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+
+        constexpr size_t n = 16;
+        wp::Context c;
+        AVPacket *pkts[n];
+        AVFrame *frms[n];
+        uint64_t pkt_allocs, frm_allocs;
+        uint64_t pkt_allocs2, frm_allocs2;
+
+        // warm pools with n elements each
+        for (size_t i = 0; i < n; ++i)
+        {
+            pkts[i] = c.acquire_packet();
+            frms[i] = c.acquire_frame();
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            c.release_packet(pkts[i]);
+            c.release_frame(frms[i]);
+        }
+        c.get_pool_allocs(pkt_allocs, frm_allocs);
+
+        // queue pooled elements, flushing must return them to the pools
+        for (size_t i = 0; i < n; ++i)
+        {
+            pkts[i] = c.acquire_packet();
+            frms[i] = c.acquire_frame();
+        }
+        if (c.get_packet_queue().push_n(pkts, n) != n)
+        {
+            std::cerr << "ERROR: failed to push packets" << std::endl;
+        }
+        if (c.get_frame_queue().push_n(frms, n) != n)
+        {
+            std::cerr << "ERROR: failed to push frames" << std::endl;
+        }
+        c.get_packet_queue().flush();
+        c.get_frame_queue().flush();
+
+        // pools still hold n elements each, so reacquiring them must not allocate
+        for (size_t i = 0; i < n; ++i)
+        {
+            pkts[i] = c.acquire_packet();
+            frms[i] = c.acquire_frame();
+        }
+        c.get_pool_allocs(pkt_allocs2, frm_allocs2);
+        if (pkt_allocs2 != pkt_allocs)
+        {
+            std::cerr << "ERROR: packet pool shrank after flush, " << (pkt_allocs2 - pkt_allocs)
+                      << " new allocations" << std::endl;
+        }
+        if (frm_allocs2 != frm_allocs)
+        {
+            std::cerr << "ERROR: frame pool shrank after flush, " << (frm_allocs2 - frm_allocs)
+                      << " new allocations" << std::endl;
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            c.release_packet(pkts[i]);
+            c.release_frame(frms[i]);
+        }
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_watchdog()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+
+        wp::Context c;
+        TestWatchdog wd(c);
+        EventRecorder rec;
+        wd.set_event_handler(&rec);
+        const double starvation = std::chrono::duration<double>(__WDCONFIG.starvation).count();
+        std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        int64_t read = 10000;
+        int64_t output = 1000;
+        double tte = wd.sample(now, read, output);
+
+        // read stalls while output drains, starving fires once time to empty first falls below threshold
+        size_t i = 0;
+        for (; i < __WDMAXSTEPS && output < read; ++i)
+        {
+            now += __WDSTEP;
+            output += __WDSTEP.count();
+            const size_t nevents = rec.events.size();
+            const double prev = tte;
+            tte = wd.sample(now, read, output);
+            if (rec.events.size() != nevents)
+            {
+                if (tte >= starvation || prev < starvation)
+                {
+                    std::cerr << "ERROR: starving fired at time to empty " << tte << "s (previous " << prev
+                              << "s, threshold " << starvation << "s)" << std::endl;
+                }
+                break;
+            }
+        }
+        check_events(rec, wp::Watchdog::EVENT_STARVING, 1, "after draining");
+        if (rec.events.size() == 1 && rec.events[0].time_to_empty >= __WDCONFIG.starvation)
+        {
+            std::cerr << "ERROR: starving event reported " << rec.events[0].time_to_empty.count()
+                      << "ms to empty" << std::endl;
+        }
+
+        // read recovers slowly, buffered only fires once time to empty reaches twice the threshold
+        size_t nband = 0;
+        for (i = 0; i < __WDMAXSTEPS; ++i)
+        {
+            now += __WDSTEP;
+            output += __WDSTEP.count();
+            read += __WDSTEP.count() + __WDSTEP.count() / 5;
+            const size_t nevents = rec.events.size();
+            tte = wd.sample(now, read, output);
+            const bool fired = rec.events.size() != nevents;
+            if (fired != (tte >= starvation * 2))
+            {
+                std::cerr << "ERROR: buffered " << (fired ? "fired" : "did not fire") << " at time to empty "
+                          << tte << "s (threshold " << starvation * 2 << "s)" << std::endl;
+            }
+            if (fired)
+            {
+                break;
+            }
+            nband += (tte >= starvation) ? 1 : 0;
+        }
+        if (nband == 0)
+        {
+            std::cerr << "ERROR: recovery never sampled between starvation threshold and twice it" << std::endl;
+        }
+        check_events(rec, wp::Watchdog::EVENT_STARVING, 1, "after recovering");
+        check_events(rec, wp::Watchdog::EVENT_BUFFERED, 1, "after recovering");
+
+        // running worker without progress stalls once at stall timeout, resumes once on progress
+        StallWorker w;
+        w.start();
+        wd.watch(wp::Context::STAGE_DECODE, &w);
+        const std::chrono::steady_clock::time_point progressed = w.get_progress_time();
+        wd.sample_workers(progressed + __WDCONFIG.stall - std::chrono::milliseconds(1));
+        check_events(rec, wp::Watchdog::EVENT_STALLED, 0, "before stall timeout");
+        wd.sample_workers(progressed + __WDCONFIG.stall);
+        wd.sample_workers(progressed + __WDCONFIG.stall + __WDSTEP);
+        check_events(rec, wp::Watchdog::EVENT_STALLED, 1, "after stall timeout");
+        check_events(rec, wp::Watchdog::EVENT_RESUMED, 0, "while stalled");
+        w.progress(1);
+        wd.sample_workers(w.get_progress_time());
+        wd.sample_workers(w.get_progress_time() + __WDSTEP);
+        check_events(rec, wp::Watchdog::EVENT_STALLED, 1, "after progress");
+        check_events(rec, wp::Watchdog::EVENT_RESUMED, 1, "after progress");
+        if (!rec.events.empty() && rec.events.back().stage != wp::Context::STAGE_DECODE)
+        {
+            std::cerr << "ERROR: stall events reported stage " << rec.events.back().stage << std::endl;
+        }
+        wd.watch(wp::Context::STAGE_DECODE, nullptr);
+        w.stop();
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_seek_boundary(const char *url)
+    {
+        std::unique_lock<std::mutex> lk(__mtx);
+        std::cout << "TESTING " << __func__ << std::endl;
+
+        init_context();
+        int rv;
+
+        std::cout << "openining input: " << url << std::endl;
+        rv = __c.open(url);
+        if (rv != 0)
+        {
+            std::cerr << "failed to open input: " << url << std::endl;
+            wu::print_error(rv);
+            return;
+        }
+
+        // seek lands before decoder reaches boundary packet, which is discarded with the ended input's packets
+        AVCodecContext *prev;
+        if (advance_input(url, prev))
+        {
+            if (!__r.seek(0.5))
+            {
+                std::cerr << "ERROR: seek by percentage failed" << std::endl;
+            }
+            check_seek_codec(prev, "seek by percentage");
+        }
+        if (advance_input(url, prev))
+        {
+            if (!__r.seek(static_cast<int64_t>(0)))
+            {
+                std::cerr << "ERROR: seek by timestamp failed" << std::endl;
+            }
+            check_seek_codec(prev, "seek by timestamp");
+        }
+        __c.close();
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
     void test_write_raw(const char *url)
     {
         std::unique_lock<std::mutex> lk(__mtx);
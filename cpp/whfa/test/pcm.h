@@ -15,6 +15,23 @@ namespace whfa::test
      */
     void test_play(const char *url, const char *dev);
 
+    /**
+     * @brief test flushing context queues recycles packets and frames into the context pools
+     */
+    void test_pool_flush();
+
+    /**
+     * @brief test watchdog starvation hysteresis and stall detection with synthetic positions and times
+     */
+    void test_watchdog();
+
+    /**
+     * @brief test seeking after reader advanced to prepared next input switches codecs
+     *
+     * @param url url to file to read (also prepared as next input)
+     */
+    void test_seek_boundary(const char *url);
+
     /**
      * @brief test writing audio file to raw PCM
      *
@@ -0,0 +1,1491 @@
+/**
+ * @file test/util.cpp
+ * @author Robert Griffith
+ */
+#include "test/util.h"
+
+#include "util/bpqueue.h"
+#include "util/canceltoken.h"
+#include "util/dbpqueue.h"
+#include "util/executor.h"
+#include "util/mappedfile.h"
+#include "util/notifier.h"
+#include "util/ppool.h"
+#include "util/spscpqueue.h"
+#include "util/threader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <poll.h>
+#include <unistd.h>
+
+namespace wu = whfa::util;
+
+namespace
+{
+
+    /// @brief capacity of queues under test (small to force blocking)
+    constexpr size_t __QCAP = 16;
+    /// @brief number of elements to pass through queues under test
+    constexpr size_t __NELEMS = 100000;
+    /// @brief number of elements per batched push (not a divisor of capacity)
+    constexpr size_t __PUSHBATCHSZ = 7;
+    /// @brief max number of elements per batched pop
+    constexpr size_t __POPBATCHSZ = 5;
+    /// @brief weight limit of weighted queues under test
+    constexpr size_t __WLIMIT = 10;
+    /// @brief timeout used to test timed push and pop
+    constexpr std::chrono::milliseconds __TIMEOUT(10);
+    /// @brief capacity of queues under epoch test (larger than one discard batch)
+    constexpr size_t __EPOCHQCAP = 256;
+    /// @brief number of producer consumer pairs sharing an executor
+    constexpr size_t __NPAIRS = 16;
+    /// @brief number of executor pool threads (fewer than pooled threaders)
+    constexpr size_t __NPOOLTHREADS = 2;
+    /// @brief duration an idle task is left on an executor to count how often it is polled
+    constexpr std::chrono::milliseconds __IDLEPERIOD(200);
+    /// @brief number of elements passed through each pooled pair
+    constexpr size_t __POOLNELEMS = 10000;
+    /// @brief number of timestamp updates posted to notifier
+    constexpr int64_t __NTICKS = 100000;
+    /// @brief duration of each slow handler call
+    constexpr std::chrono::microseconds __HANDLEDELAY(200);
+    /// @brief number of loop iterations timed
+    constexpr uint64_t __NTIMED = 20;
+    /// @brief duration each timed iteration works for
+    constexpr std::chrono::milliseconds __TIMEDBUSY(2);
+    /// @brief duration each timed iteration waits for
+    constexpr std::chrono::milliseconds __TIMEDWAIT(4);
+    /// @brief size of mapped file under test (not a multiple of pages or reads)
+    constexpr size_t __MAPSZ = 100003;
+    /// @brief readahead window of mapped file under test (smaller than file to advise repeatedly)
+    constexpr uint64_t __MAPREADAHEAD = 16384;
+    /// @brief max number of bytes per mapped file read
+    constexpr size_t __MAPREADSZ = 4093;
+
+    /// @brief number of elements handed to count_discard()
+    std::atomic<size_t> __ndiscard(0);
+    /// @brief number of upcoming fail_clone() calls to fail
+    std::atomic<size_t> __nclonefail(0);
+
+    /**
+     * @brief push all elements in order, blocking when full
+     *
+     * @param[out] q queue to push to
+     * @param elems elements to push
+     */
+    void produce(wu::PQueue<size_t> &q, size_t *elems)
+    {
+        for (size_t i = 0; i < __NELEMS; ++i)
+        {
+            if (!q.push(&(elems[i])))
+            {
+                std::cerr << "ERROR: failed to push element " << i << std::endl;
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief test queue in order delivery between producer and consumer threads
+     *
+     * @param[out] q queue to test
+     */
+    void test_ordering(wu::PQueue<size_t> &q)
+    {
+        size_t *elems = new size_t[__NELEMS];
+        for (size_t i = 0; i < __NELEMS; ++i)
+        {
+            elems[i] = i;
+        }
+        std::thread t_p(produce, std::ref(q), elems);
+        for (size_t i = 0; i < __NELEMS; ++i)
+        {
+            size_t *e;
+            if (!q.pop(e))
+            {
+                std::cerr << "ERROR: failed to pop element " << i << std::endl;
+                break;
+            }
+            if (*e != i)
+            {
+                std::cerr << "ERROR: expected element " << i << " but popped " << *e << std::endl;
+                break;
+            }
+        }
+        t_p.join();
+        if (q.get_size() != 0)
+        {
+            std::cerr << "ERROR: queue not empty after popping all elements" << std::endl;
+        }
+        wu::QueueStats stats;
+        q.get_stats(stats);
+        if (stats.pushes != stats.pops || stats.high_water > q.get_capacity() * 2)
+        {
+            std::cerr << "ERROR: inconsistent stats, pushes: " << stats.pushes
+                      << " pops: " << stats.pops << " high water: " << stats.high_water << std::endl;
+        }
+        delete[] elems;
+    }
+
+    /**
+     * @brief push all elements in order in fixed size batches, blocking when full
+     *
+     * @param[out] q queue to push to
+     * @param elems elements to push
+     */
+    void produce_batches(wu::PQueue<size_t> &q, size_t *elems)
+    {
+        size_t *batch[__PUSHBATCHSZ];
+        for (size_t i = 0; i < __NELEMS; i += __PUSHBATCHSZ)
+        {
+            const size_t n = std::min(__PUSHBATCHSZ, __NELEMS - i);
+            for (size_t j = 0; j < n; ++j)
+            {
+                batch[j] = &(elems[i + j]);
+            }
+            if (q.push_n(batch, n) != n)
+            {
+                std::cerr << "ERROR: failed to push batch at element " << i << std::endl;
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief test queue in order delivery of batched pushes and pops
+     *
+     * @param[out] q queue to test
+     */
+    void test_batches(wu::PQueue<size_t> &q)
+    {
+        size_t *elems = new size_t[__NELEMS];
+        for (size_t i = 0; i < __NELEMS; ++i)
+        {
+            elems[i] = i;
+        }
+        std::thread t_p(produce_batches, std::ref(q), elems);
+        size_t *batch[__POPBATCHSZ];
+        size_t i = 0;
+        while (i < __NELEMS)
+        {
+            const size_t n = q.pop_n(batch, __POPBATCHSZ);
+            if (n == 0)
+            {
+                std::cerr << "ERROR: failed to pop batch at element " << i << std::endl;
+                break;
+            }
+            for (size_t j = 0; j < n; ++j, ++i)
+            {
+                if (*(batch[j]) != i)
+                {
+                    std::cerr << "ERROR: expected element " << i << " but popped " << *(batch[j]) << std::endl;
+                    i = __NELEMS;
+                    break;
+                }
+            }
+        }
+        t_p.join();
+        if (q.pop_n(batch, __POPBATCHSZ, __TIMEOUT) != 0)
+        {
+            std::cerr << "ERROR: timed batch pop succeeded on empty queue" << std::endl;
+        }
+        delete[] elems;
+    }
+
+    /**
+     * @brief test timed pop on empty queue and timed push on full queue
+     *
+     * @param[out] q queue to test
+     */
+    void test_timeouts(wu::PQueue<size_t> &q)
+    {
+        size_t e = 0;
+        size_t *p;
+        if (q.pop(p, __TIMEOUT))
+        {
+            std::cerr << "ERROR: timed pop succeeded on empty queue" << std::endl;
+        }
+        for (size_t i = 0; i < q.get_capacity(); ++i)
+        {
+            if (!q.push(&e, __TIMEOUT))
+            {
+                std::cerr << "ERROR: timed push failed on non-full queue" << std::endl;
+            }
+        }
+        if (q.push(&e, __TIMEOUT))
+        {
+            std::cerr << "ERROR: timed push succeeded on full queue" << std::endl;
+        }
+        q.flush();
+        // consume flush signals, as no threads were waiting
+        q.pop(p, __TIMEOUT);
+        q.push(&e, __TIMEOUT);
+    }
+
+    /**
+     * @brief test flush waking a blocked pop
+     *
+     * @param[out] q queue to test
+     */
+    void test_flush(wu::PQueue<size_t> &q)
+    {
+        bool popped = true;
+        std::thread t_c([&]
+                        { size_t *p; popped = q.pop(p); });
+        std::this_thread::sleep_for(__TIMEOUT);
+        q.flush();
+        t_c.join();
+        if (popped)
+        {
+            std::cerr << "ERROR: blocked pop succeeded after flush" << std::endl;
+        }
+        size_t e = 0;
+        // consume push flush signal, as no threads were pushing
+        q.push(&e, __TIMEOUT);
+        q.push(&e);
+        if (q.get_size() != 1)
+        {
+            std::cerr << "ERROR: expected one element after flush and push" << std::endl;
+        }
+        q.flush();
+        size_t *p;
+        q.pop(p, __TIMEOUT);
+        q.push(&e, __TIMEOUT);
+    }
+
+    /**
+     * @brief weigh element by its value
+     *
+     * @param e element to weigh
+     * @return element value, 0 for nullptr
+     */
+    size_t weigh(const size_t *e)
+    {
+        return (e == nullptr) ? 0 : *e;
+    }
+
+    /**
+     * @brief test weight limit of queue constructed with weigh() and __WLIMIT
+     *
+     * @param[out] q queue to test
+     */
+    void test_weights(wu::PQueue<size_t> &q)
+    {
+        size_t elems[] = {4, 4, 2, 1, 2 * __WLIMIT};
+        size_t *p;
+        for (size_t i = 0; i < 3; ++i)
+        {
+            if (!q.push(&(elems[i]), __TIMEOUT))
+            {
+                std::cerr << "ERROR: weighted push failed below limit" << std::endl;
+            }
+            if (i == 1 && (!q.has_room() || !q.has_room(q.weigh(&(elems[2]))) || q.has_room(q.weigh(&(elems[0])))))
+            {
+                std::cerr << "ERROR: room below limit does not match remaining weight" << std::endl;
+            }
+        }
+        if (q.get_weight() != __WLIMIT)
+        {
+            std::cerr << "ERROR: expected weight " << __WLIMIT << " but got " << q.get_weight() << std::endl;
+        }
+        if (q.has_room() || q.has_room(q.weigh(&(elems[3]))))
+        {
+            std::cerr << "ERROR: room reported at limit" << std::endl;
+        }
+        size_t *over = &(elems[3]);
+        if (q.push_n(&over, 1, std::chrono::nanoseconds::zero()) != 0)
+        {
+            std::cerr << "ERROR: nonblocking weighted push succeeded above limit" << std::endl;
+        }
+        if (q.push(&(elems[3]), __TIMEOUT))
+        {
+            std::cerr << "ERROR: weighted push succeeded above limit" << std::endl;
+        }
+        // consumer frees weight while producer is blocked
+        std::thread t_c([&]
+                        { std::this_thread::sleep_for(__TIMEOUT); q.pop(p); });
+        if (!q.push(&(elems[3])))
+        {
+            std::cerr << "ERROR: weighted push failed after pop" << std::endl;
+        }
+        t_c.join();
+        size_t *batch[__QCAP];
+        const size_t n = q.pop_n(batch, __QCAP);
+        if (n != 3 || q.get_weight() != 0)
+        {
+            std::cerr << "ERROR: weighted batch pop did not empty queue" << std::endl;
+        }
+        if (!q.has_room(q.weigh(&(elems[4]))))
+        {
+            std::cerr << "ERROR: empty queue has no room for oversized element" << std::endl;
+        }
+        // oversized element accepted by empty queue
+        if (!q.push(&(elems[4]), __TIMEOUT) || q.push(&(elems[3]), __TIMEOUT))
+        {
+            std::cerr << "ERROR: oversized element handling failed" << std::endl;
+        }
+        q.flush();
+        if (q.get_weight() != 0)
+        {
+            std::cerr << "ERROR: weight not cleared by flush" << std::endl;
+        }
+    }
+
+    /**
+     * @brief pop all elements in order from one broadcast consumer
+     *
+     * @param[out] c consumer to pop from
+     * @param[out] ok set false on failure
+     */
+    void consume(wu::PQueue<size_t> &c, bool &ok)
+    {
+        for (size_t i = 0; i < __NELEMS; ++i)
+        {
+            size_t *e;
+            if (!c.pop(e) || *e != i)
+            {
+                ok = false;
+                return;
+            }
+        }
+    }
+
+    /**
+     * @brief test every consumer of broadcast queue receiving every element in order
+     *
+     * @param[out] q broadcast queue to test
+     */
+    void test_broadcast(wu::BPQueue<size_t> &q)
+    {
+        wu::BPQueue<size_t>::Consumer *c0 = q.subscribe();
+        wu::BPQueue<size_t>::Consumer *c1 = q.subscribe();
+        size_t *elems = new size_t[__NELEMS];
+        for (size_t i = 0; i < __NELEMS; ++i)
+        {
+            elems[i] = i;
+        }
+        bool ok0 = true;
+        bool ok1 = true;
+        std::thread t_c0(consume, std::ref(*c0), std::ref(ok0));
+        std::thread t_c1(consume, std::ref(*c1), std::ref(ok1));
+        produce_batches(*c0, elems);
+        t_c0.join();
+        t_c1.join();
+        if (!ok0 || !ok1)
+        {
+            std::cerr << "ERROR: broadcast consumer missed or reordered elements" << std::endl;
+        }
+        wu::QueueStats stats;
+        c1->get_stats(stats);
+        if (stats.pushes != __NELEMS || stats.pops != __NELEMS || stats.high_water > q.get_capacity())
+        {
+            std::cerr << "ERROR: inconsistent broadcast stats, pushes: " << stats.pushes
+                      << " pops: " << stats.pops << " high water: " << stats.high_water << std::endl;
+        }
+        q.unsubscribe(c1);
+        q.unsubscribe(c0);
+        delete[] elems;
+    }
+
+    /**
+     * @brief test slow consumer backpressure and skipping with SLOW_DROP
+     *
+     * @param[out] q broadcast queue to test, constructed with SLOW_DROP
+     */
+    void test_broadcast_drop(wu::BPQueue<size_t> &q)
+    {
+        wu::BPQueue<size_t>::Consumer *fast = q.subscribe();
+        wu::BPQueue<size_t>::Consumer *slow = q.subscribe();
+        size_t e = 0;
+        size_t *p;
+        for (size_t i = 0; i < q.get_capacity(); ++i)
+        {
+            fast->push(&e, __TIMEOUT);
+        }
+        // neither consumer is caught up, slowest applies backpressure
+        if (fast->push(&e, __TIMEOUT))
+        {
+            std::cerr << "ERROR: broadcast push succeeded with no caught up consumer" << std::endl;
+        }
+        size_t *batch[__QCAP];
+        fast->pop_n(batch, __QCAP);
+        // fast consumer caught up, slow consumer skips ahead
+        if (!fast->push(&e, __TIMEOUT) || slow->get_size() != 1 || !slow->pop(p, __TIMEOUT))
+        {
+            std::cerr << "ERROR: slow broadcast consumer not skipped" << std::endl;
+        }
+        wu::QueueStats stats;
+        slow->get_stats(stats);
+        if (stats.flushed != q.get_capacity() || stats.pops != 1)
+        {
+            std::cerr << "ERROR: expected " << q.get_capacity() << " skipped elements but got " << stats.flushed << std::endl;
+        }
+        q.unsubscribe(slow);
+        q.unsubscribe(fast);
+    }
+
+    /**
+     * @brief clone callback sharing elements, failing (as if out of memory) while __nclonefail is nonzero
+     *
+     * @param e element to clone
+     * @return e, nullptr on failure
+     */
+    size_t *fail_clone(const size_t *e)
+    {
+        size_t n = __nclonefail.load();
+        while (n != 0 && !__nclonefail.compare_exchange_weak(n, n - 1))
+        {
+        }
+        return (n != 0) ? nullptr : const_cast<size_t *>(e);
+    }
+
+    /**
+     * @brief test failed clones are retried or fall back to the original, never popped as nullptr
+     *
+     * @param[out] q broadcast queue to test, constructed with fail_clone()
+     */
+    void test_clone_failure(wu::BPQueue<size_t> &q)
+    {
+        wu::BPQueue<size_t>::Consumer *c0 = q.subscribe();
+        wu::BPQueue<size_t>::Consumer *c1 = q.subscribe();
+        size_t e = 0;
+        size_t *p = nullptr;
+        // clone fails once, popping retries
+        __nclonefail = 1;
+        c0->push(&e);
+        if (!c0->pop(p, __TIMEOUT) || p != &e || !c1->pop(p, __TIMEOUT) || p != &e)
+        {
+            std::cerr << "ERROR: failed clone not retried" << std::endl;
+        }
+        // clone keeps failing, element stays unread until its other reader is gone
+        __nclonefail = SIZE_MAX;
+        p = &e;
+        c0->push(&e);
+        if (c0->pop(p, __TIMEOUT) || p != &e || c0->get_size() != 1)
+        {
+            std::cerr << "ERROR: failed clone popped" << std::endl;
+        }
+        q.unsubscribe(c1);
+        p = nullptr;
+        if (!c0->pop(p, __TIMEOUT) || p != &e)
+        {
+            std::cerr << "ERROR: last reader did not take original after failed clone" << std::endl;
+        }
+        __nclonefail = 0;
+        q.unsubscribe(c0);
+    }
+
+    /**
+     * @brief flush callback counting discarded elements
+     *
+     * @param e discarded element
+     */
+    void count_discard(size_t *e)
+    {
+        (void)e;
+        __ndiscard++;
+    }
+
+    /**
+     * @brief test discarding (lazy or eager) of elements pushed before advancing epoch
+     *
+     * @param[out] q queue to test, constructed with count_discard() and capacity __EPOCHQCAP
+     */
+    void test_epochs(wu::PQueue<size_t> &q)
+    {
+        size_t e = 0;
+        size_t fresh = 1;
+        size_t *p = nullptr;
+        const size_t nstale = __EPOCHQCAP - 1;
+        __ndiscard = 0;
+        for (size_t i = 0; i < nstale; ++i)
+        {
+            q.push(&e);
+        }
+        q.advance_epoch();
+        if (q.pop(p, __TIMEOUT) || __ndiscard != nstale || q.get_size() != 0)
+        {
+            std::cerr << "ERROR: expected " << nstale << " stale elements discarded but got " << __ndiscard << std::endl;
+        }
+        for (size_t i = 0; i < nstale; ++i)
+        {
+            q.push(&e);
+        }
+        q.advance_epoch();
+        q.push(&fresh);
+        if (!q.pop(p) || p != &fresh || __ndiscard != 2 * nstale)
+        {
+            std::cerr << "ERROR: stale elements popped after advancing epoch" << std::endl;
+        }
+        wu::QueueStats stats;
+        q.get_stats(stats);
+        if (stats.flushed != 2 * nstale || stats.pops != 1)
+        {
+            std::cerr << "ERROR: inconsistent epoch stats, flushed: " << stats.flushed
+                      << " pops: " << stats.pops << std::endl;
+        }
+    }
+
+    /**
+     * @brief select odd elements
+     *
+     * @param e element to check
+     * @return true if element is odd
+     */
+    bool is_odd(const size_t *e)
+    {
+        return (*e & 1) != 0;
+    }
+
+    /**
+     * @brief test removing only matching elements from both underlying buffers
+     *
+     * @param[out] q queue to test
+     */
+    void test_flush_if(wu::DBPQueue<size_t> &q)
+    {
+        size_t elems[10] = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+        size_t *p;
+        for (size_t i = 0; i < 6; ++i)
+        {
+            q.push(&(elems[i]));
+        }
+        // swap buffers so elements reside in both
+        q.pop(p);
+        for (size_t i = 6; i < 10; ++i)
+        {
+            q.push(&(elems[i]));
+        }
+        const size_t removed = q.flush_if(is_odd);
+        size_t *batch[__QCAP];
+        const size_t n = q.pop_n(batch, __QCAP);
+        if (removed != 5 || n != 4 || *(batch[0]) != 2 || *(batch[1]) != 4 || *(batch[2]) != 6 || *(batch[3]) != 8)
+        {
+            std::cerr << "ERROR: flush_if removed " << removed << " elements, kept " << n << std::endl;
+        }
+    }
+
+    /// @brief number of pool elements currently allocated
+    std::atomic<size_t> __nlive(0);
+
+    /**
+     * @brief pool allocation callback counting live elements
+     *
+     * @return new element
+     */
+    size_t *alloc_elem()
+    {
+        __nlive++;
+        return new size_t(0);
+    }
+
+    /**
+     * @brief pool reset callback
+     *
+     * @param[out] e element to reset
+     */
+    void reset_elem(size_t *e)
+    {
+        *e = 0;
+    }
+
+    /**
+     * @brief pool free callback counting live elements
+     *
+     * @param e element to free
+     */
+    void free_elem(size_t *e)
+    {
+        __nlive--;
+        delete e;
+    }
+
+    /**
+     * @brief test recycling pooled elements from consumer back to producer through a queue
+     *
+     * @param[out] pool pool to test, constructed with alloc_elem(), reset_elem(), and free_elem()
+     */
+    void test_recycle(wu::PPool<size_t> &pool)
+    {
+        wu::DBPQueue<size_t> q(__QCAP);
+        bool ok = true;
+        std::thread t_c([&]
+                        {
+                            size_t *p;
+                            for (size_t i = 0; i < __NELEMS; ++i)
+                            {
+                                q.pop(p);
+                                if (*p != i + 1)
+                                {
+                                    ok = false;
+                                }
+                                pool.release(p);
+                            } });
+        for (size_t i = 0; i < __NELEMS; ++i)
+        {
+            size_t *p = pool.acquire();
+            if (*p != 0)
+            {
+                // not reset when released
+                ok = false;
+            }
+            *p = i + 1;
+            q.push(p);
+        }
+        t_c.join();
+
+        // dual buffers, consumer, and producer hold at most 2 * capacity + 2 elements at once
+        const uint64_t allocs = pool.get_allocs();
+        if (!ok || allocs > 2 * __QCAP + 2 || __nlive.load() != allocs)
+        {
+            std::cerr << "ERROR: pool allocated " << allocs << " elements for " << __NELEMS
+                      << " recycled elements, " << __nlive.load() << " live" << std::endl;
+        }
+    }
+
+    /**
+     * @brief test pool freeing elements released beyond its capacity
+     *
+     * @param[out] pool pool to test, constructed with alloc_elem(), reset_elem(), and free_elem()
+     */
+    void test_overflow(wu::PPool<size_t> &pool)
+    {
+        const size_t n = pool.get_capacity() * 2;
+        const size_t before = __nlive.load();
+        size_t **elems = new size_t *[n];
+        for (size_t i = 0; i < n; ++i)
+        {
+            elems[i] = pool.acquire();
+        }
+        for (size_t i = 0; i < n; ++i)
+        {
+            pool.release(elems[i]);
+        }
+        pool.release(nullptr);
+        delete[] elems;
+        const size_t live = __nlive.load();
+        if (live < before || live > pool.get_capacity())
+        {
+            std::cerr << "ERROR: pool kept " << live << " elements with capacity " << pool.get_capacity() << std::endl;
+        }
+    }
+
+    /**
+     * @class PoolProducer
+     * @brief pooled threader pushing elements in order, then end sentinel (nullptr)
+     */
+    class PoolProducer : public wu::Threader
+    {
+    public:
+        /**
+         * @brief constructor
+         *
+         * @param executor shared pool to run on
+         * @param q queue to push to
+         * @param elems __POOLNELEMS elements to push
+         */
+        PoolProducer(wu::Executor &executor, wu::PQueue<size_t> &q, size_t *elems)
+            : Threader(&executor),
+              _q(&q),
+              _elems(elems),
+              _i(0)
+        {
+        }
+
+        /**
+         * @brief destructor, waits for loop body before members are destroyed
+         */
+        virtual ~PoolProducer()
+        {
+            terminate();
+        }
+
+    protected:
+        /**
+         * @brief push next element without waiting longer than executor idle wait
+         */
+        void execute_loop_body() override
+        {
+            if (_i == __POOLNELEMS)
+            {
+                if (_q->push(nullptr, wu::Executor::IDLE_WAIT))
+                {
+                    set_state_stop();
+                }
+            }
+            else if (_q->push(&(_elems[_i]), wu::Executor::IDLE_WAIT))
+            {
+                _i++;
+            }
+        }
+
+        /**
+         * @brief check for queue space
+         *
+         * @return true if queue is not full
+         */
+        bool is_ready() override
+        {
+            return _q->get_size() < _q->get_capacity();
+        }
+
+        /// @brief queue to push to
+        wu::PQueue<size_t> *_q;
+        /// @brief elements to push
+        size_t *_elems;
+        /// @brief index of next element to push
+        size_t _i;
+    };
+
+    /**
+     * @class PoolConsumer
+     * @brief pooled threader popping and checking order of elements until end sentinel (nullptr)
+     */
+    class PoolConsumer : public wu::Threader
+    {
+    public:
+        /**
+         * @brief constructor
+         *
+         * @param executor shared pool to run on
+         * @param q queue to pop from
+         */
+        PoolConsumer(wu::Executor &executor, wu::PQueue<size_t> &q)
+            : Threader(&executor),
+              _q(&q),
+              _n(0),
+              _ok(true)
+        {
+        }
+
+        /**
+         * @brief destructor, waits for loop body before members are destroyed
+         */
+        virtual ~PoolConsumer()
+        {
+            terminate();
+        }
+
+        /**
+         * @brief check consumed elements once stopped
+         *
+         * @return true if all elements were popped in order
+         */
+        bool is_valid() const
+        {
+            return _ok && _n == __POOLNELEMS;
+        }
+
+    protected:
+        /**
+         * @brief pop next element without waiting longer than executor idle wait
+         */
+        void execute_loop_body() override
+        {
+            size_t *p;
+            if (!_q->pop(p, wu::Executor::IDLE_WAIT))
+            {
+                return;
+            }
+            if (p == nullptr)
+            {
+                set_state_stop();
+                return;
+            }
+            _ok = _ok && *p == _n;
+            _n++;
+        }
+
+        /**
+         * @brief check for queued elements
+         *
+         * @return true if queue is not empty
+         */
+        bool is_ready() override
+        {
+            return _q->get_size() != 0;
+        }
+
+        /// @brief queue to pop from
+        wu::PQueue<size_t> *_q;
+        /// @brief number of elements popped
+        size_t _n;
+        /// @brief true if all elements were popped in order
+        bool _ok;
+    };
+
+    /**
+     * @class IdleTask
+     * @brief executor task counting how often it is polled, idle until finished
+     */
+    class IdleTask : public wu::Executor::Task
+    {
+    public:
+        /**
+         * @brief count run, finish once requested
+         *
+         * @return TASK_DONE if finish was set, TASK_IDLE otherwise
+         */
+        Result run() override
+        {
+            nruns.fetch_add(1);
+            if (finish.load())
+            {
+                done.store(true);
+                return TASK_DONE;
+            }
+            return TASK_IDLE;
+        }
+
+        /// @brief number of times run
+        std::atomic<size_t> nruns{0};
+        /// @brief set to finish task on next run
+        std::atomic<bool> finish{false};
+        /// @brief set once task finished
+        std::atomic<bool> done{false};
+    };
+
+    /**
+     * @brief test pool threads park on idle tasks instead of polling them, until woken
+     *
+     * @param[out] executor shared pool to test
+     */
+    void test_idle_parking(wu::Executor &executor)
+    {
+        IdleTask task;
+        executor.submit(&task);
+        std::this_thread::sleep_for(__IDLEPERIOD);
+        // a few polls per park (threads may steal the task in turns), polling every IDLE_WAIT would be hundreds
+        const size_t max_runs = __NPOOLTHREADS * 4 * (2 + __IDLEPERIOD / wu::Executor::IDLE_PARK);
+        const size_t nruns = task.nruns.load();
+        if (nruns > max_runs)
+        {
+            std::cerr << "ERROR: idle task polled " << nruns << " times in " << __IDLEPERIOD.count()
+                      << "ms (expected at most " << max_runs << ")" << std::endl;
+        }
+
+        task.finish.store(true);
+        executor.wake();
+        const std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + wu::Executor::IDLE_PARK / 2;
+        while (!task.done.load() && std::chrono::steady_clock::now() < deadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        if (!task.done.load())
+        {
+            std::cerr << "ERROR: wake did not rerun parked idle task" << std::endl;
+        }
+        // executor must not run the task once destroyed
+        while (!task.done.load())
+        {
+            std::this_thread::sleep_for(__TIMEOUT);
+        }
+    }
+
+    /**
+     * @brief test many pooled producer consumer pairs sharing fewer executor threads
+     *
+     * @param[out] executor shared pool to test
+     */
+    void test_pooled_pairs(wu::Executor &executor)
+    {
+        size_t *elems = new size_t[__POOLNELEMS];
+        for (size_t i = 0; i < __POOLNELEMS; ++i)
+        {
+            elems[i] = i;
+        }
+        std::vector<wu::DBPQueue<size_t> *> qs;
+        std::vector<PoolProducer *> ps;
+        std::vector<PoolConsumer *> cs;
+        for (size_t i = 0; i < __NPAIRS; ++i)
+        {
+            qs.push_back(new wu::DBPQueue<size_t>(__QCAP));
+            ps.push_back(new PoolProducer(executor, *(qs[i]), elems));
+            cs.push_back(new PoolConsumer(executor, *(qs[i])));
+            cs[i]->start();
+            ps[i]->start();
+        }
+
+        wu::Threader::State state;
+        for (size_t i = 0; i < __NPAIRS; ++i)
+        {
+            do
+            {
+                std::this_thread::sleep_for(__TIMEOUT);
+                cs[i]->get_state(state);
+            } while (state.run);
+        }
+        size_t nvalid = 0;
+        for (size_t i = 0; i < __NPAIRS; ++i)
+        {
+            nvalid += cs[i]->is_valid() ? 1 : 0;
+            delete cs[i];
+            delete ps[i];
+            delete qs[i];
+        }
+        delete[] elems;
+        if (nvalid != __NPAIRS)
+        {
+            std::cerr << "ERROR: only " << nvalid << " of " << __NPAIRS << " pooled pairs passed elements in order" << std::endl;
+        }
+    }
+
+    /**
+     * @class Ticker
+     * @brief threader updating its timestamp as fast as possible, then stopping
+     */
+    class Ticker : public wu::Threader
+    {
+    public:
+        /**
+         * @brief destructor, waits for loop body before members are destroyed
+         */
+        virtual ~Ticker()
+        {
+            terminate();
+        }
+
+    protected:
+        /**
+         * @brief increment timestamp, stop after __NTICKS
+         */
+        void execute_loop_body() override
+        {
+            const int64_t ts = get_timestamp() + 1;
+            set_state_timestamp(ts);
+            if (ts == __NTICKS)
+            {
+                set_state_pause();
+            }
+        }
+    };
+
+    /**
+     * @class SlowHandler
+     * @brief state handler taking __HANDLEDELAY per call and recording received states
+     */
+    class SlowHandler : public wu::Threader::StateHandler
+    {
+    public:
+        /**
+         * @brief record state and stall
+         *
+         * @param state state to handle
+         */
+        void handle(const wu::Threader::State &state) override
+        {
+            // timestamps only increase until paused
+            ok = ok && state.timestamp >= last.timestamp;
+            last = state;
+            ncalls++;
+            std::this_thread::sleep_for(__HANDLEDELAY);
+        }
+
+        /// @brief true if received states were in order
+        bool ok = true;
+        /// @brief number of handled states
+        size_t ncalls = 0;
+        /// @brief last handled state
+        wu::Threader::State last = {.run = false,
+                                    .error = 0,
+                                    .timestamp = 0};
+    };
+
+    /**
+     * @brief test slow handlers do not stall worker and coalesced timestamps arrive in order
+     *
+     * timestamps read lock-free while ticking must never go backwards
+     *
+     * @param[out] n notifier to test
+     */
+    void test_coalescing(wu::Notifier &n)
+    {
+        SlowHandler h;
+        {
+            Ticker t;
+            t.set_notifier(&n, true);
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            t.start(&h);
+            wu::Threader::State state;
+            int64_t last_ts = 0;
+            do
+            {
+                const int64_t ts = t.get_timestamp();
+                if (ts < last_ts || ts > __NTICKS)
+                {
+                    std::cerr << "ERROR: read timestamp " << ts << " after " << last_ts << std::endl;
+                }
+                last_ts = ts;
+                t.get_state(state);
+            } while (state.run);
+            const std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start;
+            if (t.get_timestamp() != __NTICKS)
+            {
+                std::cerr << "ERROR: final timestamp " << t.get_timestamp() << std::endl;
+            }
+            if (t.get_progress_time() < start || t.get_progress_time() > std::chrono::steady_clock::now())
+            {
+                std::cerr << "ERROR: progress time not recorded by timestamp updates" << std::endl;
+            }
+            // synchronous handling would take __NTICKS * __HANDLEDELAY
+            if (elapsed >= __NTICKS * __HANDLEDELAY / 10)
+            {
+                std::cerr << "ERROR: worker stalled by state handler" << std::endl;
+            }
+            // destroying threader drains its queued events
+        }
+        if (!h.ok || h.last.run || h.last.timestamp != __NTICKS || h.ncalls >= static_cast<size_t>(__NTICKS))
+        {
+            std::cerr << "ERROR: notifier handled " << h.ncalls << " states, last timestamp "
+                      << h.last.timestamp << " running " << h.last.run << std::endl;
+        }
+    }
+
+    /**
+     * @class TimedWorker
+     * @brief threader spinning then sleeping each iteration, sleep counted as waiting
+     */
+    class TimedWorker : public wu::Threader
+    {
+    public:
+        /**
+         * @brief destructor, waits for loop body before members are destroyed
+         */
+        virtual ~TimedWorker()
+        {
+            terminate();
+        }
+
+    protected:
+        /**
+         * @brief spin for __TIMEDBUSY, wait for __TIMEDWAIT, stop after __NTIMED iterations
+         */
+        void execute_loop_body() override
+        {
+            const std::chrono::steady_clock::time_point busy_end = std::chrono::steady_clock::now() + __TIMEDBUSY;
+            while (std::chrono::steady_clock::now() < busy_end)
+            {
+            }
+            const std::chrono::steady_clock::time_point start = wait_start();
+            std::this_thread::sleep_for(__TIMEDWAIT);
+            count_wait(start);
+            if (++_n == __NTIMED)
+            {
+                set_state_pause();
+            }
+        }
+
+        /// @brief number of iterations run
+        uint64_t _n = 0;
+    };
+
+    /**
+     * @class BatchWorker
+     * @brief threader counting iterations in unbounded batches, optionally pausing itself
+     */
+    class BatchWorker : public wu::Threader
+    {
+    public:
+        /**
+         * @brief constructor
+         *
+         * @param executor pool to run on, nullptr = dedicated thread
+         * @param pause_at iteration to pause at, 0 = never
+         */
+        BatchWorker(wu::Executor *executor, uint64_t pause_at)
+            : Threader(executor),
+              n(0),
+              _pause_at(pause_at)
+        {
+            set_batch_budget({.iterations = SIZE_MAX,
+                              .duration = std::chrono::microseconds(0)});
+        }
+
+        /**
+         * @brief destructor, waits for loop body before members are destroyed
+         */
+        virtual ~BatchWorker()
+        {
+            terminate();
+        }
+
+        /// @brief number of iterations run
+        std::atomic<uint64_t> n;
+
+    protected:
+        /**
+         * @brief count iteration, pause if at pause iteration
+         */
+        void execute_loop_body() override
+        {
+            if (n.fetch_add(1) + 1 == _pause_at)
+            {
+                set_state_pause();
+            }
+        }
+
+        /// @brief iteration to pause at
+        const uint64_t _pause_at;
+    };
+
+    /**
+     * @brief test unbounded batches still end on state changes from within and outside loop body
+     *
+     * @param executor pool to run on, nullptr = dedicated thread
+     */
+    void test_batch_stop(wu::Executor *executor)
+    {
+        constexpr uint64_t pause_at = 1000;
+        BatchWorker self(executor, pause_at);
+        BatchWorker ext(executor, 0);
+        self.start();
+        ext.start();
+        wu::Threader::State state;
+        do
+        {
+            std::this_thread::sleep_for(__TIMEOUT);
+            self.get_state(state);
+        } while (state.run);
+        std::this_thread::sleep_for(__TIMEOUT);
+        if (self.n.load() != pause_at)
+        {
+            std::cerr << "ERROR: batch ran " << self.n.load() << " iterations after pausing at " << pause_at << std::endl;
+        }
+
+        ext.pause();
+        std::this_thread::sleep_for(__TIMEOUT);
+        const uint64_t stopped = ext.n.load();
+        std::this_thread::sleep_for(__TIMEOUT);
+        if (ext.n.load() != stopped)
+        {
+            std::cerr << "ERROR: batch kept running after external pause" << std::endl;
+        }
+    }
+
+    /**
+     * @brief check if cancel token fd is readable without blocking
+     *
+     * @param token token to poll
+     * @return true if fd is readable
+     */
+    bool is_fd_cancelled(const wu::CancelToken &token)
+    {
+        struct pollfd pfd = {.fd = token.get_fd(), .events = POLLIN, .revents = 0};
+        return poll(&pfd, 1, 0) == 1 && (pfd.revents & POLLIN) != 0;
+    }
+
+    /**
+     * @class BlockedWorker
+     * @brief threader whose loop body blocks until its cancel token is cancelled
+     */
+    class BlockedWorker : public wu::Threader
+    {
+    public:
+        /**
+         * @brief destructor, waits for loop body before members are destroyed
+         */
+        virtual ~BlockedWorker()
+        {
+            terminate();
+        }
+
+        /// @brief number of loop bodies that returned
+        std::atomic<uint64_t> n{0};
+
+    protected:
+        /**
+         * @brief block in poll on cancel token fd only
+         */
+        void execute_loop_body() override
+        {
+            struct pollfd pfd = {.fd = get_cancel_token().get_fd(), .events = POLLIN, .revents = 0};
+            poll(&pfd, 1, -1);
+            n++;
+        }
+    };
+
+    /**
+     * @brief run all queue tests
+     *
+     * @param[out] q queue to test
+     */
+    void test_pqueue(wu::PQueue<size_t> &q)
+    {
+        test_ordering(q);
+        test_batches(q);
+        test_timeouts(q);
+        test_flush(q);
+    }
+
+}
+
+namespace whfa::test
+{
+
+    void test_dbpqueue()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+        wu::DBPQueue<size_t> q(__QCAP);
+        test_pqueue(q);
+        wu::DBPQueue<size_t> wq(__QCAP, nullptr, __WLIMIT, weigh);
+        test_weights(wq);
+        wu::DBPQueue<size_t> eq(__EPOCHQCAP, count_discard);
+        test_epochs(eq);
+        wu::DBPQueue<size_t> fiq(__QCAP);
+        test_flush_if(fiq);
+        wu::DBPQueue<size_t, wu::SpinWait<>> sq(__QCAP);
+        test_pqueue(sq);
+        wu::DBPQueue<size_t, wu::SpinFutexWait<>> fq(__QCAP);
+        test_pqueue(fq);
+        wu::DBPQueue<size_t, wu::SpinFutexWait<>> fwq(__QCAP, nullptr, __WLIMIT, weigh);
+        test_weights(fwq);
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_bpqueue()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+        wu::BPQueue<size_t> q(__QCAP);
+        test_pqueue(*q.subscribe());
+        wu::BPQueue<size_t> bq(__QCAP);
+        test_broadcast(bq);
+        wu::BPQueue<size_t> dq(__QCAP, nullptr, nullptr, wu::BPQueue<size_t>::SLOW_DROP);
+        test_broadcast_drop(dq);
+        wu::BPQueue<size_t> cq(__QCAP, nullptr, fail_clone);
+        test_clone_failure(cq);
+        wu::BPQueue<size_t> eq(__EPOCHQCAP, count_discard);
+        test_epochs(*eq.subscribe());
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_ppool()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+        {
+            wu::PPool<size_t> p(2 * __QCAP + 2, alloc_elem, reset_elem, free_elem);
+            test_recycle(p);
+            test_overflow(p);
+        }
+        if (__nlive.load() != 0)
+        {
+            std::cerr << "ERROR: pool leaked " << __nlive.load() << " elements" << std::endl;
+        }
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_executor()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+        wu::Executor executor(__NPOOLTHREADS);
+        test_pooled_pairs(executor);
+        test_idle_parking(executor);
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_notifier()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+        wu::Notifier n;
+        test_coalescing(n);
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_loopstats()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+        if (wu::LoopCounters::bucket(0) != 0 || wu::LoopCounters::bucket(1) != 0 ||
+            wu::LoopCounters::bucket(1023) != 9 || wu::LoopCounters::bucket(1024) != 10 ||
+            wu::LoopCounters::bucket(UINT64_MAX) != wu::LoopStats::NBUCKETS - 1)
+        {
+            std::cerr << "ERROR: incorrect histogram buckets" << std::endl;
+        }
+
+        TimedWorker t;
+        t.start();
+        wu::Threader::State state;
+        do
+        {
+            std::this_thread::sleep_for(__TIMEOUT);
+            t.get_state(state);
+        } while (state.run);
+
+        wu::LoopStats stats;
+        t.get_stats(stats);
+        if (!wu::LOOP_STATS_ENABLED)
+        {
+            std::cout << "DONE with " << __func__ << " (compiled out)" << std::endl;
+            return;
+        }
+        uint64_t nbusy = 0;
+        uint64_t nwait = 0;
+        for (size_t i = 0; i < wu::LoopStats::NBUCKETS; ++i)
+        {
+            nbusy += stats.busy_hist[i];
+            nwait += stats.wait_hist[i];
+        }
+        const uint64_t busy_min = __NTIMED * std::chrono::duration_cast<std::chrono::nanoseconds>(__TIMEDBUSY).count();
+        const uint64_t wait_min = __NTIMED * std::chrono::duration_cast<std::chrono::nanoseconds>(__TIMEDWAIT).count();
+        if (stats.iterations != __NTIMED || nbusy != __NTIMED || nwait != __NTIMED)
+        {
+            std::cerr << "ERROR: counted " << stats.iterations << " iterations, histograms counted "
+                      << nbusy << " busy and " << nwait << " wait" << std::endl;
+        }
+        if (stats.busy_ns < busy_min || stats.wait_ns < wait_min || stats.busy_ns >= stats.wait_ns)
+        {
+            std::cerr << "ERROR: timed " << stats.busy_ns << "ns busy, " << stats.wait_ns << "ns waiting" << std::endl;
+        }
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_batching()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+        test_batch_stop(nullptr);
+        wu::Executor e(__NPOOLTHREADS);
+        test_batch_stop(&e);
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_cancel()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+        wu::CancelToken token;
+        if (token.get_fd() < 0 || token.is_cancelled() || is_fd_cancelled(token))
+        {
+            std::cerr << "ERROR: new token cancelled" << std::endl;
+        }
+        token.cancel();
+        token.cancel();
+        if (!token.is_cancelled() || !is_fd_cancelled(token))
+        {
+            std::cerr << "ERROR: token not cancelled" << std::endl;
+        }
+        token.reset();
+        if (token.is_cancelled() || is_fd_cancelled(token))
+        {
+            std::cerr << "ERROR: reset token still cancelled" << std::endl;
+        }
+
+        {
+            BlockedWorker w;
+            w.start();
+            std::this_thread::sleep_for(__TIMEOUT);
+            if (w.n.load() != 0 || w.get_cancel_token().is_cancelled())
+            {
+                std::cerr << "ERROR: running worker cancelled" << std::endl;
+            }
+            w.pause();
+            std::this_thread::sleep_for(__TIMEOUT);
+            if (w.n.load() != 1)
+            {
+                std::cerr << "ERROR: pause did not cancel blocked loop body" << std::endl;
+            }
+            w.start();
+            std::this_thread::sleep_for(__TIMEOUT);
+            if (w.get_cancel_token().is_cancelled())
+            {
+                std::cerr << "ERROR: restarted worker still cancelled" << std::endl;
+            }
+            w.stop();
+            // loop body must have returned before destruction
+            while (w.n.load() != 2)
+            {
+                std::this_thread::sleep_for(__TIMEOUT);
+            }
+        }
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_spscpqueue()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+        wu::SPSCPQueue<size_t> q(__QCAP);
+        test_pqueue(q);
+        wu::SPSCPQueue<size_t> wq(__QCAP, nullptr, __WLIMIT, weigh);
+        test_weights(wq);
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+    void test_mappedfile()
+    {
+        std::cout << "TESTING " << __func__ << std::endl;
+        char path[] = "/tmp/whfa_mappedfileXXXXXX";
+        const int fd = mkstemp(path);
+        if (fd < 0)
+        {
+            std::cerr << "ERROR: failed to create temporary file" << std::endl;
+            return;
+        }
+        std::vector<uint8_t> data(__MAPSZ);
+        for (size_t i = 0; i < __MAPSZ; ++i)
+        {
+            data[i] = static_cast<uint8_t>(i * 31 + (i >> 8));
+        }
+        const bool written = write(fd, data.data(), __MAPSZ) == static_cast<ssize_t>(__MAPSZ);
+        close(fd);
+
+        {
+            wu::MappedFile f(__MAPREADAHEAD);
+            if (!written || !f.open(path) || f.get_filesize() != __MAPSZ)
+            {
+                std::cerr << "ERROR: failed to map file" << std::endl;
+                unlink(path);
+                return;
+            }
+
+            std::vector<uint8_t> buf(__MAPSZ);
+            uint64_t total = 0;
+            uint64_t n;
+            while ((n = f.read(&(buf[total]), __MAPREADSZ)) != 0)
+            {
+                total += n;
+            }
+            if (total != __MAPSZ || buf != data || f.get_position() != __MAPSZ)
+            {
+                std::cerr << "ERROR: sequential read mismatch, read " << total << " bytes" << std::endl;
+            }
+
+            uint8_t b;
+            if (!f.seek(-1, SEEK_END) || f.read(&b, 1) != 1 || b != data[__MAPSZ - 1])
+            {
+                std::cerr << "ERROR: seek from end mismatch" << std::endl;
+            }
+            if (!f.seek(__MAPSZ / 2, SEEK_SET) || !f.seek(-3, SEEK_CUR) || f.read(&b, 1) != 1 ||
+                b != data[__MAPSZ / 2 - 3] || f.get_position() != __MAPSZ / 2 - 2)
+            {
+                std::cerr << "ERROR: random access mismatch" << std::endl;
+            }
+            if (f.seek(1, SEEK_END) || f.seek(-1, SEEK_SET) || f.get_position() != __MAPSZ / 2 - 2)
+            {
+                std::cerr << "ERROR: seek outside of file succeeded" << std::endl;
+            }
+            if (!f.seek(0, SEEK_END) || f.read(&b, 1) != 0)
+            {
+                std::cerr << "ERROR: read past end of file" << std::endl;
+            }
+            f.close();
+            if (f.is_open() || f.read(&b, 1) != 0 || f.seek(0, SEEK_SET))
+            {
+                std::cerr << "ERROR: closed file still readable" << std::endl;
+            }
+        }
+        unlink(path);
+
+        wu::MappedFile missing;
+        if (missing.open(path))
+        {
+            std::cerr << "ERROR: mapped missing file" << std::endl;
+        }
+        std::cout << "DONE with " << __func__ << std::endl;
+    }
+
+}
\ No newline at end of file
@@ -0,0 +1,60 @@
+/**
+ * @file test/util.h
+ * @author Robert Griffith
+ */
+#pragma once
+
+namespace whfa::test
+{
+
+    /**
+     * @brief test DBPQueue wait policies' ordering, batching, epochs, selective flushing, weight limits, timeouts, and flushing across threads
+     */
+    void test_dbpqueue();
+
+    /**
+     * @brief test BPQueue consumers' ordering, batching, timeouts, flushing, broadcasting, skipping, failed clones, and epochs
+     */
+    void test_bpqueue();
+
+    /**
+     * @brief test PPool recycling across threads, allocation bounds, and freeing beyond capacity
+     */
+    void test_ppool();
+
+    /**
+     * @brief test Executor running many pooled Threader producers and consumers on fewer threads
+     */
+    void test_executor();
+
+    /**
+     * @brief test Notifier dispatching slow handlers off worker threads and coalescing lock-free timestamps
+     */
+    void test_notifier();
+
+    /**
+     * @brief test Threader loop iteration counts and busy and wait time histograms
+     */
+    void test_loopstats();
+
+    /**
+     * @brief test Threader batch budgets end batches on state changes, dedicated and pooled
+     */
+    void test_batching();
+
+    /**
+     * @brief test CancelToken and Threader cancelling blocked loop bodies
+     */
+    void test_cancel();
+
+    /**
+     * @brief test SPSCPQueue ordering, batching, weight limits, timeouts, and flushing across threads
+     */
+    void test_spscpqueue();
+
+    /**
+     * @brief test MappedFile sequential reads, random access seeks, and bounds
+     */
+    void test_mappedfile();
+
+}
\ No newline at end of file